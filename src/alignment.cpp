@@ -37,279 +37,234 @@
  
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cstring>
-
-#if defined(__ARM_NEON__)
-#include <arm_neon.h>
-#endif
+#include <utility>
 
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "alignment.h"
+#include "alignment_simd.h"
+#include "alignment_wfa.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
 
 #define MAX_OP(a, b) ( (( a ) > ( b )) ? ( a ) : ( b ) )
+#define MIN_OP(a, b) ( (( a ) < ( b )) ? ( a ) : ( b ) )
 
 //____________________________________________________________________________________
 
-/**
-    The following numerical codes define "moves" available to the algorithm working in codon space for pairwise alignment.
-    The first (reference( sequence (represented by ROWS in the dynamic programming matrix) is the "blessed" reference sequence, i.e. it's in frame (no stop codons, divisble by 3)
-    The second (query) sequence (represented by COLUMNS in the dynamic programming matrix) is the one being mapped to the reference, and it admits out-of-frame indels
- 
-    The mnemonic for each macro is as follows
-        HY_XXX_YYY
-                Len (X) = Len (Y) = the number of characters output in the final alignment
-                Each '1' in the pattern corresponds to an actual alignment character being consumed from the input, and '0' - to a gap (indel)
- 
-        For example, i.f the pattern is
- 
-            HY_1101_1111, and the current context of the strings being aligned is
- 
-        REF: ... AGTACA ...
-        QRY: ...AAGTACA...
- 
-            then the output will receive
-        A-GT
-        AaGT
-            and the counter will advance 3 characters in the reference and 4 characters in the query
- 
-*/
-
-
-#define HY_ALIGNMENT_TYPES_COUNT 24
-
-// match or skip whole codons
-#define HY_111_111 0
-#define HY_111_000 1
-#define HY_000_111 2
+CodonReference::CodonReference ( char const * r_str
+                               , const long r_len
+                               , long * char_map
+                               , const cawlign_fp * cost_matrix
+                               , const long cost_stride
+                               , const long char_count
+                               , const cawlign_fp * codon3x2
+                               , const cawlign_fp * codon3x1
+                               )
+{
+    // offsets are strides in the corresponding scoring matrices
+    const long offset3x2 = HY_3X2_COUNT * char_count * char_count,
+               offset3x1 = HY_3X1_COUNT * char_count;
+
+    length      = r_len;
+    codon_count = r_len / 3;
+    codons      = new long [ codon_count ];
+    cost_rows   = new const cawlign_fp* [ codon_count ];
+    rows3x2     = new const cawlign_fp* [ codon_count ];
+    rows3x1     = new const cawlign_fp* [ codon_count ];
+    best_codon  = new cawlign_fp [ codon_count ];
+    best3x2     = new cawlign_fp [ codon_count ];
+    best3x1     = new cawlign_fp [ codon_count ];
+
+    for (long i = 0; i < codon_count; ++i ) {
+        const long c1 = char_map[ (unsigned char) r_str[ 3 * i ] ],
+                   c2 = char_map[ (unsigned char) r_str[ 3 * i + 1 ] ],
+                   c3 = char_map[ (unsigned char) r_str[ 3 * i + 2 ] ];
+
+        // anything other than a fully resolved codon gets mapped to the "generic unresolved" character
+        const long r_codon = ( c1 >= 0 && c2 >= 0 && c3 >= 0 ) ? ( c1 * char_count + c2 ) * char_count + c3 : cost_stride - 1;
+
+        codons   [ i ] = r_codon;
+        cost_rows[ i ] = cost_matrix + r_codon * cost_stride;
+        rows3x2  [ i ] = codon3x2 + r_codon * offset3x2;
+        rows3x1  [ i ] = codon3x1 + r_codon * offset3x1;
+
+        // the best scores any (partial) query codon can get against this codon
+        best_codon[ i ] = best3x2[ i ] = best3x1[ i ] = -INFINITY;
+        for (long k = 0; k < char_count * char_count * char_count; ++k ) {
+            best_codon[ i ] = MAX_OP ( best_codon[ i ], cost_rows[ i ][ k ] );
+        }
+        for (long k = 0; k < offset3x2; ++k ) {
+            best3x2[ i ] = MAX_OP ( best3x2[ i ], rows3x2[ i ][ k ] );
+        }
+        for (long k = 0; k < offset3x1; ++k ) {
+            best3x1[ i ] = MAX_OP ( best3x1[ i ], rows3x1[ i ][ k ] );
+        }
+    }
+}
 
-// match 3 in the ref to 1 in the query
-#define HY_111_100 3
-#define HY_111_010 4
-#define HY_111_001 5
+CodonReference::~CodonReference (void) {
+    delete [] codons;
+    delete [] cost_rows;
+    delete [] rows3x2;
+    delete [] rows3x1;
+    delete [] best_codon;
+    delete [] best3x2;
+    delete [] best3x1;
+}
 
-#define HY_3X1_START 3
-#define HY_3X1_COUNT 3
+//____________________________________________________________________________________
 
-// match 3 in the ref to 2 in the query
-#define HY_111_110 6
-#define HY_111_101 7
-#define HY_111_011 8
+// the length of the nucleotide k-mers in a StrandIndex; random matches of k-mers this long against a gene-sized
+// reference are rare, but they survive the substitutions between related sequences often enough
+#define STRAND_KMER_LENGTH 12
 
-/** 
- all operations consuming 3 chars in the reference and 2 in the query start with index 6 and there are 3 of them
-*/
-#define HY_3X2_START 6
-#define HY_3X2_COUNT 3
+/**
+ * @name StrandKmerCode
+ * @return the two-bit code of a nucleotide (complementary nucleotides have codes adding up to 3),
+ *         or -1 for ambiguous and other characters
+ */
 
-// match 3 in the ref to 4 in the query
-#define HY_1110_1111 9
-#define HY_1101_1111 10
-#define HY_1011_1111 11
-#define HY_0111_1111 12
+static inline long StrandKmerCode ( const char c ) {
+    switch ( toupper ( (unsigned char) c ) ) {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+        case 'U':
+            return 3;
+    }
+    return -1;
+}
 
-/**
- all operations consuming 3 chars in the reference and 4 in the query start with index 9 and there are 4 of them
-*/
-#define HY_3X4_START 9
-#define HY_3X4_COUNT 4
-
-// match 3 in the ref to 5 in the query
-
-#define HY_11100_11111 13
-#define HY_11010_11111 14
-#define HY_11001_11111 15
-#define HY_10110_11111 16
-#define HY_10101_11111 17
-#define HY_10011_11111 18
-#define HY_01110_11111 19
-#define HY_01101_11111 20
-#define HY_01011_11111 21
-#define HY_00111_11111 22
+StrandIndex::StrandIndex ( char const * r_str
+                         , const long r_len
+                         )
+{
+    const long mask = ( 1L << ( 2 * STRAND_KMER_LENGTH ) ) - 1;
 
-/**
- all operations consuming 3 chars in the reference and 5 in the query start with index 13 and there are 10 of them
-*/
-#define HY_3X5_START   13
-#define HY_3X5_COUNT   10
+    kmers      = new long [ MAX_OP ( r_len - STRAND_KMER_LENGTH + 1, 1 ) ];
+    kmer_count = 0;
 
+    // k-mers with ambiguous characters are skipped
+    long kmer = 0,
+         run  = 0;
 
-// the local align move (i.e. take a direct shortcut to any internal position in the alignment matrix)
+    for (long i = 0; i < r_len; ++i ) {
+        const long code = StrandKmerCode ( r_str[ i ] );
+        if ( code < 0 ) {
+            run = 0;
+            continue;
+        }
+        kmer = ( ( kmer << 2 ) | code ) & mask;
+        if ( ++run >= STRAND_KMER_LENGTH ) {
+            kmers[ kmer_count++ ] = kmer;
+        }
+    }
 
-#define HY_LOCAL_ALIGN_SHORTCUT 23
+    std::sort ( kmers, kmers + kmer_count );
+    kmer_count = std::unique ( kmers, kmers + kmer_count ) - kmers;
+}
 
-#define HY_MAXIMUM_RESOLUTIONS  8
+StrandIndex::~StrandIndex (void) {
+    delete [] kmers;
+}
 
 //____________________________________________________________________________________
 
-
 /**
- * @name CodonAlignStringsStep
- * Perform a single step in the codon alignment algorithm; returns the best operation and updates DP matrices
+ * @name QueryStrand
+ * Decides which strand of a (nucleotide) query matches the reference by counting the k-mers of the query, and of its
+ * reverse complement, which occur in the reference.
  *
- * @param score_matrix an NxN score matrix (N = 65, to accommodate all 64 codons plus an explicit "unresolved" character)
- * @param reference the reference string remapped with characters remapped to indices in score_matrix
- * @param query the query string remapped with characters remapped to indices in score_matrix
- * @param r index in reference (counted out in codons)
- * @param q index in query (counted out in nucleotides)
- * @param score_cols the number of columns in score_matrix
- * @param char_count the number of valid characters (nucleotides)
- * @param miscall_cost the cost of introducing an out-of-frame indel
- * @param open_deletion the cost of opening an indel in the reference 
- * @param extend_deletion the cost of extending an indel in the reference
- * @param open_inserion the cost of opening an indel in the query
- * @param extend_inserion the cost of extending an indel in the query
- * @param cost_matrix the main DP matrix
- * @param cost_stride the number of columns in the DP matrix
- * @param insertion_matrix the DP matrix for affine insertions
- * @param deletion_matrix the DP matrix for affine deletions
- * @param codon3x5 the 3-ref 5-qry scoring matrix
- * @param codon3x4 the 3-ref 4-qry scoring matrix
- * @param codon3x2 the 3-ref 2-qry scoring matrix
- * @param codon3x1 the 3-ref 1-qry scoring matrix
- * @param do_local if TRUE, perform a local alignment (no prefix/suffix indel cost)
+ * @param index the k-mers of the reference
+ * @param q_str the query
+ * @param q_len the length of the query
  *
- * @return the best scoring alignment operation
-
+ * @return 1 if the query clearly matches the forward strand, -1 if its reverse complement clearly does,
+ *         and 0 if the k-mers do not tell (both strands need to be aligned)
  */
 
-long CodonAlignStringsStep( cawlign_fp * const score_matrix
-                          , long * const reference
-                          , long * const query
-                          , const long r
-                          , const long q
-                          , const long score_cols
-                          , const long char_count
-                          , const cawlign_fp miscall_cost
-                          , const cawlign_fp open_insertion
-                          , const cawlign_fp open_deletion
-                          , const cawlign_fp extend_insertion
-                          , const cawlign_fp extend_deletion
-                          , const cawlign_fp * cost_matrix
-                          , const long cost_stride
-                          , cawlign_fp * const insertion_matrix
-                          , cawlign_fp * const deletion_matrix
-                          , cawlign_fp const *codon3x5
-                          , cawlign_fp const *  codon3x4
-                          , cawlign_fp const *  codon3x2
-                          , cawlign_fp const*  codon3x1
-                          , const    bool  do_local
-                          , cawlign_fp& score
-                          , long const * resolutions
-                          )
+long QueryStrand ( StrandIndex const * const index
+                 , char const * q_str
+                 , const long q_len
+                 )
 {
-    /**
-     * r is CODON position in the reference,
-     * q is NUC position in the query,
-     * curr is a pointer to the current position in the scoring matrix,
-     * prev is a pointer to the previous CODON in the scoring matrix
-     * NOTE: moving by score_cols in the scoring matrix changes the CODON
-     *       position in the scoring matrix, as we're only interested in CODON
-     *       alignments to the reference
-     * rpos is the position of r in the reference
-     * do_local is true if we wish to perform a local alignment 
-     */
-    const long curr = ( r ) * score_cols + q, // where we currently are in the DP matrix
-               prev = curr - score_cols, // upstream a codon in the reference for the DP matrix
-               // offsets are strides in the corresponding scoring matrices
-               offset3x5 = HY_3X5_COUNT * char_count * char_count * char_count, // both 3x5 and 3x4 are
-               offset3x4 = HY_3X4_COUNT * char_count * char_count * char_count, // full codons
-               offset3x2 = HY_3X2_COUNT * char_count * char_count,
-               offset3x1 = HY_3X1_COUNT * char_count,
-               rpos = r * 3; // the real position in R
-    
-    // mutable vars
-    long r_codon = -1,
-         q_codon = -1,
-         best_choice = 0,
-         //i,
-         choice,
-         partial_codons[ 10 ];
-    // we need to multiply by 3 to get the NUC position
-    
-    auto construct_codon_code = [&] (long c1, long c2, long c3) -> long {
-        if (c1 >= 0 && c2 >= 0 && c3 >= 0) {
-            return ((c1 * char_count + c2) * char_count + c3);
+    // a strand wins if it has at least this many k-mer hits, and this many times as many as the other strand
+    const long min_hits = 4,
+               min_ratio = 4,
+               mask      = ( 1L << ( 2 * STRAND_KMER_LENGTH ) ) - 1,
+               rc_shift  = 2 * ( STRAND_KMER_LENGTH - 1 );
+
+    long forward = 0,
+         rc      = 0,
+         kmer    = 0,
+         kmer_rc = 0,
+         run     = 0;
+
+    long const * const from = index->kmers,
+               * const to   = index->kmers + index->kmer_count;
+
+    for (long i = 0; i < q_len; ++i ) {
+        const long code = StrandKmerCode ( q_str[ i ] );
+        if ( code < 0 ) {
+            run = 0;
+            continue;
         }
-        return -1;
-    };
-    
-    auto construct_resolutions = [&] (long c1, long c2, long c3, long * store) -> long {
-        if (resolutions) {
-            
-            long res1[4] = {0},
-            res2[4] = {0},
-            res3[4] = {0};
-            
-            long res_count [3] = {0,0,0};
-            
-            if (c1 >= 0) {
-                res1[c1] = 1;
-                res_count [0] = 1;
-            } else {
-                if (c1 == -1) return 0;
-                c1 = -c1 - 2;
-                res1[0] = resolutions[c1*4];
-                res1[1] = resolutions[c1*4+1];
-                res1[2] = resolutions[c1*4+2];
-                res1[3] = resolutions[c1*4+3];
-                res_count [0] = res1[0] + res1[1] + res1[2] + res1[3];
-            }
-            
-            if (c2 >= 0) {
-                res2[c2] = 1;
-                res_count [1] = 1;
-            } else {
-                if (c2 == -1) return 0;
-                c2 = -c2 - 2;
-                res2[0] = resolutions[c2*4];
-                res2[1] = resolutions[c2*4+1];
-                res2[2] = resolutions[c2*4+2];
-                res2[3] = resolutions[c2*4+3];
-                res_count [1] = res2[0] + res2[1] + res2[2] + res2[3];
-            }
-            
-            if (c3 >= 0) {
-                res3[c3] = 1;
-                res_count [2] = 1;
-            } else {
-                if (c3 == -1) return 0;
-                c3 = -c3 - 2;
-                res3[0] = resolutions[c3*4];
-                res3[1] = resolutions[c3*4+1];
-                res3[2] = resolutions[c3*4+2];
-                res3[3] = resolutions[c3*4+3];
-                res_count [2] = res3[0] + res3[1] + res3[2] + res3[3];
-            }
-            
-            long total_res = res_count[0] * res_count[1] * res_count[2];
-            
-            if (total_res > HY_MAXIMUM_RESOLUTIONS) return 0;
-            
-            long res_index = 0;
-            
-            for (long i = 0; i < 4; i++) {
-                if (res1[i]) {
-                    for (long j = 0; j < 4; j++) {
-                        if (res2[j]) {
-                            for (long k = 0; k < 4; k++) {
-                                if (res3[k]) {
-                                    store [res_index++] = (i*char_count + j)*char_count + k;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            
-            return res_index;
-            
+        // the k-mer ending at i, and its reverse complement (which starts at i on the other strand)
+        kmer    = ( ( kmer << 2 ) | code ) & mask;
+        kmer_rc = ( kmer_rc >> 2 ) | ( ( 3 - code ) << rc_shift );
+        if ( ++run >= STRAND_KMER_LENGTH ) {
+            forward += std::binary_search ( from, to, kmer );
+            rc      += std::binary_search ( from, to, kmer_rc );
         }
-        return 0;
-    };
+    }
+
+    if ( forward >= min_hits && forward >= min_ratio * rc ) {
+        return 1;
+    }
+    if ( rc >= min_hits && rc >= min_ratio * forward ) {
+        return -1;
+    }
+    return 0;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name CodonQueryCodes
+ * The codon moves ending at query position q only read query characters q-5..q-1, so the (partial) codons they
+ * take from the query are the same in every row of the DP matrix; compute them once per alignment.
+ * Partial codons which run past the start of the query are stored as -1; the others are encoded exactly as
+ * CodonAlignStringsStep did (a code < 0 means the partial codon is not resolved).
+ *
+ * @param query the encoded query
+ * @param q_length the length of the query
+ * @param char_count the number of valid characters (nucleotides)
+ * @param partials receives HY_QUERY_PARTIALS codes for each of the q_length + 1 query positions
+ * @param codons receives the code of the full codon ending at each of the q_length + 1 query positions
+ *        (-1 if it is not resolved, or runs past the start of the query)
+ */
 
+void CodonQueryCodes ( long const * query
+                     , const long q_length
+                     , const long char_count
+                     , int32_t * const partials
+                     , int32_t * const codons
+                     )
+{
     // 3x5 codon specifications (inverted indices)
     static long const codon_spec_3x5[ 10 ][ 3 ] = {
         { 5, 4, 3 }, // 11100
@@ -324,452 +279,213 @@ long CodonAlignStringsStep( cawlign_fp * const score_matrix
         { 3, 2, 1 }  // 00111
     };
     // 3x4 codon specifications (inverted indices)
-    static long const long codon_spec_3x4[ 4 ][ 3 ] = {
+    static long const codon_spec_3x4[ 4 ][ 3 ] = {
         { 4, 3, 2 }, // 1110
         { 4, 3, 1 }, // 1101
         { 4, 2, 1 }, // 1011
         { 3, 2, 1 }  // 0111
     };
 
-    long    local_shortcut_came_from_this_move = -1;
-
-    cawlign_fp choices[ HY_ALIGNMENT_TYPES_COUNT ],
-           max_score = -INFINITY,
-           penalty;
-
-    // store the scores of our choices in choices,
-    // pre-initialize to -infinity
-    for (long i = 0; i < HY_ALIGNMENT_TYPES_COUNT; i++ ) {
-        choices[ i ] = -INFINITY;
-    }
-    
-    // if we're at least a CODON away from the edge...
-    // (psst, r is CODONs remember?)
-    if ( r >= 1 ) {
-        // if we're doing affine gaps (deletions)
-        if ( deletion_matrix ) {
-            choices[ HY_111_000 ] = MAX_OP(
-                score_matrix[ prev ] - open_deletion,
-                deletion_matrix[ prev ] - ( r > 1 ? extend_deletion : open_deletion )
-            );
-            deletion_matrix[ curr ] = choices[ HY_111_000 ];
-            
-            //printf ("%ld/%ld %g %g \n", r, q, deletion_matrix[ prev ] , deletion_matrix[ curr ]);
-        } else {
-            choices[ HY_111_000 ] = score_matrix[ prev ] - open_deletion;
-        }
-
-        r_codon = construct_codon_code ( reference[ rpos - 3 ] ,reference[ rpos - 2 ], reference[ rpos - 1 ]) ;
-
-        if ( r_codon < 0 ) {
-            // anything other than a fully resolved codon gets mapped to the "generic unresolved" character
-            r_codon = cost_stride - 1;
-            /* 20240219: SLKP optimization note this needs to be adjusted; let's not print stuff to stderr */
-            //fprintf (stderr, "*** NIL CODON *** %ld %ld %ld %ld\n", reference[ rpos - 3 ], reference[ rpos - 2], reference[ rpos - 1], r_codon);
-        }
-    }
-
-    // if we're at least 1 codon away from the edge
-    if ( q >= 3 ) {
-        // if we're doing affine gaps (insertions)
-        if ( insertion_matrix ) {
-            choices[ HY_000_111 ] = MAX_OP(
-                score_matrix[ curr - 3 ] - open_insertion,
-                insertion_matrix[ curr - 3 ] - ( q > 3 ? extend_insertion : open_insertion )
-            );
-            insertion_matrix[ curr ] = choices[ HY_000_111 ];
-        } else {
-            choices[ HY_000_111 ] = score_matrix[ curr - 3 ] - open_insertion;
-        }
-
-        q_codon = construct_codon_code ( query[ q - 3 ], query[ q - 2 ], query[ q - 1 ]);
-    }
+    for ( long q = 0; q <= q_length; ++q ) {
+        int32_t * const partial = partials + q * HY_QUERY_PARTIALS;
 
-    // if q_codon and r_codon both exist, set the score equal to match
-    if ( r_codon >= 0 && q >= 3) {
-        if (q_codon < 0) {
-            // check the resolutions if they are available
-            long resolutions [HY_MAXIMUM_RESOLUTIONS],
-            res_count = construct_resolutions (query[ q - 3 ], query[ q - 2 ], query[ q - 1 ], resolutions);
-            if (res_count) {
-                cawlign_fp score = -1.e100;
-                for (long i = 0; i < res_count; i++) {
-                   cawlign_fp score_res = cost_matrix[ r_codon * cost_stride + resolutions[i]];
-                    if (score_res > score) {
-                        score = score_res;
-                    }
-                }
-                //score /= res_count;
-                choices[ HY_111_111 ] = score_matrix[ prev - 3 ] + score;
-            } else {
-                choices[ HY_111_111 ] = score_matrix[ prev - 3 ] + cost_matrix[ r_codon * cost_stride + cost_stride - 1 ];
-            }
-            q_codon = cost_stride - 1;
-        } else {
-            
-            if (q_codon >= 0) {
-                const cawlign_fp move_cost = cost_matrix[ r_codon * cost_stride + q_codon ];
-                choices[ HY_111_111 ] = score_matrix[ prev - 3 ] + move_cost;
-            }
+        for ( long i = 0; i < HY_QUERY_PARTIALS; ++i ) {
+            partial[ i ] = -1;
         }
-        //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
-        //    local_shortcut_came_from_this_move = HY_111_111;
-        //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
-        //}
-    }
-
-    // we disallow partial moves in the reference, so those used to be here but are now gone
-
-    // HERE BE DRAGONS!!!!
-
-    // miscall matches, starting with 3x5, then 3x4, then 3x2, finally 3x1
-    if ( r_codon >= 0 ) {
-#if defined(__ARM_NEON2__)
-        // 3x5 partial codons
-        if ( q >= 5 ) {
-            // fill in the partial codons table
-            // use a 10x1 array to allow for load hoisting,
-            // we don't want to be bouncing cachelines in this critical inner loop
-            for (long i = 0; i < HY_3X5_COUNT; ++i ) {
-                partial_codons[ i ] = ( query[ q - codon_spec_3x5[ i ][ 0 ] ]   * char_count
-                                      + query[ q - codon_spec_3x5[ i ][ 1 ] ] ) * char_count
-                                      + query[ q - codon_spec_3x5[ i ][ 2 ] ] ;
-            }
-            // go over each choice, fill it in
-            for (long i = 0; i < HY_3X5_COUNT; i+=4 ) {
-                 cawlign_fp p[4];
-                 long       c[4];
-                 
-                 for (long k=0; k<4; k++) {
-                    if (i+k < HY_3X5_COUNT) {
-                        c[k] = HY_3X5_START + i + k;
-                        if ( ( q == 5              && c[k] == HY_00111_11111 )
-                          || ( q == score_cols - 1 && c[k] == HY_11100_11111 ) )
-                            p[k] = 0.;
-                        // if we have a single ragged edge, penalize by a single miscall
-                        // we don't have to worry about specifying each case here,
-                        // as the 00111_11111 case takes preference above,
-                        // so we don't have to explicitly avoid it
-                        else if ( q == 5 && c[k] >= HY_01110_11111 )
-                            p[k] = miscall_cost;
-                        // if we have a single ragged edge, penalize by a single miscall
-                        // unfortunately these cases are spread out,
-                        // so we have to enumerate them explicitly here
-                        else if ( q == score_cols - 1
-                               && ( c[k] == HY_11010_11111
-                                 || c[k] == HY_10110_11111
-                                 || c[k] == HY_01110_11111 ) )
-                            p[k] = miscall_cost;
-                        // if we don't fit into any of these special cases,
-                        // the miscall penalty is cawlign_fp (as we're matching 3 to 5)
-                        else
-                            p[k] = 2. * miscall_cost;
-                    }
-                 }
-                
-                float32x4_t penalties = vld1q_f32(p);
-                float32x4_t move_costs = vld1q_f32(codon3x5 + r_codon * offset3x5 + HY_3X5_COUNT * partial_codons[ i ] + i);
-                float32x4_t score_matrix_vector = vdupq_n_f32 (score_matrix[ prev - 5 ]);
-                float32x4_t choice_scores = vsubq_f32(vaddq_f32(score_matrix_vector, move_costs), penalties);
-                
-                for (long k=0; k<4; k++) {
-                    if (i+k < HY_3X5_COUNT) {
-                        choices [c[k]] = choice_scores[k];
-                    }
-                }
+        codons[ q ] = -1;
 
-            }
-        }
-#else
-        // 3x5 partial codons
         if ( q >= 5 ) {
-            // fill in the partial codons table
-            // use a 10x1 array to allow for load hoisting,
-            // we don't want to be bouncing cachelines in this critical inner loop
-            for (long i = 0; i < HY_3X5_COUNT; ++i ) {
-                partial_codons[ i ] = ( query[ q - codon_spec_3x5[ i ][ 0 ] ]   * char_count
-                                      + query[ q - codon_spec_3x5[ i ][ 1 ] ] ) * char_count
-                                      + query[ q - codon_spec_3x5[ i ][ 2 ] ] ;
-            }
-            // go over each choice, fill it in
-            for (long i = 0; i < HY_3X5_COUNT; ++i ) {
-                if ( partial_codons[ i ] >= 0 ) {
-                    // this partial codon is resolved
-                    choice = HY_3X5_START + i;
-                    // if we have a cawlign_fp ragged edge, don't penalize
-                    if ( ( q == 5              && choice == HY_00111_11111 )
-                      || ( q == score_cols - 1 && choice == HY_11100_11111 ) )
-                        penalty = 0.;
-                    // if we have a single ragged edge, penalize by a single miscall
-                    // we don't have to worry about specifying each case here,
-                    // as the 00111_11111 case takes preference above,
-                    // so we don't have to explicitly avoid it
-                    else if ( q == 5 && choice >= HY_01110_11111 )
-                        penalty = miscall_cost;
-                    // if we have a single ragged edge, penalize by a single miscall
-                    // unfortunately these cases are spread out,
-                    // so we have to enumerate them explicitly here
-                    else if ( q == score_cols - 1
-                           && ( choice == HY_11010_11111
-                             || choice == HY_10110_11111
-                             || choice == HY_01110_11111 ) )
-                        penalty = miscall_cost;
-                    // if we don't fit into any of these special cases,
-                    // the miscall penalty is cawlign_fp (as we're matching 3 to 5)
-                    else
-                        penalty = 2. * miscall_cost;
-                        
-                    const cawlign_fp move_cost = codon3x5[ r_codon * offset3x5 + HY_3X5_COUNT * partial_codons[ i ] + i ];
-                    
-                    choices[ choice ] = score_matrix[ prev - 5 ] - penalty + move_cost;
-                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
-                    //    local_shortcut_came_from_this_move = choice;
-                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
-                    //}
-                }
-            }
-        }
-#endif
-
-#if defined(__ARM_NEON2__)
-        // 3x4 partial codons
-        if ( q >= 4 ) {
-            // fill in partial codons table
-            for (long i = 0; i < HY_3X4_COUNT; ++i ) {
-                partial_codons[ i ] = ( query[ q - codon_spec_3x4[ i ][ 0 ] ]   * char_count
-                                      + query[ q - codon_spec_3x4[ i ][ 1 ] ] ) * char_count
-                                      + query[ q - codon_spec_3x4[ i ][ 2 ] ] ;
-            }
-            // fill in choices
-            cawlign_fp p[4];
-            long       c[4];
-
-            for (long i = 0; i < HY_3X4_COUNT; ++i ) {
-                if ( partial_codons[ i ] >= 0 ) {
-                    c[i] = HY_3X4_START + i;
-                    // if we have a ragged edge,
-                    // penalize it not at all
-                    if ( ( q == 4              && c[i] == HY_0111_1111 )
-                      || ( q == score_cols - 1 && c[i] == HY_1110_1111 ) )
-                        p[i] = 0.;
-                    // otherwise it's just a single miscall penalty
-                    else
-                        p[i] = miscall_cost;
-                }
-            }
-            
-            float32x4_t penalties = vld1q_f32(p);
-            float32x4_t move_costs = vld1q_f32(codon3x4 + r_codon * offset3x4 + HY_3X4_COUNT * partial_codons[ 0 ] );
-            float32x4_t score_matrix_vector = vdupq_n_f32 (score_matrix[ prev - 4 ]);
-            float32x4_t choice_scores = vsubq_f32(vaddq_f32(score_matrix_vector, move_costs), penalties);
-            
-            for (long k=0; k<4; k++) {
-                if (partial_codons[k] >= 0) {
-                    choices [c[k]] = choice_scores[k];
-                }
+            for ( long i = 0; i < HY_3X5_COUNT; ++i ) {
+                partial[ HY_QUERY_3X5 + i ] = ( query[ q - codon_spec_3x5[ i ][ 0 ] ]   * char_count
+                                              + query[ q - codon_spec_3x5[ i ][ 1 ] ] ) * char_count
+                                              + query[ q - codon_spec_3x5[ i ][ 2 ] ] ;
             }
-
         }
-#else
-        // 3x4 partial codons
         if ( q >= 4 ) {
-            // fill in partial codons table
-            for (long i = 0; i < HY_3X4_COUNT; ++i ) {
-                partial_codons[ i ] = ( query[ q - codon_spec_3x4[ i ][ 0 ] ]   * char_count
-                                      + query[ q - codon_spec_3x4[ i ][ 1 ] ] ) * char_count
-                                      + query[ q - codon_spec_3x4[ i ][ 2 ] ] ;
-            }
-            // fill in choices
-            for (long i = 0; i < HY_3X4_COUNT; ++i ) {
-                if ( partial_codons[ i ] >= 0 ) {
-                    choice = HY_3X4_START + i;
-                    // if we have a ragged edge,
-                    // penalize it not at all
-                    if ( ( q == 4              && choice == HY_0111_1111 )
-                      || ( q == score_cols - 1 && choice == HY_1110_1111 ) )
-                        penalty = 0.;
-                    // otherwise it's just a single miscall penalty
-                    else
-                        penalty = miscall_cost;
-
-                    const cawlign_fp move_cost = codon3x4[ r_codon * offset3x4 + HY_3X4_COUNT * partial_codons[ i ] + i ];
-
-                    choices[ choice ] = score_matrix[ prev - 4 ] - penalty + move_cost;
-                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
-                    //    local_shortcut_came_from_this_move = choice;
-                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
-                    //}
-                }
+            for ( long i = 0; i < HY_3X4_COUNT; ++i ) {
+                partial[ HY_QUERY_3X4 + i ] = ( query[ q - codon_spec_3x4[ i ][ 0 ] ]   * char_count
+                                              + query[ q - codon_spec_3x4[ i ][ 1 ] ] ) * char_count
+                                              + query[ q - codon_spec_3x4[ i ][ 2 ] ] ;
             }
         }
-#endif
-#if defined(__ARM_NEON2__)
-        // 3x2
-        if ( q >= 2 ) {
-            // only a single partial codon
-            partial_codons[ 0 ] = query[ q - 2 ] * char_count
-                                + query[ q - 1 ] ;
-            // fill in choices
-            if ( partial_codons[ 0 ] >= 0 ) {
-                cawlign_fp p[4];
-                long       c[4];
-
-                for (long i = 0; i < HY_3X2_COUNT; ++i ) {
-                    c[i] = HY_3X2_START + i;
-                    // if we have a ragged edge at the beginning or end,
-                    // respectively, don't penalize it
-                    if ( ( q == 2              && c[i] == HY_111_011 )
-                      || ( q == score_cols - 1 && c[i] == HY_111_110 ) )
-                        p[i] = 0.;
-                    // otherwise it's just a single miscall penalty
-                    else
-                        p[i] = miscall_cost;
-                }
-                
-                float32x4_t penalties = vld1q_f32(p);
-                float32x4_t move_costs = vld1q_f32(codon3x2 + r_codon * offset3x2 + HY_3X2_COUNT * partial_codons[ 0 ]);
-                float32x4_t score_matrix_vector = vdupq_n_f32 (score_matrix[ prev - 2 ]);
-                float32x4_t choice_scores = vsubq_f32(vaddq_f32(score_matrix_vector, move_costs), penalties);
-
-                for (long k=0; k<HY_3X2_COUNT; k++) {
-                    choices [c[k]] = choice_scores[k];
-                }
+        if ( q >= 3 ) {
+            if ( query[ q - 3 ] >= 0 && query[ q - 2 ] >= 0 && query[ q - 1 ] >= 0 ) {
+                codons[ q ] = ( query[ q - 3 ] * char_count + query[ q - 2 ] ) * char_count + query[ q - 1 ];
             }
         }
-#else
-        // 3x2
         if ( q >= 2 ) {
-            // only a single partial codon
-            partial_codons[ 0 ] = query[ q - 2 ] * char_count
-                                + query[ q - 1 ] ;
-            // fill in choices
-            if ( partial_codons[ 0 ] >= 0 ) {
-                for (long i = 0; i < HY_3X2_COUNT; ++i ) {
-                    choice = HY_3X2_START + i;
-                    // if we have a ragged edge at the beginning or end,
-                    // respectively, don't penalize it
-                    if ( ( q == 2              && choice == HY_111_011 )
-                      || ( q == score_cols - 1 && choice == HY_111_110 ) )
-                        penalty = 0.;
-                    // otherwise it's just a single miscall penalty
-                    else
-                        penalty = miscall_cost;
-                        
-                                                                
-                    const cawlign_fp move_cost = codon3x2[ r_codon * offset3x2 + HY_3X2_COUNT * partial_codons[ 0 ] + i ];
-
-                    choices[ choice ] = score_matrix[ prev - 2 ] - penalty + move_cost;
-                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
-                    //    local_shortcut_came_from_this_move = choice;
-                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
-                    //}
-                }
-            }
+            partial[ HY_QUERY_3X2 ] = query[ q - 2 ] * char_count + query[ q - 1 ];
         }
-#endif
-#if defined(__ARM_NEON2__)
-        // 3x1
         if ( q >= 1 ) {
-            // only a single partial codon
-            partial_codons[ 0 ] = query[ q - 1 ];
-            // fill in choices
-            if ( partial_codons[ 0 ] >= 0 ) {
-                cawlign_fp p[4];
-                long       c[4];
-
-                for (long i = 0; i < HY_3X1_COUNT; ++i ) {
-                    c[i] = HY_3X1_START + i;
-                    // if we have a cawlign_fp ragged edge,
-                    // don't enforce a miscall penalty
-                    if ( ( q == 1              && c[i] == HY_111_001 )
-                      || ( q == score_cols - 1 && c[i] == HY_111_100 ) )
-                        p[i] = 0.;
-                    // if we have a single ragged edge,
-                    // enforce only a single miscall penalty
-                    else if ( ( q == 1              && c[i] == HY_111_010 )
-                           || ( q == score_cols - 1 && c[i] == HY_111_010 ) )
-                        p[i] = miscall_cost;
-                    // otherwise we need a cawlign_fp miscall penalty,
-                    // for the two positions we're inserting
-                    else
-                        p[i] = 2. * miscall_cost;
-                }
-                
-                float32x4_t penalties = vld1q_f32(p);
-                float32x4_t move_costs = vld1q_f32(codon3x1 + r_codon * offset3x1 + HY_3X1_COUNT * partial_codons[ 0 ]);
-                float32x4_t score_matrix_vector = vdupq_n_f32 (score_matrix[ prev - 1 ]);
-                float32x4_t choice_scores = vsubq_f32(vaddq_f32(score_matrix_vector, move_costs), penalties);
+            partial[ HY_QUERY_3X1 ] = query[ q - 1 ];
+        }
+    }
+}
 
-                for (long k=0; k<HY_3X1_COUNT; k++) {
-                    choices [c[k]] = choice_scores[k];
-                }
-            }
+//____________________________________________________________________________________
+
+/**
+ * @name CodonResolutions
+ * Lists the codons an (ambiguous) encoded query codon could resolve to
+ *
+ * @param c1, c2, c3 the encoded nucleotides of the codon (ambiguous characters are < -1, see CawalignCodonScores::resolutions)
+ * @param char_count the number of valid characters (nucleotides)
+ * @param resolutions the nucleotide resolutions of ambiguous characters (NULL if they are not resolved)
+ * @param store receives up to HY_MAXIMUM_RESOLUTIONS codon codes
+ *
+ * @return the number of resolutions (0 if the codon has a character which does not resolve, or too many resolutions)
+ */
+
+static long CodonResolutions ( long c1, long c2, long c3, const long char_count, long const * resolutions, long * store ) {
+    if (resolutions) {
+        
+        long res1[4] = {0},
+        res2[4] = {0},
+        res3[4] = {0};
+        
+        long res_count [3] = {0,0,0};
+        
+        if (c1 >= 0) {
+            res1[c1] = 1;
+            res_count [0] = 1;
+        } else {
+            if (c1 == -1) return 0;
+            c1 = -c1 - 2;
+            res1[0] = resolutions[c1*4];
+            res1[1] = resolutions[c1*4+1];
+            res1[2] = resolutions[c1*4+2];
+            res1[3] = resolutions[c1*4+3];
+            res_count [0] = res1[0] + res1[1] + res1[2] + res1[3];
         }
-#else
-        // 3x1
-        if ( q >= 1 ) {
-            // only a single partial codon
-            partial_codons[ 0 ] = query[ q - 1 ];
-            // fill in choices
-            if ( partial_codons[ 0 ] >= 0 ) {
-                for (long i = 0; i < HY_3X1_COUNT; ++i ) {
-                    choice = HY_3X1_START + i;
-                    // if we have a cawlign_fp ragged edge,
-                    // don't enforce a miscall penalty
-                    if ( ( q == 1              && choice == HY_111_001 )
-                      || ( q == score_cols - 1 && choice == HY_111_100 ) )
-                        penalty = 0.;
-                    // if we have a single ragged edge,
-                    // enforce only a single miscall penalty
-                    else if ( ( q == 1              && choice == HY_111_010 )
-                           || ( q == score_cols - 1 && choice == HY_111_010 ) )
-                        penalty = miscall_cost;
-                    // otherwise we need a cawlign_fp miscall penalty,
-                    // for the two positions we're inserting
-                    else
-                        penalty = 2. * miscall_cost;
-
-                    const cawlign_fp move_cost = codon3x1[ r_codon * offset3x1 + HY_3X1_COUNT * partial_codons[ 0 ] + i ];
-
-                    choices[ choice ] = score_matrix[ prev - 1 ] - penalty + move_cost;
-                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
-                    //    local_shortcut_came_from_this_move = choice;
-                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
-                    //}
+        
+        if (c2 >= 0) {
+            res2[c2] = 1;
+            res_count [1] = 1;
+        } else {
+            if (c2 == -1) return 0;
+            c2 = -c2 - 2;
+            res2[0] = resolutions[c2*4];
+            res2[1] = resolutions[c2*4+1];
+            res2[2] = resolutions[c2*4+2];
+            res2[3] = resolutions[c2*4+3];
+            res_count [1] = res2[0] + res2[1] + res2[2] + res2[3];
+        }
+        
+        if (c3 >= 0) {
+            res3[c3] = 1;
+            res_count [2] = 1;
+        } else {
+            if (c3 == -1) return 0;
+            c3 = -c3 - 2;
+            res3[0] = resolutions[c3*4];
+            res3[1] = resolutions[c3*4+1];
+            res3[2] = resolutions[c3*4+2];
+            res3[3] = resolutions[c3*4+3];
+            res_count [2] = res3[0] + res3[1] + res3[2] + res3[3];
+        }
+        
+        long total_res = res_count[0] * res_count[1] * res_count[2];
+        
+        if (total_res > HY_MAXIMUM_RESOLUTIONS) return 0;
+        
+        long res_index = 0;
+        
+        for (long i = 0; i < 4; i++) {
+            if (res1[i]) {
+                for (long j = 0; j < 4; j++) {
+                    if (res2[j]) {
+                        for (long k = 0; k < 4; k++) {
+                            if (res3[k]) {
+                                store [res_index++] = (i*char_count + j)*char_count + k;
+                            }
+                        }
+                    }
                 }
             }
         }
-#endif
+        
+        return res_index;
+        
     }
+    return 0;
+}
 
-    // find the best possible choice
-    //if (do_local) {
-        for (long i = 0; i < HY_ALIGNMENT_TYPES_COUNT ; ++i ) {
-            if ( choices[ i ] > max_score ) {
-                best_choice = i;
-                max_score = choices[ i ];
-            }
+//____________________________________________________________________________________
+
+/**
+ * @name CodonQueryAmbiguities
+ * The score of matching an unresolved query codon to a reference codon is the best score of any of its resolutions
+ * (or that of the "generic unresolved" character if it has none); it does not depend on the row of the DP matrix,
+ * so compute it once per alignment for every reference codon.
+ *
+ * @param query the encoded query
+ * @param q_length the length of the query
+ * @param char_count the number of valid characters (nucleotides)
+ * @param codons the full codon ending at each query position (see CodonQueryCodes)
+ * @param resolutions the nucleotide resolutions of ambiguous characters (NULL if they are not resolved)
+ * @param cost_matrix the codon scoring matrix
+ * @param cost_stride the number of columns in cost_matrix (the last one is the "generic unresolved" codon)
+ * @param ambiguities receives, for each of the q_length + 1 query positions ending an unresolved codon, its scores
+ *        against each of the cost_stride codons (and NULL for the other positions)
+ *
+ * @return the storage for the scores (NULL if there are no unresolved codons); to be deleted by the caller
+ */
+
+cawlign_fp * CodonQueryAmbiguities ( long const * query
+                                   , const long q_length
+                                   , const long char_count
+                                   , int32_t const * const codons
+                                   , long const * resolutions
+                                   , cawlign_fp const * cost_matrix
+                                   , const long cost_stride
+                                   , cawlign_fp const ** const ambiguities
+                                   )
+{
+    long ambiguous_count = 0;
+    for ( long q = 3; q <= q_length; ++q ) {
+        if ( codons[ q ] < 0 ) {
+            ambiguous_count ++;
         }
-    /*} else {
-        for (long i = 0; i < HY_ALIGNMENT_TYPES_COUNT - 1 ; ++i ) {
-            if ( choices[ i ] > max_score ) {
-                best_choice = i;
-                max_score = choices[ i ];
+    }
+
+    for ( long q = 0; q <= q_length; ++q ) {
+        ambiguities[ q ] = NULL;
+    }
+
+    if ( ambiguous_count == 0 ) {
+        return NULL;
+    }
+
+    cawlign_fp * const scores = new cawlign_fp [ ambiguous_count * cost_stride ],
+               * store       = scores;
+
+    for ( long q = 3; q <= q_length; ++q ) {
+        if ( codons[ q ] < 0 ) {
+            long codon_resolutions [ HY_MAXIMUM_RESOLUTIONS ],
+                 res_count = CodonResolutions ( query[ q - 3 ], query[ q - 2 ], query[ q - 1 ], char_count, resolutions, codon_resolutions );
+
+            for ( long r_codon = 0; r_codon < cost_stride; ++r_codon ) {
+                cawlign_fp const * cost_row = cost_matrix + r_codon * cost_stride;
+                if ( res_count ) {
+                    cawlign_fp score = -1.e100;
+                    for (long i = 0; i < res_count; i++) {
+                        cawlign_fp score_res = cost_row[ codon_resolutions[i] ];
+                        if (score_res > score) {
+                            score = score_res;
+                        }
+                    }
+                    //score /= res_count;
+                    store[ r_codon ] = score;
+                } else {
+                    store[ r_codon ] = cost_row[ cost_stride - 1 ];
+                }
             }
+            ambiguities[ q ] = store;
+            store += cost_stride;
         }
-    }*/
-    
-    
-    //fprintf( stderr, "\nscore: %.3g best: %ld\n", max_score, best_choice );
-
-    // assign the score to the current position
-    score_matrix[ curr ] = max_score;
+    }
 
-    //if (do_local && best_choice == HY_LOCAL_ALIGN_SHORTCUT) {
-    //    return -local_shortcut_came_from_this_move - 1;
-    //}
-    score = max_score;
-    return best_choice;
+    return scores;
 }
 
 //____________________________________________________________________________________
@@ -1036,66 +752,1996 @@ inline void MatchScore( char const * r_str
 
 //____________________________________________________________________________________
 
-
 /**
- * @name AlignStrings
- * Performs a pairwise string alignment; the nature of the alignment algoritm invoked will depend on option flags
- * returns the score of the alignment
- * r_res and q_res parameters will the receive aligned strings they will be allocated and populated by this function
- * 
- * @param r_str the reference string
- * @param q_str the query string
- * @param _r_len the length of the reference string (-1 to compute here)
- * @param _q_len the length of the query string (-1 to compute here)
- * @param r_res will receive the resulting REFERENCE alignment
- * @param q_res will receive the resulting QUERY alignment
- * @param char_map a char->long map which takes a character from the input string and maps into in [-1,N-1] where N is the dimension of the scoring matrix; an "indvalid" character is mapped to -1
- * @param cost_matrix an NxN (row-major) matrix of pairwise character scores
- * @param cost_stride N (column dimension of cost_matrix)
- * @param gap the character to use for an indel (e.g. '-')
- * @param open_insertion the cost of opening a gap in the REFERENCE
- * @param extend_insertion the cost of extending a gap in the REFERENCE
- * @param open_deletion the cost of opening a gap in the QUERY
- * @param extend_deletion the cost of extending a gap in the QUERY
- * @param miscall_cost the cost of introducing any out-of-frame indels
- * @param do_local if TRUE, local alignment will be performed (no prefix or suffix gap cost)
- * @param do_affine if TRUE, use the affine gap penalty
- * @param do_codon if TRUE, do a codon-aware alignment
- * @param char_count number of alphabet (N-1, where N == cost_stride)
- * @param codon3x5 (do_codon == TRUE), the cost of aligning codon X with any of the 10 options where 3 refs align to 5 qry
- * @param codon3x4 (do_codon == TRUE), the cost of aligning codon X with any of the 4 options where 3 refs align to 4 qry
- * @param codon3x2 (do_codon == TRUE), the cost of aligning codon X with any of the 3 options where 3 refs align to 2 qry
- * @param codon3x1 (do_codon == TRUE), the cost of aligning codon X with any of the 3 options where 3 refs align to 1 qry
- * @param do_true_local if TRUE, perform a true local (best scoring substings) alignment
- * @param report_ref_insertions if TRUE (default), will report deletions relative to the
- * @param score_matrix_cache if provided, use this to store the scoring matrix (assumed to have sufficient size)
- * @param insertion_matrix_cache if provided, use this to store the insertion (affine gaps) score matrix (assumed to have sufficient size)
- * @param deletion_matrix_cache if provided, use this to store the  deletion (affine gaps) score scoring matrix (assumed to have sufficient size)
- * @param resolution_map if provided, lists ambiguity resolutions for codon-aware alignments
- * @return the alignment score
+ * @name InitAlignmentMatrices
+ * Pre-initializes the first row and the first column of the dynamic programming matrices used by AlignStrings
+ * (the score matrix, and, if do_affine is TRUE, the insertion and deletion matrices); for codon data with affine
+ * gaps, also the first 3 columns of the insertion matrix, which the codon step reads but does not fill
+ *
+ * @param score_rows the number of rows in the DP matrices
+ * @param score_cols the number of columns in the DP matrices
+ * @param other arguments are as in AlignStrings
+ */
 
-*/
-cawlign_fp AlignStrings( char const * r_str
-                   , char const * q_str
-                   , const long _r_len
-                   , const long _q_len
-                   , char * & r_res
-                   , char * & q_res
-                   , long * char_map
-                   , cawlign_fp const * cost_matrix
-                   , const long cost_stride
-                   , const char gap
-                   , cawlign_fp open_insertion
-                   , cawlign_fp extend_insertion
-                   , cawlign_fp open_deletion
-                   , cawlign_fp extend_deletion
-                   , cawlign_fp miscall_cost
-                   , const bool do_local
-                   , const bool do_affine
+void InitAlignmentMatrices ( const unsigned long score_rows
+                           , const unsigned long score_cols
+                           , const bool do_local
+                           , const bool do_affine
+                           , const bool do_codon
+                           , const cawlign_fp open_insertion
+                           , const cawlign_fp extend_insertion
+                           , const cawlign_fp open_deletion
+                           , const cawlign_fp extend_deletion
+                           , const cawlign_fp miscall_cost
+                           , cawlign_fp * const score_matrix
+                           , cawlign_fp * const insertion_matrix
+                           , cawlign_fp * const deletion_matrix
+                           )
+{
+    score_matrix [ 0 ] = 0.;
+    // pre-initialize the values in the various matrices
+    if ( ! do_local ) {
+        // full global alignment, i.e. indels at the beginning and end ARE penalized
+        cawlign_fp cost;
+         // initialize gap costs in first column and first row
+        // they are 0 for local alignments, so ignore
+
+        if ( do_affine ) {
+
+            // first handle insertions
+            cost = -open_insertion;
+            insertion_matrix[ 0 ] = cost;
+
+            for (long i = 1; i < score_cols; ++i, cost -= extend_insertion ) {
+                score_matrix[ i ] = cost;
+                insertion_matrix[ i ] = cost;
+                deletion_matrix[ i ] = cost;
+            }
+
+            // then deletions
+            cost = -open_deletion;
+            deletion_matrix[ 0 ] = cost;
+
+            /** 20240219 : SLKP optimization note; may be faster to do 3 loops because of memory locality */
+            for (long i = score_cols; i < score_rows * score_cols; i += score_cols, cost -= extend_deletion ) {
+                score_matrix[ i ] = cost;
+                insertion_matrix[ i ] = cost;
+                deletion_matrix[ i ] = cost;
+            }
+
+            if ( do_codon ) {
+                // the codon step also reads the insertion matrix in columns 1 and 2, which it never fills;
+                // the matrices are reused between alignments, so these must be set here rather than left as found
+                for (long i = score_cols; i < score_rows * score_cols; i += score_cols ) {
+                    for (long j = 1; j < 3 && j < score_cols; ++j ) {
+                        insertion_matrix[ i + j ] = 0.;
+                    }
+                }
+            }
+        } else {
+            // no affine gaps
+            if ( ! do_codon ) {
+                cost = -open_insertion;
+                for (long i = 1; i < score_cols; ++i, cost -= open_insertion )
+                    score_matrix[ i ] = cost;
+
+                cost = -open_deletion;
+                for (long i = score_cols; i < score_rows * score_cols; i += score_cols, cost -= open_deletion )
+                    score_matrix[ i ] = cost;
+
+                // handle the do_local, do_codon case
+            } else {
+                cost = -open_insertion;
+                /** 20240219 : SLKP optimization note; surely the next two loops don't need to do integer remainer at each iteration */
+                for (long i = 1; i < score_cols; ++i, cost -= open_insertion )
+                    score_matrix[ i ] = cost - ( i % 3 != 1 ? miscall_cost : 0 );
+
+                cost = -open_deletion;
+                for (long i = score_cols, j = 0; i < score_rows * score_cols; i += score_cols, cost -= open_insertion, ++j )
+                    score_matrix[ i ] = cost - ( j % 3 != 0 ? miscall_cost : 0 );
+            }
+        }
+     } else {
+         // here we're doing a local alignment,
+         // the costs of opening a deletion or an insertion
+         // remain the same no matter how far down the ref or query
+         // we've traveled, respectively
+
+        if ( do_affine ) {
+            deletion_matrix [ 0 ] = 0.;
+            insertion_matrix [ 0 ] = 0.;
+            if ( do_codon ) {
+                /** 20240219 : SLKP optimization note; surely the next two loops don't need to do integer remainer at each iteration */
+
+                // XXX: should we be including the frameshift penalty here? I think not
+                // fill in the first row of the affine deletion matrix
+                // with the deletion cost plus the miscall penalty
+                
+                
+                for (long i = 1; i < score_cols; ++i ) {
+                    deletion_matrix[ i ] = -open_deletion - ( i % 3 != 1 ? miscall_cost : 0 );
+                    insertion_matrix [ i ] = 0.;
+                    score_matrix [ i ] = 0.;
+                }
+
+                // fill in the first column of the affine insertion matrix
+                // with the insertion cost plus the miscall penalty
+                for (long i = score_cols, j = 0; i < score_rows * score_cols; i += score_cols, ++j ) {
+                    
+                    cawlign_fp is = -open_insertion - ( j % 3 != 0 ? miscall_cost : 0 );
+                    
+                    insertion_matrix[ i ] = is;
+                    insertion_matrix[ i + 1 ] = 0.;//is;
+                    insertion_matrix[ i + 2 ] = 0.;// is;
+
+                    deletion_matrix [ i ] = 0.;
+                    deletion_matrix [ i + 1 ] = 0.;
+                    deletion_matrix [ i + 2 ] = 0.;
+                    
+                    score_matrix [ i ] = 0.;
+                }
+                
+                //for (long i = score_cols + 1; i < score_rows * score_cols; i += score_cols ) {
+                //}
+                
+
+            } else {
+                // fill in the first row of the affine deletion matrix
+                // with the deletion cost
+                for (long i = 1; i < score_cols; ++i ) {
+                    deletion_matrix[ i ] = -open_deletion;
+                    insertion_matrix [ i ] = 0.;
+                    score_matrix [ i ] = 0.;
+                }
+
+                // fill in the first column of the affine insertion matrix
+                // with the insertion cost
+                for (long i = score_cols; i < score_rows * score_cols; i += score_cols ) {
+                    insertion_matrix[ i ] = -open_insertion;
+                    deletion_matrix [ i ] = 0.;
+                    score_matrix [ i ] = 0.;
+                }
+            }
+        } else {
+            // init zeros in the score matrix for the non-affine case
+            for (long i = 1; i < score_cols; ++i ) {
+                score_matrix [ i ] = 0.;
+            }
+
+            // fill in the first column of the affine insertion matrix
+            // with the insertion cost
+            for (long i = score_cols; i < score_rows * score_cols; i += score_cols ) {
+                score_matrix [ i ] = 0.;
+            }
+        }
+    }
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name EditOpsToAlignment
+ * Builds the aligned strings from a (reversed) list of edit operations produced by backtracking
+ * r_res and q_res will be allocated and populated by this function
+ *
+ * @param edit_ops the edit operations, last one first (see BacktrackAlign and BacktrackAlignCodon for the codes)
+ * @param edit_ptr the number of edit operations (> 0)
+ * @param index_R the position in the reference where the alignment starts
+ * @param index_Q the position in the query where the alignment starts
+ * @param other arguments are as in AlignStrings
+ */
+
+void EditOpsToAlignment ( signed char const * edit_ops
+                        , long edit_ptr
+                        , char const * r_str
+                        , char const * q_str
+                        , char * & r_res
+                        , char * & q_res
+                        , const char gap
+                        , const bool report_ref_insertions
+                        , long index_R
+                        , long index_Q
+                        )
+{
+    // rebuild the strings from the edit_ops
+    // with room for the null terminator
+    r_res = new char[ edit_ptr + 1 ];
+    q_res = new char[ edit_ptr + 1 ];
+    --edit_ptr;
+    long k = 0;
+    for (; edit_ptr >= 0; --edit_ptr, ++k ) {
+        switch ( edit_ops[ edit_ptr ] ) {
+                // match! include characters from both strings
+            case 0:
+                r_res[ k ] = r_str[ index_R++ ];
+                q_res[ k ] = q_str[ index_Q++ ];
+                break;
+                // insertion!
+            case 1:
+                if (report_ref_insertions) {
+                    r_res[ k ] = gap;
+                    q_res[ k ] = q_str[ index_Q++ ];
+                } else {
+                    k --; index_Q++;
+                }
+                break;
+            case 2:
+                if (report_ref_insertions) {
+                    r_res[ k ] = gap;
+                    q_res[ k ] = tolower( q_str[ index_Q++ ] );
+                } else {
+                    k --; index_Q++;
+                }
+                break;
+            case -1:
+                r_res[ k ] = r_str[ index_R++ ];
+                q_res[ k ] = gap;
+                break;
+            case -2:
+                r_res[ k ] = tolower( r_str[ index_R++ ] );
+                q_res[ k ] = gap;
+                break;
+        }
+    }
+    // make sure to null-terminate
+    r_res[ k ] = '\0';
+    q_res[ k ] = '\0';
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name BacktrackAlignment
+ * Locates the end cell of the optimal alignment in filled DP matrices (as determined by do_local / do_true_local),
+ * backtracks from it and builds the aligned strings
+ * r_res and q_res parameters will the receive aligned strings they will be allocated and populated by this function
+ *
+ * @param score_rows the number of rows in the DP matrices
+ * @param score_cols the number of columns in the DP matrices
+ * @param codon_moves (do_codon == TRUE) the move codes (see HY_CODON_MOVE_MASK) recorded for every cell during the fill
+ * @param other arguments are as in AlignStrings
+ * @return the alignment score
+ */
+
+cawlign_fp BacktrackAlignment ( char const * r_str
+                              , char const * q_str
+                              , const unsigned long r_len
+                              , const unsigned long q_len
+                              , char * & r_res
+                              , char * & q_res
+                              , long * char_map
+                              , cawlign_fp const * cost_matrix
+                              , const long cost_stride
+                              , const char gap
+                              , const cawlign_fp open_insertion
+                              , const cawlign_fp extend_insertion
+                              , const cawlign_fp open_deletion
+                              , const cawlign_fp extend_deletion
+                              , const bool do_local
+                              , const bool do_affine
+                              , const bool do_codon
+                              , const bool do_true_local
+                              , const bool report_ref_insertions
+                              , const unsigned long score_rows
+                              , const unsigned long score_cols
+                              , cawlign_fp * const score_matrix
+                              , cawlign_fp * const insertion_matrix
+                              , cawlign_fp * const deletion_matrix
+                              , const unsigned char * const codon_moves
+                              )
+{
+    const unsigned long ref_stride = ( do_codon ? 3 : 1 );
+    cawlign_fp score;
+
+    long edit_ptr = 0;
+    // don't forget the optional termination character
+    
+    signed char * const edit_ops = (signed char * const)alloca (sizeof (signed char) * ( r_len + q_len ));
+    // allocate enough storage to store the best scoring path through the DP matrix
+
+    // set these indices to point at the ends
+    // of the ref and query, respectively
+    long index_R = r_len;
+    long index_Q = q_len;
+    
+    bool took_local_shortcut = false;
+
+    // grab maximum score from the last entry in the table
+    score = score_matrix[ score_rows * score_cols - 1 ];
+
+    // if we're doing a local alignment,
+    if ( do_true_local) {
+        // find the best score in the matrix
+        // except for the first row/first column 
+        // and start backtracking from there
+        const cawlign_fp * score_row = score_matrix + score_cols;
+        for (long m = 1; m < score_rows; m ++)  {
+            for (long k = 1; k < score_cols; k ++) {
+                if ( score_row[ k ] > score ) {
+                    score = score_row[ k ];
+                    index_R = ref_stride * m;
+                    index_Q = k;
+                }
+            }
+            score_row += score_cols;
+        }
+                       
+    } else 
+        // find the best score in the last row and column of the scoring matrix
+        // and start backtracking from there ( if it's better than the score
+        // we've already found, that is )
+        if ( do_local ) {
+            // grab the best score from the last column of the score matrix,
+            // skipping the very last entry ( we already checked it )
+            
+            for (long k = score_cols - 1; k < score_rows * score_cols - 1; k += score_cols )
+                if ( score_matrix[ k ] > score ) {
+                    score = score_matrix[ k ];
+                    // if do_codon, k / score_cols indexes into the codon space
+                    // of the reference, which is resolved by multiplication
+                    // by ref_stride ( which is 3 ), otherwise this
+                    // directly indexes into the reference
+                    index_R = ref_stride * ( k / score_cols );
+                }
+
+            // grab the best score from the last row of the score matrix,
+            // skipping the very last entry ( we already checked it )
+            for (long k = ( score_rows - 1 ) * score_cols; k < score_rows * score_cols - 1; ++k )
+                if ( score_matrix[ k ] > score ) {
+                    score = score_matrix[ k ];
+                    // if we've found a better score here,
+                    // don't forget to reset the ref index
+                    index_R = r_len;
+                    // remove the initial value!
+                    index_Q = k - ( score_rows - 1 ) * score_cols;
+                }
+
+            // fill in the edit_ops with the difference
+            // between r_len and i
+            for (long k = index_R; k < r_len; ++k ) {
+                edit_ops[ edit_ptr++ ] = -1;
+            }
+
+            // fill in the edit_ops with the difference
+            // between q_len and j
+            for (long k = index_Q; k < q_len; ++k ) {
+                edit_ops[ edit_ptr++ ] = 1;
+            }
+        }
+
+    // backtrack now
+
+    /*
+    // prints the score matrix
+    for ( long m = 0; m < score_rows; ++m ) {
+       for ( long n = 0; n < score_cols; ++n ) {
+           if ( n > 0 )
+               fprintf( stderr, "," );
+           fprintf( stderr, "% 3.3g", score_matrix[ m * score_cols + n ] );
+       }
+       fprintf( stderr, "\n" );
+    }
+    fprintf( stderr, "\n" );
+    */
+
+    if ( do_codon ) {
+        // if either index hits 0, we're done
+        // or if both indices fall below 3, we're done
+
+        while ( index_R && index_Q && ( index_R >= 3 || index_Q >= 3 ) && !took_local_shortcut ) {
+            // look up the step taken into this cell (divide by 3 to index into codon space)
+            const long code = codon_moves[ ( index_R / 3 ) * score_cols + index_Q ] & HY_CODON_MOVE_MASK;
+            
+            // alter edit_ops and decrement i and j
+            // according to the step k we took
+            BacktrackAlignCodon( edit_ops, edit_ptr, index_R, index_Q, code );
+            
+            
+            // if anything drops below 0, something bad happened
+            if ( index_R < 0 || index_Q < 0 ) {
+                //delete [] edit_ops;
+                return -INFINITY;
+            }
+
+            // handle the affine cases
+            if ( do_affine ) {
+                // divide by 3 to index into codon space
+                long k = ( index_R / 3 ) * score_cols + index_Q;
+                // reference matched but not query, a deletion
+                if ( code == HY_111_000 ) {
+                    // while deletion is preferential to match
+                    while ( index_R >= 3
+                         && ( codon_moves[ k ] & HY_CODON_DELETION_CONTINUES ) ) {
+                        // take a codon out of the reference
+                        index_R -= 3;
+                        edit_ops[ edit_ptr++ ] = -1;
+                        edit_ops[ edit_ptr++ ] = -1;
+                        edit_ops[ edit_ptr++ ] = -1;
+                        // move up a row in the score_matrix
+                        // which is a codon in the reference
+                        k -= score_cols;
+                    }
+                    // query matched but not reference, insertion
+                } else if ( code == HY_000_111 ) {
+                    // while insertion is preferential to match
+                    while ( index_Q >= 3
+                         && ( codon_moves[ k ] & HY_CODON_INSERTION_CONTINUES ) ) {
+                        // take a codon out of the query
+                        index_Q -= 3;
+                        edit_ops[ edit_ptr++ ] = 1;
+                        edit_ops[ edit_ptr++ ] = 1;
+                        edit_ops[ edit_ptr++ ] = 1;
+                        // move up 3 in the score_matrix
+                        // which is a codon in the query
+                        k -= 3;
+                    }
+                }
+            }
+        }
+    } else {
+        if ( do_affine ) {
+            while ( index_R && index_Q ) {
+                long curr = ( index_R ) * score_cols + index_Q,
+                     prev = ( index_R - 1 ) * score_cols + index_Q,
+                     best_choice = 0;
+
+                // check the current affine scores and the match score
+                cawlign_fp scores[ 3 ] = {
+                    deletion_matrix[ curr ],
+                    insertion_matrix[ curr ],
+                    score_matrix[ prev - 1 ]
+                }, max_score = scores[ best_choice ];
+
+                MatchScore( r_str, q_str, index_R, index_Q, char_map, cost_matrix, cost_stride, scores[2] );
+
+                // look at choice other than 0
+                if (scores[1] > max_score) {
+                    max_score = scores[1];
+                    best_choice = 1;
+                }
+                if (scores[2] > max_score) {
+                    best_choice = 2;
+                }
+                
+                switch ( best_choice ) {
+                case 0:
+                    // we have at least 1 deletion
+                    --index_R;
+                    edit_ops[ edit_ptr++ ] = -1;
+                    // deletion is travel in the reference but not query,
+                    // look at scores back in the reference,
+                    // and while they are better for the deletion case,
+                    // move backwards in the reference
+                    while ( index_R
+                         && score_matrix[ curr - score_cols ] - open_deletion
+                         <= deletion_matrix[ curr - score_cols ] - extend_deletion
+                          ) {
+                        --index_R;
+                        edit_ops[ edit_ptr++ ] = -1;
+                        curr -= score_cols;
+                    }
+                    break;
+
+                case 1:
+                    // we have at least 1 insertion
+                    --index_Q;
+                    edit_ops[ edit_ptr++ ] = 1;
+                    // insertion is travel in the query but not the reference,
+                    // look at scores back in the query,
+                    // and while they are better than for the insertion case,
+                    // move backwards in the query
+                    while ( index_Q
+                         && score_matrix[ curr - 1 ] - open_insertion
+                         <= insertion_matrix[ curr - 1 ] - extend_insertion
+                          ) {
+                        --index_Q;
+                        edit_ops[ edit_ptr++ ] = 1;
+                        --curr;
+                    }
+                    break;
+
+                case 2:
+                    // it's a match! move back in both
+                    --index_R;
+                    --index_Q;
+                    edit_ops[ edit_ptr++ ] = 0;
+                    break;
+                }
+            }
+            // no affine gaps, no codons
+        } else {
+            while ( index_R && index_Q ) {
+                const long curr = ( index_R ) * score_cols + index_Q,
+                           prev = ( index_R - 1 ) * score_cols + index_Q;
+
+                cawlign_fp deletion  = score_matrix[ prev ] - open_deletion,
+                       insertion = score_matrix[ curr - 1 ] - open_insertion,
+                       match     = score_matrix[ prev - 1 ];
+
+                MatchScore( r_str, q_str, index_R, index_Q, char_map, cost_matrix, cost_stride, match );
+                BacktrackAlign( edit_ops, edit_ptr, index_R, index_Q, deletion, insertion, match );
+            }
+        }
+    }
+
+
+    
+    if (!took_local_shortcut) {
+        // for anything that remains,
+        // don't forget it!!!
+        // reference
+        
+        
+        while ( --index_R >= 0 )
+            edit_ops[ edit_ptr++ ] = -1;
+
+        // then query
+        while ( --index_Q >= 0 )
+            edit_ops[ edit_ptr++ ] = 1;
+    }
+
+    if ( edit_ptr > 0 ) {
+        // reset indices to 0
+        if (!took_local_shortcut){ 
+            index_Q = index_R = 0;
+        }
+
+        EditOpsToAlignment ( edit_ops, edit_ptr, r_str, q_str, r_res, q_res, gap, report_ref_insertions, index_R, index_Q );
+    }
+
+    return score;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name BacktrackAlignmentCodes
+ * Backtracks a (non-codon) alignment using per-cell traceback codes (see AlignStringsFillDiffSIMD for the encoding)
+ * instead of the DP matrices; produces exactly the same alignment as BacktrackAlignment would from the matrices
+ *
+ * @param index_R the row of the cell where the backtrack starts
+ * @param index_Q the column of the cell where the backtrack starts
+ * @param score the score of the alignment (returned as is)
+ * @param cell_code a functor returning the traceback code for cell (i,j), 1 <= i <= r_len, 1 <= j <= q_len
+ * @param other arguments are as in AlignStrings
+ * @return the alignment score
+ */
+
+template <class CELL_CODE> cawlign_fp BacktrackAlignmentCodes ( char const * r_str
+                                                              , char const * q_str
+                                                              , const long r_len
+                                                              , const long q_len
+                                                              , char * & r_res
+                                                              , char * & q_res
+                                                              , const char gap
+                                                              , const bool do_local
+                                                              , const bool do_affine
+                                                              , const bool report_ref_insertions
+                                                              , long index_R
+                                                              , long index_Q
+                                                              , const cawlign_fp score
+                                                              , const CELL_CODE & cell_code
+                                                              )
+{
+    long edit_ptr = 0;
+    signed char * const edit_ops = (signed char * const)alloca (sizeof (signed char) * ( r_len + q_len ));
+    
+    if ( do_local ) {
+        for (long k = index_R; k < r_len; ++k ) {
+            edit_ops[ edit_ptr++ ] = -1;
+        }
+        for (long k = index_Q; k < q_len; ++k ) {
+            edit_ops[ edit_ptr++ ] = 1;
+        }
+    }
+    
+    while ( index_R && index_Q ) {
+        switch ( cell_code ( index_R, index_Q ) & 3 ) {
+            case 1:
+                // deletion, followed by any extensions
+                --index_R;
+                edit_ops[ edit_ptr++ ] = -1;
+                if ( do_affine ) {
+                    while ( index_R && ( cell_code ( index_R, index_Q ) & 4 ) ) {
+                        --index_R;
+                        edit_ops[ edit_ptr++ ] = -1;
+                    }
+                }
+                break;
+            case 2:
+                // insertion, followed by any extensions
+                --index_Q;
+                edit_ops[ edit_ptr++ ] = 1;
+                if ( do_affine ) {
+                    while ( index_Q && ( cell_code ( index_R, index_Q ) & 8 ) ) {
+                        --index_Q;
+                        edit_ops[ edit_ptr++ ] = 1;
+                    }
+                }
+                break;
+            default:
+                --index_R;
+                --index_Q;
+                edit_ops[ edit_ptr++ ] = 0;
+        }
+    }
+    
+    while ( --index_R >= 0 )
+        edit_ops[ edit_ptr++ ] = -1;
+    while ( --index_Q >= 0 )
+        edit_ops[ edit_ptr++ ] = 1;
+    
+    if ( edit_ptr > 0 ) {
+        EditOpsToAlignment ( edit_ops, edit_ptr, r_str, q_str, r_res, q_res, gap, report_ref_insertions, 0, 0 );
+    }
+    
+    return score;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name IntegerScoringScale
+ * Finds the smallest power of two scale (up to max_scale) that makes all scores and gap costs integers
+ * of magnitude below 1024, and reports the scaled values
+ *
+ * @param s_min, s_max will receive the smallest and the largest scaled score
+ * @param od, ed, oi, ei will receive the scaled gap costs
+ * @return the scale factor, or 0 if there is none
+ */
+
+long IntegerScoringScale ( const cawlign_fp * cost_matrix
+                         , const long cost_stride
+                         , const cawlign_fp open_insertion
+                         , const cawlign_fp extend_insertion
+                         , const cawlign_fp open_deletion
+                         , const cawlign_fp extend_deletion
+                         , const long max_scale
+                         , long & s_min
+                         , long & s_max
+                         , long & od
+                         , long & ed
+                         , long & oi
+                         , long & ei
+                         )
+{
+    s_min = s_max = 0;
+    
+    for (long scale = 1; scale <= max_scale; scale <<= 1 ) {
+        bool integral = true;
+        
+        auto scaled = [&] ( const cawlign_fp value ) -> long {
+            const cawlign_fp v = value * scale;
+            if ( ! ( v > -1024. && v < 1024. ) || v != (cawlign_fp) (long) v ) {
+                integral = false;
+                return 0;
+            }
+            return (long) v;
+        };
+        
+        od = scaled ( open_deletion );
+        ed = scaled ( extend_deletion );
+        oi = scaled ( open_insertion );
+        ei = scaled ( extend_insertion );
+        
+        for (long k = 0; k < cost_stride * cost_stride && integral; ++k ) {
+            const long s = scaled ( cost_matrix[ k ] );
+            s_min = k ? MIN_OP( s_min, s ) : s;
+            s_max = k ? MAX_OP( s_max, s ) : s;
+        }
+        
+        if ( integral ) {
+            return scale;
+        }
+    }
+    return 0;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name DifferenceKernelScale
+ * Checks whether a (non-codon) alignment can be computed exactly by the anti-diagonal difference kernel:
+ * all scores and gap costs become integers when multiplied by 1, 2 or 4, extensions cost no more than opening a gap,
+ * and every difference between adjacent DP cells is guaranteed to fit into a signed byte. The sequences must also
+ * be short enough for all DP values to be exact in single precision (as they are in the float DP).
+ *
+ * @return the scale factor, or 0 if the kernel can not be used
+ */
+
+long DifferenceKernelScale ( const cawlign_fp * cost_matrix
+                           , const long cost_stride
+                           , const cawlign_fp open_insertion
+                           , const cawlign_fp extend_insertion
+                           , const cawlign_fp open_deletion
+                           , const cawlign_fp extend_deletion
+                           , const long r_len
+                           , const long q_len
+                           )
+{
+    if ( AlignStringsDiffSIMDWidth () == 0 || cost_stride > 127 || r_len + q_len >= ( 1L << 17 ) ) {
+        return 0;
+    }
+    
+    long s_min, s_max, od, ed, oi, ei;
+    const long scale = IntegerScoringScale ( cost_matrix, cost_stride, open_insertion, extend_insertion, open_deletion, extend_deletion
+                                           , 4, s_min, s_max, od, ed, oi, ei );
+    
+    if ( scale && ed >= 0 && ed <= od && ei >= 0 && ei <= oi && s_min >= -127 && s_max + MAX_OP( od, oi ) <= 127 && od + oi <= 127 ) {
+        return scale;
+    }
+    return 0;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name Int16KernelScale
+ * Checks whether a (non-codon) alignment can be attempted with the int16 striped kernel,
+ * i.e. whether all scores and gap costs become (small) integers when multiplied by a power of two up to 16;
+ * whether the DP values actually fit into int16 is only known once the kernel has run
+ *
+ * @return the scale factor, or 0 if the kernel can not be used
+ */
+
+long Int16KernelScale ( const cawlign_fp * cost_matrix
+                      , const long cost_stride
+                      , const cawlign_fp open_insertion
+                      , const cawlign_fp extend_insertion
+                      , const cawlign_fp open_deletion
+                      , const cawlign_fp extend_deletion
+                      )
+{
+    if ( AlignStringsInt16SIMDWidth () == 0 ) {
+        return 0;
+    }
+    
+    long s_min, s_max, od, ed, oi, ei;
+    return IntegerScoringScale ( cost_matrix, cost_stride, open_insertion, extend_insertion, open_deletion, extend_deletion
+                               , 16, s_min, s_max, od, ed, oi, ei );
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignmentEnd
+ * Locates the cell where the backtrack starts from the scores in the last row and column of the DP matrix
+ * (scaled integer or float), exactly as BacktrackAlignment does for global and trim (do_local) alignments
+ *
+ * @param best will receive the score of that cell
+ */
+
+template <class VALUE> void AlignmentEnd ( const long r_len
+                                         , const long q_len
+                                         , const VALUE * last_row
+                                         , const VALUE * last_col
+                                         , const bool do_local
+                                         , VALUE & best
+                                         , long & index_R
+                                         , long & index_Q
+                                         )
+{
+    index_R = r_len;
+    index_Q = q_len;
+    best    = last_row[ q_len ];
+    
+    if ( do_local ) {
+        for (long i = 0; i < r_len; ++i ) {
+            if ( last_col[ i ] > best ) {
+                best = last_col[ i ];
+                index_R = i;
+            }
+        }
+        for (long j = 0; j < q_len; ++j ) {
+            if ( last_row[ j ] > best ) {
+                best = last_row[ j ];
+                index_R = r_len;
+                index_Q = j;
+            }
+        }
+    }
+}
+
+/**
+ * @name AlignmentEnd
+ * As above, also for true local (do_true_local) alignments, which end at the best cell found by the fill
+ * (best_score, at best_R, best_Q) if it beats the last cell of the matrix
+ */
+
+template <class VALUE> void AlignmentEnd ( const long r_len
+                                         , const long q_len
+                                         , const VALUE * last_row
+                                         , const VALUE * last_col
+                                         , const bool do_local
+                                         , const bool do_true_local
+                                         , const VALUE best_score
+                                         , const long best_R
+                                         , const long best_Q
+                                         , VALUE & best
+                                         , long & index_R
+                                         , long & index_Q
+                                         )
+{
+    if ( do_true_local ) {
+        // as in BacktrackAlignment, the last cell wins ties
+        index_R = r_len;
+        index_Q = q_len;
+        best    = last_row[ q_len ];
+        if ( best_score > best ) {
+            best    = best_score;
+            index_R = best_R;
+            index_Q = best_Q;
+        }
+    } else {
+        AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, best, index_R, index_Q );
+    }
+}
+
+//____________________________________________________________________________________
+
+// the number of threads which have run out of queries of their own (see AlignmentThreadIdle)
+static std::atomic<long> idle_alignment_threads (0);
+
+/**
+ * @name AlignmentThreadIdle
+ * Records that the calling thread (of the OpenMP parallel region that aligns the queries) has no more queries to
+ * align; from then on, the DP matrices of the alignments still in progress are filled as a wavefront of tasks,
+ * which the idle threads (waiting at the end of the parallel region) pick up (see CodonFillTiles and FillBlocks).
+ */
+
+void AlignmentThreadIdle (void) {
+    idle_alignment_threads ++;
+}
+
+#ifdef _OPENMP
+
+//____________________________________________________________________________________
+
+/**
+ * The arguments of FillWavefront, shared by its tasks (see FillWavefrontTask)
+ */
+
+template <class FILL> struct TileWavefront {
+    long band_count,
+         tile_count;
+    // the number of tiles that each tile still waits for
+    std::atomic<int> * waiting;
+    FILL const & fill;
+};
+
+/**
+ * @name FillWavefrontTask
+ * Fills a tile of the wavefront, then the tiles to its right for as long as they have nothing else to wait for;
+ * the tile below each of them is handed to a new task as soon as it is ready.
+ * A tile waits for the tile above it and the tile to its left (which itself waited for the tile above and to the left,
+ * the rest of the halo).
+ */
+
+template <class FILL> static void FillWavefrontTask ( TileWavefront<FILL> const & wavefront, const long band, long tile ) {
+    for (;;) {
+        wavefront.fill ( band, tile );
+        
+        if ( band + 1 < wavefront.band_count && -- wavefront.waiting[ ( band + 1 ) * wavefront.tile_count + tile ] == 0 ) {
+            #pragma omp task default(none) firstprivate(band, tile) shared(wavefront)
+            FillWavefrontTask ( wavefront, band + 1, tile );
+        }
+        
+        if ( ++tile == wavefront.tile_count || -- wavefront.waiting[ band * wavefront.tile_count + tile ] != 0 ) {
+            break;
+        }
+    }
+}
+
+/**
+ * @name FillWavefront
+ * Calls fill (band, tile) for each of the band_count x tile_count tiles of a matrix, as a wavefront of OpenMP tasks
+ * which any thread of the team can pick up (see FillWavefrontTask); returns once every tile is filled.
+ */
+
+template <class FILL> static void FillWavefront ( const long band_count, const long tile_count, FILL const & fill ) {
+    const long tiles = band_count * tile_count;
+    
+    TileWavefront<FILL> wavefront = { band_count, tile_count, new std::atomic<int> [ tiles ], fill };
+    for (long k = 0; k < tiles; ++k ) {
+        wavefront.waiting[ k ] = ( k >= tile_count ) + ( k % tile_count > 0 );
+    }
+    
+    #pragma omp taskgroup
+    {
+        FillWavefrontTask ( wavefront, 0, 0 );
+    }
+    
+    delete [] wavefront.waiting;
+}
+
+#endif
+
+//____________________________________________________________________________________
+
+// (non-codon) DP matrices with at least this many cells are filled in blocks when aligning in parallel (see FillBlocks)
+#define HY_BLOCK_FILL_CELLS  (1L << 22)
+// the height of the bands of blocks, and the narrowest block of the wavefront
+#define HY_BLOCK_ROWS_MIN    256
+#define HY_BLOCK_ROWS_MAX    2048
+#define HY_BLOCK_COLUMNS_MIN 256
+
+/**
+ * @name UseBlockedFill
+ * @return true if the (non-codon) DP matrix of r_len x q_len cells is large enough to be filled in blocks,
+ * and is aligned inside an OpenMP parallel region whose idle threads could share it (see FillBlocks)
+ */
+
+static bool UseBlockedFill ( const long r_len, const long q_len ) {
+#ifdef _OPENMP
+    return r_len * q_len >= HY_BLOCK_FILL_CELLS && r_len >= 2 * HY_BLOCK_ROWS_MIN && q_len >= 2 * HY_BLOCK_COLUMNS_MIN
+           && omp_in_parallel () && omp_get_num_threads () > 1;
+#else
+    return false;
+#endif
+}
+
+/**
+ * A block of a (non-codon) DP matrix filled by FillBlocks, with its traceback codes and what the block to its right
+ * needs from it
+ */
+
+struct DPBlock {
+    long            columns;
+    unsigned char * traceback;
+    long          * diag_offset;
+    // the scores and (do_affine only) insertion scores in the last column of the block (rows + 1 values, index 0 being
+    // the row above the block)
+    cawlign_fp    * last_col_h,
+                  * last_col_i;
+    // (do_true_local only) the best score in the block, and the first cell (in the whole matrix) where it is found
+    cawlign_fp      best_score;
+    long            best_R,
+                    best_Q;
+};
+
+/**
+ * A (non-codon) DP matrix filled in blocks: bands of band_rows rows, top to bottom, each cut into blocks of
+ * tile_columns [band] columns, left to right, whose first row and column are those of AlignStrings
+ */
+
+struct DPBlocks {
+    DPBlocks ( const long r_len, const long q_len, const bool do_affine
+             , const cawlign_fp * row_h, const cawlign_fp * row_d, const cawlign_fp * col_h, const cawlign_fp * col_i );
+    ~DPBlocks ( void );
+    
+    void SetTiles ( const long band, const long columns );
+    
+    long r_len,
+         q_len,
+         band_rows,
+         band_count;
+    const cawlign_fp * col_h,
+                     * col_i;
+    long * tile_columns,
+         * tile_count;
+    DPBlock ** blocks;
+    // band_h [b] and band_d [b] hold the scores and (do_affine only) deletion scores in the row above band b
+    // (q_len + 1 values; band_h [band_count] is the last row of the matrix)
+    cawlign_fp ** band_h,
+               ** band_d;
+    // set when a block could not be filled (e.g. its int16 scores saturated), so that no more blocks are
+    std::atomic<bool> failed;
+};
+
+DPBlocks::DPBlocks ( const long r_len, const long q_len, const bool do_affine
+                   , const cawlign_fp * row_h, const cawlign_fp * row_d, const cawlign_fp * col_h, const cawlign_fp * col_i )
+    : r_len ( r_len ), q_len ( q_len ), col_h ( col_h ), col_i ( col_i ), failed ( false )
+{
+    long threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_num_threads ();
+#endif
+    // (at least) 4 bands per thread, so that a wavefront can soon keep every thread busy
+    band_rows    = MAX_OP ( HY_BLOCK_ROWS_MIN, MIN_OP ( HY_BLOCK_ROWS_MAX, r_len / ( 4 * threads ) ) );
+    band_count   = ( r_len + band_rows - 1 ) / band_rows;
+    tile_columns = new long [ 2 * band_count ];
+    tile_count   = tile_columns + band_count;
+    blocks       = new DPBlock* [ band_count ] ();
+    band_h       = new cawlign_fp* [ 2 * ( band_count + 1 ) ];
+    band_d       = band_h + band_count + 1;
+    band_h [ 0 ] = new cawlign_fp [ 2 * ( band_count + 1 ) * ( q_len + 1 ) ];
+    
+    for (long b = 0; b <= band_count; ++b ) {
+        band_h [ b ] = band_h [ 0 ] + 2 * b * ( q_len + 1 );
+        band_d [ b ] = band_h [ b ] + q_len + 1;
+        band_h [ b ][ 0 ] = col_h [ MIN_OP ( b * band_rows, r_len ) ];
+    }
+    
+    memcpy ( band_h [ 0 ], row_h, sizeof ( cawlign_fp ) * ( q_len + 1 ) );
+    if ( do_affine ) {
+        memcpy ( band_d [ 0 ], row_d, sizeof ( cawlign_fp ) * ( q_len + 1 ) );
+    }
+}
+
+DPBlocks::~DPBlocks ( void ) {
+    for (long b = 0; b < band_count; ++b ) {
+        if ( blocks [ b ] ) {
+            for (long t = 0; t < tile_count [ b ]; ++t ) {
+                delete [] blocks [ b ][ t ].traceback;
+                delete [] blocks [ b ][ t ].diag_offset;
+                delete [] blocks [ b ][ t ].last_col_h;
+            }
+            delete [] blocks [ b ];
+        }
+    }
+    delete [] band_h [ 0 ];
+    delete [] band_h;
+    delete [] blocks;
+    delete [] tile_columns;
+}
+
+/**
+ * @name DPBlocks::SetTiles
+ * Cuts band number band into blocks of (at most) columns columns
+ */
+
+void DPBlocks::SetTiles ( const long band, const long columns ) {
+    tile_columns [ band ] = columns;
+    tile_count   [ band ] = ( q_len + columns - 1 ) / columns;
+    blocks       [ band ] = new DPBlock [ tile_count [ band ] ] ();
+    for (long t = 0; t < tile_count [ band ]; ++t ) {
+        blocks [ band ][ t ].columns = MIN_OP ( columns, q_len - t * columns );
+    }
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name FillDPBlock
+ * Fills block number tile of band number band, once the block above it and the block to its left are filled
+ *
+ * @param fill fills a block with one of the SIMD kernels, as in FillBlocks
+ */
+
+template <class FILL> static void FillDPBlock ( DPBlocks & dp, const long band, const long tile, FILL const & fill ) {
+    if ( dp.failed ) {
+        return;
+    }
+    
+    const long i0   = 1 + band * dp.band_rows,
+               j0   = 1 + tile * dp.tile_columns [ band ],
+               rows = MIN_OP ( dp.band_rows, dp.r_len - i0 + 1 );
+    
+    DPBlock       & block = dp.blocks [ band ][ tile ];
+    DPBlock const * left  = tile ? & dp.blocks [ band ][ tile - 1 ] : NULL;
+    
+    block.last_col_h = new cawlign_fp [ 2 * ( rows + 1 ) ];
+    block.last_col_i = block.last_col_h + rows + 1;
+    
+    // the corner of the last row belongs to the block to the left, which may be reading it
+    cawlign_fp * const last_row = new cawlign_fp [ block.columns + 1 ];
+    
+    const FillBlock edges = { i0 == 1, j0 == 1, dp.band_d [ band + 1 ] + j0 - 1, block.last_col_i };
+    
+    if ( fill ( block, i0, j0, rows, edges, dp.band_h [ band ] + j0 - 1, dp.band_d [ band ] + j0 - 1
+              , left ? left->last_col_h : dp.col_h + i0 - 1, left ? left->last_col_i : dp.col_i + i0 - 1, last_row ) ) {
+        memcpy ( dp.band_h [ band + 1 ] + j0, last_row + 1, sizeof ( cawlign_fp ) * block.columns );
+        block.best_R += i0 - 1;
+        block.best_Q += j0 - 1;
+    } else {
+        dp.failed = true;
+    }
+    
+    delete [] last_row;
+}
+
+/**
+ * @name FillBlocks
+ * Fills the DP matrix in bands of dp.band_rows rows, which every (non-codon) SIMD kernel can do given the row above
+ * and the column to the left of a block (see FillBlock), with the same scores and traceback codes as a fill of the
+ * entire matrix. While every thread has queries of its own, each band is one block filled by the calling thread;
+ * once there are idle threads (see AlignmentThreadIdle), the remaining bands are cut into (at least) 4 blocks per
+ * thread, and filled as a wavefront of OpenMP tasks (see FillWavefront) which the idle threads share.
+ *
+ * @param fill bool fill (DPBlock & block, long i0, long j0, long rows, FillBlock const & edges, row_h, row_d, col_h,
+ *             col_i, cawlign_fp * last_row) fills the block with rows rows whose top left cell is (i0, j0), as one
+ *             of the kernels with the given boundaries; it stores the traceback, the last column (block.last_col_h,
+ *             rows + 1 values), the last row (last_row, block.columns + 1 values) and (do_true_local only) the best
+ *             score of the block, and returns false if the kernel could not fill it
+ * @return false if a block could not be filled
+ */
+
+template <class FILL> static bool FillBlocks ( DPBlocks & dp, FILL const & fill ) {
+    long band = 0;
+    
+    for (; band < dp.band_count && ! dp.failed; ++band ) {
+#ifdef _OPENMP
+        if ( idle_alignment_threads > 0 ) {
+            break;
+        }
+#endif
+        dp.SetTiles ( band, dp.q_len );
+        FillDPBlock ( dp, band, 0, fill );
+    }
+    
+#ifdef _OPENMP
+    if ( band < dp.band_count && ! dp.failed ) {
+        const long threads = omp_get_num_threads (),
+                   columns = MAX_OP ( HY_BLOCK_COLUMNS_MIN, ( dp.q_len + 4 * threads - 1 ) / ( 4 * threads ) );
+        
+        for (long b = band; b < dp.band_count; ++b ) {
+            dp.SetTiles ( b, columns );
+        }
+        
+        FillWavefront ( dp.band_count - band, dp.tile_count [ band ], [&] ( const long wavefront_band, const long tile ) {
+            FillDPBlock ( dp, band + wavefront_band, tile, fill );
+        } );
+    }
+#endif
+    
+    return ! dp.failed;
+}
+
+/**
+ * @name AlignInBlocks
+ * Aligns two (non-codon) strings by filling their DP matrix in blocks (see FillBlocks), then backtracking through
+ * the traceback codes of the blocks; the result is identical to that of a fill of the entire matrix with the same kernel.
+ *
+ * @param fill fills a block with one of the kernels (see FillBlocks)
+ * @param block_code unsigned char block_code (DPBlock const & block, long i, long j) is the traceback code of cell
+ *                   (i, j) of the block (1 <= i <= its rows, 1 <= j <= block.columns)
+ * @param score will receive the alignment score
+ * @param other arguments are as in AlignStrings and AlignStringsFloat
+ * @return false if a block could not be filled (nothing is done)
+ */
+
+template <class FILL, class CODE> static bool AlignInBlocks ( char const * r_str
+                                                            , char const * q_str
+                                                            , const long r_len
+                                                            , const long q_len
+                                                            , char * & r_res
+                                                            , char * & q_res
+                                                            , const char gap
+                                                            , const bool do_local
+                                                            , const bool do_affine
+                                                            , const bool do_true_local
+                                                            , const bool report_ref_insertions
+                                                            , const bool score_only
+                                                            , const cawlign_fp * row_h
+                                                            , const cawlign_fp * row_d
+                                                            , const cawlign_fp * col_h
+                                                            , const cawlign_fp * col_i
+                                                            , FILL const & fill
+                                                            , CODE const & block_code
+                                                            , cawlign_fp & score
+                                                            )
+{
+    DPBlocks dp ( r_len, q_len, do_affine, row_h, row_d, col_h, col_i );
+    
+    if ( ! FillBlocks ( dp, fill ) ) {
+        return false;
+    }
+    
+    // the last column of the matrix is that of the last block of every band
+    cawlign_fp * const last_col = new cawlign_fp [ r_len + 1 ];
+    last_col [ 0 ] = row_h [ q_len ];
+    
+    cawlign_fp best_score = 0.;
+    long       best_R     = 0,
+               best_Q     = 0;
+    
+    for (long b = 0; b < dp.band_count; ++b ) {
+        DPBlock const & last = dp.blocks [ b ][ dp.tile_count [ b ] - 1 ];
+        memcpy ( last_col + 1 + b * dp.band_rows, last.last_col_h + 1, sizeof ( cawlign_fp ) * MIN_OP ( dp.band_rows, r_len - b * dp.band_rows ) );
+        
+        if ( do_true_local ) {
+            // the first cell (in row-major order) with the best score
+            for (long t = 0; t < dp.tile_count [ b ]; ++t ) {
+                DPBlock const & block = dp.blocks [ b ][ t ];
+                if ( ( b == 0 && t == 0 ) || block.best_score > best_score
+                     || ( block.best_score == best_score && ( block.best_R < best_R || ( block.best_R == best_R && block.best_Q < best_Q ) ) ) ) {
+                    best_score = block.best_score;
+                    best_R     = block.best_R;
+                    best_Q     = block.best_Q;
+                }
+            }
+        }
+    }
+    
+    cawlign_fp const * const last_row = dp.band_h [ dp.band_count ];
+    
+    long       index_R, index_Q;
+    cawlign_fp best;
+    
+    AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, do_true_local, best_score, best_R, best_Q, best, index_R, index_Q );
+    
+    if ( score_only ) {
+        score = best;
+    } else {
+        score = BacktrackAlignmentCodes ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local && ! do_true_local, do_affine, report_ref_insertions
+                                        , index_R, index_Q, best
+                                        , [&] ( const long i, const long j ) -> unsigned char {
+                                            const long band = ( i - 1 ) / dp.band_rows,
+                                                       tile = ( j - 1 ) / dp.tile_columns [ band ];
+                                            return block_code ( dp.blocks [ band ][ tile ], i - band * dp.band_rows, j - tile * dp.tile_columns [ band ] );
+                                        } );
+    }
+    
+    delete [] last_col;
+    return true;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsDifference
+ * Aligns two (non-codon) strings with the anti-diagonal difference kernel, when DifferenceKernelScale allows it;
+ * the result is identical to that of the float DP in AlignStrings, but only one byte per DP cell is stored.
+ * Does not support true local alignment.
+ *
+ * @param score_only only compute the score (r_res and q_res are not set, and no traceback is stored)
+ * @param score will receive the alignment score
+ * @param other arguments are as in AlignStrings
+ * @return false if the kernel can not be used (nothing is done)
+ */
+
+bool AlignStringsDifference ( char const * r_str
+                            , char const * q_str
+                            , const long r_len
+                            , const long q_len
+                            , char * & r_res
+                            , char * & q_res
+                            , long * char_map
+                            , const cawlign_fp * cost_matrix
+                            , const long cost_stride
+                            , const char gap
+                            , const cawlign_fp open_insertion
+                            , const cawlign_fp extend_insertion
+                            , const cawlign_fp open_deletion
+                            , const cawlign_fp extend_deletion
+                            , const bool do_local
+                            , const bool do_affine
+                            , const bool report_ref_insertions
+                            , const bool score_only
+                            , cawlign_fp & score
+                            )
+{
+    const long scale = DifferenceKernelScale ( cost_matrix, cost_stride, open_insertion, extend_insertion, open_deletion, extend_deletion, r_len, q_len );
+    
+    if ( scale == 0 ) {
+        return false;
+    }
+    
+    // the first row and column of the DP matrices, initialized exactly as in AlignStrings
+    cawlign_fp * const boundaries = new cawlign_fp [ 3 * ( q_len + 1 ) + 3 * ( r_len + 1 ) ],
+               * const row_h = boundaries,
+               * const row_i = row_h + ( q_len + 1 ),
+               * const row_d = row_i + ( q_len + 1 ),
+               * const col_h = row_d + ( q_len + 1 ),
+               * const col_i = col_h + ( r_len + 1 ),
+               * const col_d = col_i + ( r_len + 1 );
+    
+    InitAlignmentMatrices ( 1, q_len + 1, do_local, do_affine, false
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                          , row_h, row_i, row_d );
+    InitAlignmentMatrices ( r_len + 1, 1, do_local, do_affine, false
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                          , col_h, col_i, col_d );
+    
+    if ( UseBlockedFill ( r_len, q_len ) ) {
+        AlignInBlocks ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local, do_affine, false, report_ref_insertions, score_only
+                      , row_h, row_d, col_h, col_i
+                      , [&] ( DPBlock & block, const long i0, const long j0, const long rows, FillBlock const & edges
+                            , const cawlign_fp * b_row_h, const cawlign_fp * b_row_d, const cawlign_fp * b_col_h, const cawlign_fp * b_col_i
+                            , cawlign_fp * last_row ) -> bool {
+                          const long columns = block.columns;
+                          long * const scaled = new long [ rows + columns + 2 ];
+                          
+                          block.traceback   = score_only ? NULL : new unsigned char [ rows * columns + AlignStringsDiffSIMDWidth () ];
+                          block.diag_offset = new long [ rows + columns + 1 ];
+                          AlignStringsFillDiffSIMD ( r_str + i0 - 1, q_str + j0 - 1, rows, columns, char_map, cost_matrix, cost_stride, scale
+                                                   , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine
+                                                   , b_row_h, b_row_d, b_col_h, b_col_i, block.traceback, block.diag_offset
+                                                   , scaled, scaled + columns + 1, &edges );
+                          for (long j = 0; j <= columns; ++j ) {
+                              last_row [ j ] = (cawlign_fp) scaled [ j ] / (cawlign_fp) scale;
+                          }
+                          for (long i = 0; i <= rows; ++i ) {
+                              block.last_col_h [ i ] = (cawlign_fp) scaled [ columns + 1 + i ] / (cawlign_fp) scale;
+                          }
+                          delete [] scaled;
+                          return true;
+                      }
+                      , [] ( DPBlock const & block, const long i, const long j ) -> unsigned char { return block.traceback[ block.diag_offset[ i + j ] + i ]; }
+                      , score );
+        delete [] boundaries;
+        return true;
+    }
+    
+    unsigned char * const traceback   = score_only ? NULL : new unsigned char [ r_len * q_len + AlignStringsDiffSIMDWidth () ];
+    long          * const diag_offset = new long [ r_len + q_len + 1 ],
+                  * const last_row    = new long [ q_len + 1 ],
+                  * const last_col    = new long [ r_len + 1 ];
+    
+    AlignStringsFillDiffSIMD ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride, scale
+                             , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine
+                             , row_h, row_d, col_h, col_i, traceback, diag_offset, last_row, last_col );
+    
+    long index_R, index_Q, best;
+    AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, best, index_R, index_Q );
+    
+    if ( score_only ) {
+        score = (cawlign_fp) best / (cawlign_fp) scale;
+    } else {
+        score = BacktrackAlignmentCodes ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local, do_affine, report_ref_insertions
+                                        , index_R, index_Q, (cawlign_fp) best / (cawlign_fp) scale
+                                        , [&] ( const long i, const long j ) -> unsigned char { return traceback[ diag_offset[ i + j ] + i ]; } );
+    }
+    
+    delete [] traceback;
+    delete [] diag_offset;
+    delete [] last_row;
+    delete [] last_col;
+    delete [] boundaries;
+    return true;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsInt16
+ * Aligns two (non-codon) strings with the int16 striped kernel, when Int16KernelScale allows it and
+ * the DP values fit into 16 bits; the result is identical to that of the float DP in AlignStrings,
+ * but only one byte per DP cell is stored.
+ *
+ * @param score_only only compute the score (r_res and q_res are not set, and no traceback is stored)
+ * @param score will receive the alignment score
+ * @param other arguments are as in AlignStrings
+ * @return false if the kernel can not be used or the scores saturated (nothing is done; use the float DP instead)
+ */
+
+bool AlignStringsInt16 ( char const * r_str
+                       , char const * q_str
+                       , const long r_len
+                       , const long q_len
+                       , char * & r_res
+                       , char * & q_res
+                       , long * char_map
+                       , const cawlign_fp * cost_matrix
+                       , const long cost_stride
+                       , const char gap
+                       , const cawlign_fp open_insertion
+                       , const cawlign_fp extend_insertion
+                       , const cawlign_fp open_deletion
+                       , const cawlign_fp extend_deletion
+                       , const bool do_local
+                       , const bool do_affine
+                       , const bool do_true_local
+                       , const bool report_ref_insertions
+                       , const bool score_only
+                       , cawlign_fp & score
+                       )
+{
+    const long scale = Int16KernelScale ( cost_matrix, cost_stride, open_insertion, extend_insertion, open_deletion, extend_deletion );
+    
+    if ( scale == 0 ) {
+        return false;
+    }
+    
+    // the first row and column of the DP matrices, initialized exactly as in AlignStrings
+    cawlign_fp * const boundaries = new cawlign_fp [ 3 * ( q_len + 1 ) + 3 * ( r_len + 1 ) ],
+               * const row_h = boundaries,
+               * const row_i = row_h + ( q_len + 1 ),
+               * const row_d = row_i + ( q_len + 1 ),
+               * const col_h = row_d + ( q_len + 1 ),
+               * const col_i = col_h + ( r_len + 1 ),
+               * const col_d = col_i + ( r_len + 1 );
+    
+    InitAlignmentMatrices ( 1, q_len + 1, do_local, do_affine, false
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                          , row_h, row_i, row_d );
+    InitAlignmentMatrices ( r_len + 1, 1, do_local, do_affine, false
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                          , col_h, col_i, col_d );
+    
+    if ( UseBlockedFill ( r_len, q_len ) ) {
+        const bool filled = AlignInBlocks ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local, do_affine, do_true_local, report_ref_insertions, score_only
+                                          , row_h, row_d, col_h, col_i
+                                          , [&] ( DPBlock & block, const long i0, const long j0, const long rows, FillBlock const & edges
+                                                , const cawlign_fp * b_row_h, const cawlign_fp * b_row_d, const cawlign_fp * b_col_h, const cawlign_fp * b_col_i
+                                                , cawlign_fp * last_row ) -> bool {
+                                              const long columns = block.columns;
+                                              long * const scaled = new long [ rows + columns + 2 ];
+                                              long best_score;
+                                              
+                                              block.traceback = score_only ? NULL : new unsigned char [ rows * columns ];
+                                              const bool block_filled = AlignStringsFillInt16SIMD ( r_str + i0 - 1, q_str + j0 - 1, rows, columns, char_map, cost_matrix, cost_stride, scale
+                                                                                                  , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                                                                                                  , b_row_h, b_row_d, b_col_h, b_col_i, block.traceback, scaled, scaled + columns + 1
+                                                                                                  , best_score, block.best_R, block.best_Q, &edges );
+                                              if ( block_filled ) {
+                                                  for (long j = 0; j <= columns; ++j ) {
+                                                      last_row [ j ] = (cawlign_fp) scaled [ j ] / (cawlign_fp) scale;
+                                                  }
+                                                  for (long i = 0; i <= rows; ++i ) {
+                                                      block.last_col_h [ i ] = (cawlign_fp) scaled [ columns + 1 + i ] / (cawlign_fp) scale;
+                                                  }
+                                                  block.best_score = (cawlign_fp) best_score / (cawlign_fp) scale;
+                                              }
+                                              delete [] scaled;
+                                              return block_filled;
+                                          }
+                                          , [] ( DPBlock const & block, const long i, const long j ) -> unsigned char { return block.traceback[ ( i - 1 ) * block.columns + j - 1 ]; }
+                                          , score );
+        delete [] boundaries;
+        return filled;
+    }
+    
+    unsigned char * const traceback = score_only ? NULL : new unsigned char [ r_len * q_len ];
+    long          * const last_row  = new long [ q_len + 1 ],
+                  * const last_col  = new long [ r_len + 1 ];
+    
+    long best_score, best_R, best_Q;
+    
+    const bool filled = AlignStringsFillInt16SIMD ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride, scale
+                                                  , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                                                  , row_h, row_d, col_h, col_i, traceback, last_row, last_col, best_score, best_R, best_Q );
+    
+    if ( filled ) {
+        long index_R, index_Q, best;
+        
+        AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, do_true_local, best_score, best_R, best_Q, best, index_R, index_Q );
+        
+        if ( score_only ) {
+            score = (cawlign_fp) best / (cawlign_fp) scale;
+        } else {
+            score = BacktrackAlignmentCodes ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local && ! do_true_local, do_affine, report_ref_insertions
+                                            , index_R, index_Q, (cawlign_fp) best / (cawlign_fp) scale
+                                            , [&] ( const long i, const long j ) -> unsigned char { return traceback[ ( i - 1 ) * q_len + j - 1 ]; } );
+        }
+    }
+    
+    delete [] traceback;
+    delete [] last_row;
+    delete [] last_col;
+    delete [] boundaries;
+    return filled;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsBandedFill
+ * Fills the cells (i,j) of the (non-codon) DP matrix with band_lo <= j - i <= band_hi, treating all other cells as
+ * unreachable. Only two rows of scores are kept, and a traceback code (packed, see StoreTracebackCode) is stored for
+ * every cell in the band. With band_lo = -r_len and band_hi = q_len, this is the scalar version of AlignStringsFillSIMD.
+ *
+ * @param row_h, row_d the first row (q_len + 1 values) of the score and deletion (if do_affine) matrices
+ * @param col_h, col_i the first column (r_len + 1 values) of the score and insertion (if do_affine) matrices
+ * @param row_offset will receive the index of the first traceback code of each row (r_len + 1 values)
+ * @param traceback zeroed storage for the packed traceback codes of all cells in the band;
+ *                  the code for (i,j) is code number row_offset[i] + j - max (1, i + band_lo) (NULL if only the scores are needed)
+ * @param last_row will receive the scores in the last row of the DP matrix (q_len + 1 values, -INFINITY outside the band)
+ * @param last_col will receive the scores in the last column of the DP matrix (r_len + 1 values, -INFINITY outside the band)
+ * @param best_score, best_R, best_Q (do_true_local only) will receive the best score in the band (rows and columns
+ *                                   1 and above), and the first cell (in row-major order) where it is found
+ */
+
+void AlignStringsBandedFill ( char const * r_str
+                            , char const * q_str
+                            , const long r_len
+                            , const long q_len
+                            , long * char_map
+                            , const cawlign_fp * cost_matrix
+                            , const long cost_stride
+                            , const cawlign_fp open_insertion
+                            , const cawlign_fp extend_insertion
+                            , const cawlign_fp open_deletion
+                            , const cawlign_fp extend_deletion
+                            , const bool do_affine
+                            , const bool do_true_local
+                            , const long band_lo
+                            , const long band_hi
+                            , const cawlign_fp * row_h
+                            , const cawlign_fp * row_d
+                            , const cawlign_fp * col_h
+                            , const cawlign_fp * col_i
+                            , long * row_offset
+                            , unsigned char * traceback
+                            , cawlign_fp * last_row
+                            , cawlign_fp * last_col
+                            , cawlign_fp & best_score
+                            , long & best_R
+                            , long & best_Q
+                            )
+{
+    cawlign_fp * const rows   = new cawlign_fp [ 4 * ( q_len + 1 ) ],
+               *       h_prev = rows,
+               *       h_curr = h_prev + ( q_len + 1 ),
+               *       d_prev = h_curr + ( q_len + 1 ),
+               *       d_curr = d_prev + ( q_len + 1 );
+    
+    for (long j = 0; j <= q_len; ++j ) {
+        const bool in_band = j <= band_hi;
+        h_prev[ j ]   = in_band ? row_h[ j ] : -INFINITY;
+        d_prev[ j ]   = in_band && do_affine ? row_d[ j ] : -INFINITY;
+        last_row[ j ] = -INFINITY;
+    }
+    for (long i = 0; i <= r_len; ++i ) {
+        last_col[ i ] = -INFINITY;
+    }
+    last_col[ 0 ] = h_prev[ q_len ];
+    
+    best_score = -INFINITY;
+    best_R = best_Q = 0;
+    
+    long offset = 0;
+    
+    for (long i = 1; i <= r_len; ++i ) {
+        const long r_char = char_map[ (unsigned char) r_str[ i - 1 ] ],
+                   lo     = MAX_OP ( 1, i + band_lo ),
+                   hi     = MIN_OP ( q_len, i + band_hi );
+        
+        // column 0 is in the band only for the first -band_lo rows
+        const bool left_in_band = lo == 1 && -i >= band_lo;
+        
+        cawlign_fp h_left = left_in_band ? col_h[ i ] : -INFINITY,
+                   i_left = left_in_band && do_affine ? col_i[ i ] : -INFINITY;
+        
+        h_curr[ lo - 1 ] = h_left;
+        
+        row_offset[ i ] = offset;
+        const long code_offset = offset - lo;
+        offset += hi - lo + 1;
+        
+        for (long j = lo; j <= hi; ++j ) {
+            cawlign_fp deletion  = h_prev[ j ] - open_deletion,
+                       insertion = h_left - open_insertion,
+                       match     = h_prev[ j - 1 ];
+            
+            if ( r_char >= 0 ) {
+                const long q_char = char_map[ (unsigned char) q_str[ j - 1 ] ];
+                if ( q_char >= 0 ) {
+                    match += cost_matrix[ r_char * cost_stride + q_char ];
+                }
+            }
+            
+            unsigned char code;
+            
+            if ( do_affine ) {
+                deletion  = MAX_OP( deletion,  d_prev[ j ] - ( i > 1 ? extend_deletion : open_deletion ) );
+                insertion = MAX_OP( insertion, i_left - ( j > 1 ? extend_insertion : open_insertion ) );
+                d_curr[ j ] = deletion;
+                i_left      = insertion;
+                
+                // the same choices as the affine backtrack in BacktrackAlignment
+                cawlign_fp max_score = deletion;
+                code = 1;
+                if ( insertion > max_score ) {
+                    max_score = insertion;
+                    code = 2;
+                }
+                if ( match > max_score ) {
+                    code = 0;
+                }
+            } else {
+                // the same choices as BacktrackAlign
+                code = ( match >= deletion && match >= insertion ) ? 0 : ( deletion >= insertion ? 1 : 2 );
+            }
+            
+            h_left = MAX_OP( match, MAX_OP( deletion, insertion ) );
+            h_curr[ j ] = h_left;
+            
+            if ( do_affine ) {
+                if ( h_left - open_deletion <= deletion - extend_deletion ) {
+                    code |= 4;
+                }
+                if ( h_left - open_insertion <= insertion - extend_insertion ) {
+                    code |= 8;
+                }
+            }
+            
+            if ( traceback ) {
+                StoreTracebackCode ( traceback, code_offset + j, code );
+            }
+            
+            if ( do_true_local && h_left > best_score ) {
+                best_score = h_left;
+                best_R     = i;
+                best_Q     = j;
+            }
+        }
+        
+        // the next row reads at most one cell past either end of this one
+        if ( hi < q_len ) {
+            h_curr[ hi + 1 ] = -INFINITY;
+            d_curr[ hi + 1 ] = -INFINITY;
+        }
+        if ( hi == q_len ) {
+            last_col[ i ] = h_curr[ q_len ];
+        }
+        
+        std::swap ( h_prev, h_curr );
+        std::swap ( d_prev, d_curr );
+    }
+    
+    if ( -r_len >= band_lo ) {
+        last_row[ 0 ] = col_h[ r_len ];
+    }
+    for (long j = MAX_OP ( 1, r_len + band_lo ); j <= MIN_OP ( q_len, r_len + band_hi ); ++j ) {
+        last_row[ j ] = h_prev[ j ];
+    }
+    
+    delete [] rows;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name BacktrackFloatCodes
+ * Picks the cell where the alignment ends, exactly as BacktrackAlignment does, and backtracks from it through the
+ * packed traceback codes written by AlignStringsFillSIMD (or AlignStringsBandedFill over the entire matrix).
+ *
+ * @param traceback the packed traceback codes; the code for (i,j) is code number (i-1)*q_len + j-1
+ * @param last_row, last_col, best_score, best_R, best_Q as filled by AlignStringsFillSIMD
+ * @param other arguments are as in AlignStrings
+ * @return the alignment score
+ */
+
+cawlign_fp BacktrackFloatCodes ( char const * r_str
+                               , char const * q_str
+                               , const long r_len
+                               , const long q_len
+                               , char * & r_res
+                               , char * & q_res
+                               , const char gap
+                               , const bool do_local
+                               , const bool do_affine
+                               , const bool do_true_local
+                               , const bool report_ref_insertions
+                               , const unsigned char * traceback
+                               , const cawlign_fp * last_row
+                               , const cawlign_fp * last_col
+                               , const cawlign_fp best_score
+                               , const long best_R
+                               , const long best_Q
+                               )
+{
+    long       index_R, index_Q;
+    cawlign_fp best;
+    
+    AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, do_true_local, best_score, best_R, best_Q, best, index_R, index_Q );
+    
+    return BacktrackAlignmentCodes ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local && ! do_true_local, do_affine, report_ref_insertions
+                                   , index_R, index_Q, best
+                                   , [&] ( const long i, const long j ) -> unsigned char { return TracebackCode ( traceback, ( i - 1 ) * q_len + j - 1 ); } );
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsFloat
+ * Aligns two (non-empty, non-codon) strings with single precision scores, using the striped SIMD kernel if available
+ * (and the scalar fill otherwise). Only two rows of scores and half a byte of traceback information per DP cell are
+ * stored, instead of the full score, insertion and deletion matrices; the result is that of the full DP.
+ *
+ * @param score_only only compute the score (r_res and q_res are not set, and no traceback is stored)
+ * @param other arguments are as in AlignStrings
+ * @return the alignment score
+ */
+
+cawlign_fp AlignStringsFloat ( char const * r_str
+                             , char const * q_str
+                             , const long r_len
+                             , const long q_len
+                             , char * & r_res
+                             , char * & q_res
+                             , long * char_map
+                             , const cawlign_fp * cost_matrix
+                             , const long cost_stride
+                             , const char gap
+                             , const cawlign_fp open_insertion
+                             , const cawlign_fp extend_insertion
+                             , const cawlign_fp open_deletion
+                             , const cawlign_fp extend_deletion
+                             , const bool do_local
+                             , const bool do_affine
+                             , const bool do_true_local
+                             , const bool report_ref_insertions
+                             , const bool score_only
+                             )
+{
+    // the first row and column of the DP matrices
+    cawlign_fp * const boundaries = new cawlign_fp [ 3 * ( q_len + 1 ) + 3 * ( r_len + 1 ) ],
+               * const row_h = boundaries,
+               * const row_i = row_h + ( q_len + 1 ),
+               * const row_d = row_i + ( q_len + 1 ),
+               * const col_h = row_d + ( q_len + 1 ),
+               * const col_i = col_h + ( r_len + 1 ),
+               * const col_d = col_i + ( r_len + 1 );
+    
+    InitAlignmentMatrices ( 1, q_len + 1, do_local, do_affine, false
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                          , row_h, row_i, row_d );
+    InitAlignmentMatrices ( r_len + 1, 1, do_local, do_affine, false
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                          , col_h, col_i, col_d );
+    
+    cawlign_fp score;
+    
+    if ( AlignStringsSIMDWidth () > 1 && UseBlockedFill ( r_len, q_len )
+         && AlignInBlocks ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local, do_affine, do_true_local, report_ref_insertions, score_only
+                      , row_h, row_d, col_h, col_i
+                      , [&] ( DPBlock & block, const long i0, const long j0, const long rows, FillBlock const & edges
+                            , const cawlign_fp * b_row_h, const cawlign_fp * b_row_d, const cawlign_fp * b_col_h, const cawlign_fp * b_col_i
+                            , cawlign_fp * last_row ) -> bool {
+                          block.traceback = score_only ? NULL : new unsigned char [ TracebackCodeBytes ( rows * block.columns ) ] ();
+                          return AlignStringsFillSIMD ( r_str + i0 - 1, q_str + j0 - 1, rows, block.columns, char_map, cost_matrix, cost_stride
+                                                      , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                                                      , b_row_h, b_row_d, b_col_h, b_col_i, block.traceback, last_row, block.last_col_h
+                                                      , block.best_score, block.best_R, block.best_Q, &edges );
+                      }
+                      , [] ( DPBlock const & block, const long i, const long j ) -> unsigned char { return TracebackCode ( block.traceback, ( i - 1 ) * block.columns + j - 1 ); }
+                      , score ) ) {
+        delete [] boundaries;
+        return score;
+    }
+    
+    unsigned char * const traceback = score_only ? NULL : new unsigned char [ TracebackCodeBytes ( r_len * q_len ) ] ();
+    cawlign_fp    * const last_row  = new cawlign_fp [ q_len + 1 ],
+                  * const last_col  = new cawlign_fp [ r_len + 1 ];
+    
+    cawlign_fp best_score;
+    long       best_R, best_Q;
+    
+    if ( ! AlignStringsFillSIMD ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride
+                                , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                                , row_h, row_d, col_h, col_i, traceback, last_row, last_col, best_score, best_R, best_Q ) ) {
+        // scalar fallback: a band which covers the entire matrix
+        long * const row_offset = new long [ r_len + 1 ];
+        AlignStringsBandedFill ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride
+                               , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                               , -r_len, q_len, row_h, row_d, col_h, col_i, row_offset, traceback, last_row, last_col
+                               , best_score, best_R, best_Q );
+        delete [] row_offset;
+    }
+    
+    if ( score_only ) {
+        long index_R, index_Q;
+        AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, do_true_local, best_score, best_R, best_Q, score, index_R, index_Q );
+    } else {
+        score = BacktrackFloatCodes ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local, do_affine, do_true_local
+                                    , report_ref_insertions, traceback, last_row, last_col, best_score, best_R, best_Q );
+    }
+    
+    delete [] traceback;
+    delete [] last_row;
+    delete [] last_col;
+    delete [] boundaries;
+    return score;
+}
+
+//____________________________________________________________________________________
+
+// the height (in reference codons) of the tiles in which the codon DP matrices are filled; with a taller tile,
+// the rows of a narrow tile would each sit on a different page of the matrices
+#define HY_TILE_ROWS 64
+
+// the width of the tiles in which the codon DP matrices are filled (see SetAlignmentTileSize)
+static long alignment_tile_columns = DEFAULT_TILE_COLUMNS;
+
+/**
+ * @name SetAlignmentTileSize
+ * Sets the width (in query positions) of the tiles in which the codon DP matrices are filled (see CodonFillTiles)
+ *
+ * @param columns the tile width; 0 fills entire rows
+ */
+
+void SetAlignmentTileSize ( const long columns ) {
+    alignment_tile_columns = columns > 0 ? columns : 0;
+}
+
+/**
+ * @name AlignmentTileSize
+ * @return the width of the tiles in which the codon DP matrices are filled (0 if entire rows are)
+ */
+
+long AlignmentTileSize (void) {
+    return alignment_tile_columns;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * The arguments of CodonFillTiles, shared by the tasks which fill its tiles (see CodonFillTile)
+ */
+
+struct CodonTiles {
+    CodonReference const * reference;
+    int32_t const * query_partials,
+                  * query_codons;
+    cawlign_fp const * const * query_ambiguities;
+    long first_row,
+         last_row,
+         score_cols,
+         cost_stride,
+         tile_columns,
+         tile_count;
+    cawlign_fp miscall_cost,
+               open_insertion,
+               extend_insertion,
+               open_deletion,
+               extend_deletion;
+    bool do_affine,
+         do_true_local;
+    cawlign_fp * score_matrix,
+               * insertion_matrix,
+               * deletion_matrix;
+    unsigned char * codon_moves;
+};
+
+//____________________________________________________________________________________
+
+/**
+ * @name CodonFillTile
+ * Fills tile number tile (counted left to right) of band number band (HY_TILE_ROWS rows, counted top to bottom)
+ */
+
+static void CodonFillTile ( CodonTiles const & tiles, const long band, const long tile ) {
+    const long i_from = tiles.first_row + 1 + band * HY_TILE_ROWS,
+               i_to   = MIN_OP ( i_from + HY_TILE_ROWS - 1, tiles.last_row ),
+               q_from = 1 + tile * tiles.tile_columns,
+               q_to   = MIN_OP ( q_from + tiles.tile_columns, tiles.score_cols ) - 1;
+    
+    for (long i = i_from; i <= i_to; ++i ) {
+        const long row = ( i - tiles.first_row ) * tiles.score_cols;
+        CodonFillRow ( tiles.reference, tiles.query_partials, tiles.query_codons, tiles.query_ambiguities, i, q_from, q_to
+                     , tiles.score_cols, row + q_from, tiles.score_cols
+                     , tiles.miscall_cost, tiles.open_insertion, tiles.extend_insertion, tiles.open_deletion, tiles.extend_deletion
+                     , tiles.cost_stride, tiles.do_affine, tiles.do_true_local
+                     , tiles.score_matrix, tiles.insertion_matrix, tiles.deletion_matrix
+                     , tiles.codon_moves ? tiles.codon_moves + row - tiles.score_cols + q_from : NULL );
+    }
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name CodonFillTiles
+ * Fills rows first_row + 1, ..., last_row of the codon DP matrices, whose row 0 holds row first_row and whose
+ * boundary columns are already filled, in tiles of HY_TILE_ROWS rows by AlignmentTileSize () columns.
+ * Bands of rows are filled top to bottom, and the tiles of a band left to right; every cell reads the previous row
+ * and up to 5 columns to its left, so the halo of a tile (the last row of the band above it and the last 5 columns
+ * of the tile to its left) is always complete, and every cell is computed from the same values as in a row by row fill.
+ * While a tile is filled, its previous row and the query codes of its columns stay in cache, instead of being
+ * evicted by the rest of a long row, as they are when every row is filled in full.
+ *
+ * Once there are fewer queries left than threads (see AlignmentThreadIdle), the remaining bands are filled as a
+ * wavefront of OpenMP tasks instead (see FillWavefront), with narrower tiles if needed to give every
+ * thread a few tiles of each band, so that the idle threads share this alignment.
+ *
+ * @param codon_moves if not NULL, receives the move codes (see HY_CODON_MOVE_MASK) of rows first_row + 1, ..., last_row
+ * @param other arguments are as in AlignStrings and CodonFillRow
+ */
+
+static void CodonFillTiles ( CodonReference const * const reference
+                           , int32_t const * const query_partials
+                           , int32_t const * const query_codons
+                           , cawlign_fp const * const * const query_ambiguities
+                           , const long first_row
+                           , const long last_row
+                           , const long score_cols
+                           , const cawlign_fp miscall_cost
+                           , const cawlign_fp open_insertion
+                           , const cawlign_fp extend_insertion
+                           , const cawlign_fp open_deletion
+                           , const cawlign_fp extend_deletion
+                           , const long cost_stride
+                           , const bool do_affine
+                           , const bool do_true_local
+                           , cawlign_fp * const score_matrix
+                           , cawlign_fp * const insertion_matrix
+                           , cawlign_fp * const deletion_matrix
+                           , unsigned char * const codon_moves
+                           )
+{
+    if ( score_cols <= 1 ) {
+        return;
+    }
+    
+    const long tile_columns = alignment_tile_columns > 0 ? MIN_OP ( alignment_tile_columns, score_cols - 1 ) : score_cols - 1,
+               band_count   = ( last_row - first_row + HY_TILE_ROWS - 1 ) / HY_TILE_ROWS;
+    
+    CodonTiles tiles = { reference, query_partials, query_codons, query_ambiguities, first_row, last_row, score_cols, cost_stride
+                       , tile_columns, ( score_cols - 1 + tile_columns - 1 ) / tile_columns
+                       , miscall_cost, open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                       , score_matrix, insertion_matrix, deletion_matrix, codon_moves };
+    
+    long band = 0;
+    
+    for (; band < band_count; ++band ) {
+#ifdef _OPENMP
+        if ( idle_alignment_threads > 0 && omp_in_parallel () ) {
+            break;
+        }
+#endif
+        for (long tile = 0; tile < tiles.tile_count; ++tile ) {
+            CodonFillTile ( tiles, band, tile );
+        }
+    }
+    
+#ifdef _OPENMP
+    if ( band < band_count ) {
+        // (at least) 4 tiles per thread in each band, unless that would make them narrower than a band is tall
+        const long threads = omp_get_num_threads (),
+                   columns = MAX_OP ( HY_TILE_ROWS, ( score_cols - 1 + 4 * threads - 1 ) / ( 4 * threads ) );
+        
+        tiles.tile_columns = MIN_OP ( tiles.tile_columns, columns );
+        tiles.tile_count   = ( score_cols - 1 + tiles.tile_columns - 1 ) / tiles.tile_columns;
+        
+        FillWavefront ( band_count - band, tiles.tile_count, [&] ( const long wavefront_band, const long tile ) {
+            CodonFillTile ( tiles, band + wavefront_band, tile );
+        } );
+    }
+#endif
+}
+
+
+//____________________________________________________________________________________
+
+
+/**
+ * @name AlignStrings
+ * Performs a pairwise string alignment; the nature of the alignment algoritm invoked will depend on option flags
+ * returns the score of the alignment
+ * r_res and q_res parameters will the receive aligned strings they will be allocated and populated by this function
+ * 
+ * @param r_str the reference string
+ * @param q_str the query string
+ * @param _r_len the length of the reference string (-1 to compute here)
+ * @param _q_len the length of the query string (-1 to compute here)
+ * @param r_res will receive the resulting REFERENCE alignment
+ * @param q_res will receive the resulting QUERY alignment
+ * @param char_map a char->long map which takes a character from the input string and maps into in [-1,N-1] where N is the dimension of the scoring matrix; an "indvalid" character is mapped to -1
+ * @param cost_matrix an NxN (row-major) matrix of pairwise character scores
+ * @param cost_stride N (column dimension of cost_matrix)
+ * @param gap the character to use for an indel (e.g. '-')
+ * @param open_insertion the cost of opening a gap in the REFERENCE
+ * @param extend_insertion the cost of extending a gap in the REFERENCE
+ * @param open_deletion the cost of opening a gap in the QUERY
+ * @param extend_deletion the cost of extending a gap in the QUERY
+ * @param miscall_cost the cost of introducing any out-of-frame indels
+ * @param do_local if TRUE, local alignment will be performed (no prefix or suffix gap cost)
+ * @param do_affine if TRUE, use the affine gap penalty
+ * @param do_codon if TRUE, do a codon-aware alignment
+ * @param char_count number of alphabet (N-1, where N == cost_stride)
+ * @param codon3x2 (do_codon == TRUE), the cost of aligning codon X with any of the 3 options where 3 refs align to 2 qry
+ * @param codon3x1 (do_codon == TRUE), the cost of aligning codon X with any of the 3 options where 3 refs align to 1 qry
+ * @param do_true_local if TRUE, perform a true local (best scoring substings) alignment
+ * @param report_ref_insertions if TRUE (default), will report deletions relative to the
+ * @param score_matrix_cache if provided, use this to store the scoring matrix (assumed to have sufficient size)
+ * @param insertion_matrix_cache if provided, use this to store the insertion (affine gaps) score matrix (assumed to have sufficient size)
+ * @param deletion_matrix_cache if provided, use this to store the  deletion (affine gaps) score scoring matrix (assumed to have sufficient size)
+ * @param resolution_map if provided, lists ambiguity resolutions for codon-aware alignments
+ * @param codon_reference if provided (do_codon == TRUE), r_str prepared with the same char_map and scoring tables;
+ *        otherwise it is prepared by this call
+ * @return the alignment score
+
+*/
+cawlign_fp AlignStrings( char const * r_str
+                   , char const * q_str
+                   , const long _r_len
+                   , const long _q_len
+                   , char * & r_res
+                   , char * & q_res
+                   , long * char_map
+                   , cawlign_fp const * cost_matrix
+                   , const long cost_stride
+                   , const char gap
+                   , cawlign_fp open_insertion
+                   , cawlign_fp extend_insertion
+                   , cawlign_fp open_deletion
+                   , cawlign_fp extend_deletion
+                   , cawlign_fp miscall_cost
+                   , const bool do_local
+                   , const bool do_affine
                    , const bool do_codon
                    , const long char_count
-                   , const cawlign_fp * codon3x5
-                   , const cawlign_fp * codon3x4
                    , const cawlign_fp * codon3x2
                    , const cawlign_fp * codon3x1
                    , const bool do_true_local
@@ -1104,6 +2750,7 @@ cawlign_fp AlignStrings( char const * r_str
                    , cawlign_fp* insertion_matrix_cache
                    , cawlign_fp* deletion_matrix_cache
                    , const long* resolution_map
+                   , const CodonReference* codon_reference
                    )
 {
     const unsigned long r_len = _r_len >= 0 ? _r_len : strlen( r_str ),
@@ -1167,595 +2814,1244 @@ cawlign_fp AlignStrings( char const * r_str
                 else
                     score = -open_deletion * r_len;
             }
+        } else if ( ! do_codon && ! do_true_local
+                    && AlignStringsDifference ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                                              , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                              , do_local, do_affine, report_ref_insertions, false, score ) ) {
+            // aligned by the anti-diagonal difference kernel
+        } else if ( ! do_codon
+                    && AlignStringsInt16 ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                                         , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                         , do_local, do_affine, do_true_local, report_ref_insertions, false, score ) ) {
+            // aligned by the int16 striped kernel (scores did not saturate)
+        } else if ( ! do_codon ) {
+            score = AlignStringsFloat ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                                      , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                      , do_local, do_affine, do_true_local, report_ref_insertions, false );
         } else {
-            long edit_ptr = 0;
-            // don't forget the optional termination character
-            
-            signed char * const edit_ops = (signed char * const)alloca (sizeof (signed char) * ( r_len + q_len ));
-            // allocate enough storage to store the best scoring path through the DP matrix
-
             cawlign_fp * const score_matrix = score_matrix_cache ?  score_matrix_cache : new cawlign_fp[ score_rows * score_cols ],
                    * const insertion_matrix = do_affine ? (insertion_matrix_cache ? insertion_matrix_cache : new cawlign_fp[ score_rows * score_cols ]) : NULL,
                    * const deletion_matrix  = do_affine ? (deletion_matrix_cache ? deletion_matrix_cache : new cawlign_fp[ score_rows * score_cols ]) : NULL;
             
             // allocate the DP matrix and, if using affine gaps, also allocate insertion and deletion DP matrices
 
-            // encode each string using the character map (char_map)
-            long * r_enc = NULL,
-                 * q_enc = NULL;
+            // encode the query using the character map (char_map); the reference is prepared once per run
+            long * q_enc = NULL;
+
+            CodonReference const * reference = codon_reference;
+
+            // the (partial) query codons of each column, see CodonQueryCodes and CodonQueryAmbiguities
+            int32_t * query_partials = NULL,
+                    * query_codons   = NULL;
+            cawlign_fp const ** query_ambiguities = NULL;
+            cawlign_fp        * ambiguity_scores  = NULL;
+ 
+            if ( do_codon ) {
+                // encode the query in [0, charCount],
+                // i.e. something that can be directly looked up in the scoring matrix
+                q_enc = (long*)alloca (sizeof (long) *  q_len );
+
+                if ( ! reference ) {
+                    reference = new CodonReference ( r_str, r_len, char_map, cost_matrix, cost_stride, char_count
+                                                   , codon3x2, codon3x1 );
+                }
+
+                for (long i = 0; i < q_len; ++i ) {
+                    q_enc[ i ] = char_map[ (unsigned char) q_str[ i ] ];
+                }
+
+                query_partials = new int32_t [ score_cols * HY_QUERY_PARTIALS ];
+                query_codons   = new int32_t [ score_cols ];
+                CodonQueryCodes ( q_enc, q_len, char_count, query_partials, query_codons );
+
+                query_ambiguities = new cawlign_fp const* [ score_cols ];
+                ambiguity_scores  = CodonQueryAmbiguities ( q_enc, q_len, char_count, query_codons, resolution_map
+                                                          , cost_matrix, cost_stride, query_ambiguities );
+            }
+            
+            //memset (score_matrix, 0, sizeof (cawlign_fp) * score_rows * score_cols);
+            
+
+            //if ( do_affine ) {
+            //    memset (insertion_matrix, 0, sizeof (cawlign_fp) * score_rows * score_cols);
+            //    memset (deletion_matrix , 0, sizeof (cawlign_fp) * score_rows * score_cols);
+            //}
+
+            InitAlignmentMatrices ( score_rows, score_cols, do_local, do_affine, do_codon
+                                  , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                                  , score_matrix, insertion_matrix, deletion_matrix );
+
+            // the winning move of every cell, so that the backtrack does not have to re-evaluate any of them
+            unsigned char * const codon_moves = new unsigned char [ score_rows * score_cols ];
+
+            if ( do_codon ) {
+                /** populate the dynamic programming matrix here */
+                CodonFillTiles ( reference, query_partials, query_codons, query_ambiguities, 0, score_rows - 1, score_cols
+                               , miscall_cost, open_insertion, extend_insertion, open_deletion, extend_deletion
+                               , cost_stride, do_affine, do_true_local
+                               , score_matrix, insertion_matrix, deletion_matrix, codon_moves + score_cols );
+            }
+
+            score = BacktrackAlignment ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                                       , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                       , do_local, do_affine, do_codon, do_true_local, report_ref_insertions, score_rows, score_cols
+                                       , score_matrix, insertion_matrix, deletion_matrix, codon_moves );
+
+            delete [] codon_moves;
+
+            if ( do_codon ) {
+                delete [] query_partials;
+                delete [] query_codons;
+                delete [] query_ambiguities;
+                delete [] ambiguity_scores;
+                if ( reference != codon_reference ) {
+                    delete reference;
+                }
+            }
+
+            //delete [] edit_ops;
+            if (score_matrix != score_matrix_cache) {
+                delete [] score_matrix;
+            }
+
+            if ( do_affine ) {
+                if (insertion_matrix != insertion_matrix_cache) {
+                    delete [] insertion_matrix;
+                }
+                if (deletion_matrix != deletion_matrix_cache) {
+                    delete [] deletion_matrix;
+                }
+            }
+
+            /*
+            if (do_codon) {
+                delete [] q_enc;
+            }
+            */
+        }
+    }
+
+    return score;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name CodonFillRows
+ * Fills rows first_row + 1, ..., last_row of the codon DP matrices, whose row 0 must hold row first_row (scores and,
+ * for affine gaps, deletions). Column 0 of every row (and columns 1 and 2 of affine insertions, which the fill reads
+ * but never writes) is copied from the boundary_* arrays, which hold the first 3 columns of all rows.
+ *
+ * @param codon_moves if not NULL, receives the move codes (see HY_CODON_MOVE_MASK) of rows first_row + 1, ..., last_row
+ * @param other arguments are as in AlignStrings and CodonFillRow
+ */
+
+void CodonFillRows ( CodonReference const * const reference
+                   , int32_t const * const query_partials
+                   , int32_t const * const query_codons
+                   , cawlign_fp const * const * const query_ambiguities
+                   , const long first_row
+                   , const long last_row
+                   , const long score_cols
+                   , const cawlign_fp miscall_cost
+                   , const cawlign_fp open_insertion
+                   , const cawlign_fp extend_insertion
+                   , const cawlign_fp open_deletion
+                   , const cawlign_fp extend_deletion
+                   , const long cost_stride
+                   , const bool do_affine
+                   , const bool do_true_local
+                   , const cawlign_fp * const boundary_score
+                   , const cawlign_fp * const boundary_insertion
+                   , const cawlign_fp * const boundary_deletion
+                   , cawlign_fp * const score_matrix
+                   , cawlign_fp * const insertion_matrix
+                   , cawlign_fp * const deletion_matrix
+                   , unsigned char * const codon_moves
+                   )
+{
+    for (long i = first_row + 1; i <= last_row; ++i ) {
+        const long row = ( i - first_row ) * score_cols;
+        score_matrix[ row ] = boundary_score[ 3 * i ];
+        if ( do_affine ) {
+            deletion_matrix[ row ] = boundary_deletion[ 3 * i ];
+            for (long j = 0; j < 3 && j < score_cols; ++j ) {
+                insertion_matrix[ row + j ] = boundary_insertion[ 3 * i + j ];
+            }
+        }
+    }
+    CodonFillTiles ( reference, query_partials, query_codons, query_ambiguities, first_row, last_row, score_cols
+                   , miscall_cost, open_insertion, extend_insertion, open_deletion, extend_deletion
+                   , cost_stride, do_affine, do_true_local
+                   , score_matrix, insertion_matrix, deletion_matrix, codon_moves );
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name BacktrackCodonMoves
+ * Follows the move codes of a codon DP (see HY_CODON_MOVE_MASK) back from (index_R, index_Q), as BacktrackAlignment
+ * does with the full matrices, until the start of either string is reached (or only a partial codon is left in both).
+ *
+ * @param edit_ops receives the edit operations, last one first (see BacktrackAlignCodon)
+ * @param edit_ptr the number of operations in edit_ops (updated)
+ * @param index_R the current position in the reference (nucleotides; updated)
+ * @param index_Q the current position in the query (updated)
+ * @param do_affine if TRUE, follow the deletion / insertion runs recorded in the move codes
+ * @param moves returns the move code of the cell in a given (codon) row and (nucleotide) column
+ *
+ * @return false if the walk ran past the start of the strings (the move codes are inconsistent)
+ */
+
+template <class MOVES> bool BacktrackCodonMoves ( signed char * const edit_ops
+                                                , long & edit_ptr
+                                                , long & index_R
+                                                , long & index_Q
+                                                , const bool do_affine
+                                                , MOVES moves
+                                                )
+{
+    bool in_deletion = false;
+
+    while ( index_R && index_Q && ( index_R >= 3 || index_Q >= 3 ) ) {
+        const long row = index_R / 3;
+
+        // a codon deletion run is followed one row per iteration
+        if ( in_deletion ) {
+            if ( moves ( row, index_Q ) & HY_CODON_DELETION_CONTINUES ) {
+                index_R -= 3;
+                edit_ops[ edit_ptr++ ] = -1;
+                edit_ops[ edit_ptr++ ] = -1;
+                edit_ops[ edit_ptr++ ] = -1;
+                continue;
+            }
+            in_deletion = false;
+        }
+
+        const long code = moves ( row, index_Q ) & HY_CODON_MOVE_MASK;
+        BacktrackAlignCodon( edit_ops, edit_ptr, index_R, index_Q, code );
+
+        // if anything drops below 0, something bad happened
+        if ( index_R < 0 || index_Q < 0 ) {
+            return false;
+        }
+
+        if ( do_affine ) {
+            if ( code == HY_111_000 ) {
+                in_deletion = true;
+            } else if ( code == HY_000_111 ) {
+                // insertion runs stay in the same row
+                while ( index_Q >= 3 && ( moves ( row, index_Q ) & HY_CODON_INSERTION_CONTINUES ) ) {
+                    index_Q -= 3;
+                    edit_ops[ edit_ptr++ ] = 1;
+                    edit_ops[ edit_ptr++ ] = 1;
+                    edit_ops[ edit_ptr++ ] = 1;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsCodonLinear
+ * Performs the same codon alignment as AlignStrings (do_codon = TRUE), and reports the same alignment,
+ * without storing the entire (r_len / 3 + 1) x (q_len + 1) DP matrices.
+ *
+ * The rows of the DP matrices (reference codons) are split into ~sqrt (r_len / 3) blocks of ~sqrt (r_len / 3) rows each.
+ * A forward pass keeps only the first row of every block; the backtrack then refills one block at a time,
+ * bottom to top, from its first row, recording the move codes of just that block. This takes about twice the
+ * time of the quadratic fill, and memory proportional to sqrt (r_len / 3) x q_len.
+ *
+ * Arguments are as in AlignStrings
+ * @return the score of the alignment
+ */
+
+cawlign_fp AlignStringsCodonLinear ( char const * r_str
+                                   , char const * q_str
+                                   , const long _r_len
+                                   , const long _q_len
+                                   , char * & r_res
+                                   , char * & q_res
+                                   , long * char_map
+                                   , cawlign_fp const * cost_matrix
+                                   , const long cost_stride
+                                   , const char gap
+                                   , cawlign_fp open_insertion
+                                   , cawlign_fp extend_insertion
+                                   , cawlign_fp open_deletion
+                                   , cawlign_fp extend_deletion
+                                   , cawlign_fp miscall_cost
+                                   , const bool do_local
+                                   , const bool do_affine
+                                   , const long char_count
+                                   , const cawlign_fp * codon3x2
+                                   , const cawlign_fp * codon3x1
+                                   , const bool do_true_local
+                                   , const bool report_ref_insertions
+                                   , const long* resolution_map
+                                   , const CodonReference* codon_reference
+                                   )
+{
+    const long r_len = _r_len >= 0 ? _r_len : strlen( r_str ),
+               q_len = _q_len >= 0 ? _q_len : strlen( q_str ),
+               score_rows = r_len / 3 + 1,
+               score_cols = q_len + 1;
+
+    if ( r_len % 3 != 0 ) {
+        return -INFINITY;
+    }
+
+    if ( score_rows <= 1 || score_cols <= 1 ) {
+        // nothing to fill
+        return AlignStrings ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                            , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                            , do_local, do_affine, true, char_count, codon3x2, codon3x1
+                            , do_true_local, report_ref_insertions, NULL, NULL, NULL, resolution_map, codon_reference );
+    }
+
+    const long block_rows  = (long) ceil ( sqrt ( (double) ( score_rows - 1 ) ) ),
+               block_count = ( score_rows - 2 ) / block_rows + 1,
+               buffer_size = ( block_rows + 1 ) * score_cols;
+
+    CodonReference const * const reference = codon_reference ? codon_reference
+                                                             : new CodonReference ( r_str, r_len, char_map, cost_matrix, cost_stride, char_count
+                                                                                  , codon3x2, codon3x1 );
+
+    long * const q_enc = new long [ q_len ];
+
+    for (long i = 0; i < q_len; ++i ) {
+        q_enc[ i ] = char_map[ (unsigned char) q_str[ i ] ];
+    }
+
+    int32_t * const query_partials = new int32_t [ score_cols * HY_QUERY_PARTIALS ],
+            * const query_codons   = new int32_t [ score_cols ];
+
+    CodonQueryCodes ( q_enc, q_len, char_count, query_partials, query_codons );
+
+    cawlign_fp const ** const query_ambiguities = new cawlign_fp const* [ score_cols ];
+    cawlign_fp        * const ambiguity_scores  = CodonQueryAmbiguities ( q_enc, q_len, char_count, query_codons, resolution_map
+                                                                        , cost_matrix, cost_stride, query_ambiguities );
+
+    // the first 3 columns of every row, set up by InitAlignmentMatrices as in the quadratic matrices
+    cawlign_fp * const boundary_score     = new cawlign_fp [ 3 * score_rows ](),
+               * const boundary_insertion = do_affine ? new cawlign_fp [ 3 * score_rows ]() : NULL,
+               * const boundary_deletion  = do_affine ? new cawlign_fp [ 3 * score_rows ]() : NULL;
+
+    InitAlignmentMatrices ( score_rows, 3, do_local, do_affine, true
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                          , boundary_score, boundary_insertion, boundary_deletion );
+
+    // one block of rows, preceded by its first row
+    cawlign_fp * const score_matrix     = new cawlign_fp [ buffer_size ],
+               * const insertion_matrix = do_affine ? new cawlign_fp [ buffer_size ] : NULL,
+               * const deletion_matrix  = do_affine ? new cawlign_fp [ buffer_size ] : NULL,
+    // the first row of every block, and the last column of the score matrix
+               * const checkpoint_score    = new cawlign_fp [ block_count * score_cols ],
+               * const checkpoint_deletion = do_affine ? new cawlign_fp [ block_count * score_cols ] : NULL,
+               * const last_column         = new cawlign_fp [ score_rows ];
+
+    unsigned char * const codon_moves = new unsigned char [ block_rows * score_cols ];
+
+    InitAlignmentMatrices ( 1, score_cols, do_local, do_affine, true
+                          , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                          , score_matrix, insertion_matrix, deletion_matrix );
+
+    auto fill_block = [&] ( const long block, unsigned char * const moves ) -> long {
+        const long first_row = block * block_rows,
+                   last_row  = MIN_OP ( first_row + block_rows, score_rows - 1 );
+        CodonFillRows ( reference, query_partials, query_codons, query_ambiguities, first_row, last_row, score_cols, miscall_cost
+                      , open_insertion, extend_insertion, open_deletion, extend_deletion
+                      , cost_stride
+                      , do_affine, do_true_local
+                      , boundary_score, boundary_insertion, boundary_deletion
+                      , score_matrix, insertion_matrix, deletion_matrix, moves );
+        return last_row - first_row;
+    };
+
+    // forward pass: keep the first row of every block; a single block keeps its move codes as well
+    cawlign_fp best_local = -INFINITY;
+    long       best_local_R = r_len,
+               best_local_Q = q_len,
+               filled_rows = 0;
+
+    last_column[ 0 ] = score_matrix[ score_cols - 1 ];
+
+    for (long b = 0; b < block_count; ++b ) {
+        if ( b ) {
+            memcpy ( score_matrix, score_matrix + filled_rows * score_cols, sizeof ( cawlign_fp ) * score_cols );
+            if ( do_affine ) {
+                memcpy ( deletion_matrix, deletion_matrix + filled_rows * score_cols, sizeof ( cawlign_fp ) * score_cols );
+            }
+        }
+        memcpy ( checkpoint_score + b * score_cols, score_matrix, sizeof ( cawlign_fp ) * score_cols );
+        if ( do_affine ) {
+            memcpy ( checkpoint_deletion + b * score_cols, deletion_matrix, sizeof ( cawlign_fp ) * score_cols );
+        }
+
+        filled_rows = fill_block ( b, block_count == 1 ? codon_moves : NULL );
+
+        for (long i = 1; i <= filled_rows; ++i ) {
+            const cawlign_fp * score_row = score_matrix + i * score_cols;
+            last_column[ b * block_rows + i ] = score_row[ score_cols - 1 ];
+            if ( do_true_local ) {
+                // the first best cell in row-major order, as in BacktrackAlignment
+                for (long k = 1; k < score_cols; ++k ) {
+                    if ( score_row[ k ] > best_local ) {
+                        best_local   = score_row[ k ];
+                        best_local_R = 3 * ( b * block_rows + i );
+                        best_local_Q = k;
+                    }
+                }
+            }
+        }
+    }
+
+    // locate the end cell of the alignment exactly as BacktrackAlignment does
+    const cawlign_fp * const last_row = score_matrix + filled_rows * score_cols;
+    cawlign_fp score = last_row[ score_cols - 1 ];
+
+    signed char * const edit_ops = new signed char [ r_len + q_len ];
+    long edit_ptr = 0,
+         index_R  = r_len,
+         index_Q  = q_len;
+
+    if ( do_true_local ) {
+        if ( best_local > score ) {
+            score   = best_local;
+            index_R = best_local_R;
+            index_Q = best_local_Q;
+        }
+    } else if ( do_local ) {
+        for (long m = 0; m < score_rows - 1; ++m ) {
+            if ( last_column[ m ] > score ) {
+                score   = last_column[ m ];
+                index_R = 3 * m;
+            }
+        }
+        for (long k = 0; k < score_cols - 1; ++k ) {
+            if ( last_row[ k ] > score ) {
+                score   = last_row[ k ];
+                index_R = r_len;
+                index_Q = k;
+            }
+        }
+        for (long k = index_R; k < r_len; ++k ) {
+            edit_ops[ edit_ptr++ ] = -1;
+        }
+        for (long k = index_Q; k < q_len; ++k ) {
+            edit_ops[ edit_ptr++ ] = 1;
+        }
+    }
+
+    // backtrack, refilling the block which holds the current row whenever the path leaves the one in memory
+    long loaded_block = block_count == 1 ? 0 : -1;
+
+    const bool traced = BacktrackCodonMoves ( edit_ops, edit_ptr, index_R, index_Q, do_affine
+                                            , [&] ( const long row, const long column ) -> unsigned char {
+        const long block = ( row - 1 ) / block_rows;
+        if ( block != loaded_block ) {
+            memcpy ( score_matrix, checkpoint_score + block * score_cols, sizeof ( cawlign_fp ) * score_cols );
+            if ( do_affine ) {
+                memcpy ( deletion_matrix, checkpoint_deletion + block * score_cols, sizeof ( cawlign_fp ) * score_cols );
+            }
+            fill_block ( block, codon_moves );
+            loaded_block = block;
+        }
+        return codon_moves[ ( row - 1 - block * block_rows ) * score_cols + column ];
+    } );
+
+    if ( ! traced ) {
+        score = -INFINITY;
+    } else {
+        // for anything that remains, reference then query
+        while ( --index_R >= 0 )
+            edit_ops[ edit_ptr++ ] = -1;
+        while ( --index_Q >= 0 )
+            edit_ops[ edit_ptr++ ] = 1;
+
+        if ( edit_ptr > 0 ) {
+            EditOpsToAlignment ( edit_ops, edit_ptr, r_str, q_str, r_res, q_res, gap, report_ref_insertions, 0, 0 );
+        }
+    }
+
+    delete [] edit_ops;
+    delete [] codon_moves;
+    delete [] last_column;
+    delete [] checkpoint_score;
+    delete [] score_matrix;
+    delete [] boundary_score;
+    if ( do_affine ) {
+        delete [] checkpoint_deletion;
+        delete [] insertion_matrix;
+        delete [] deletion_matrix;
+        delete [] boundary_insertion;
+        delete [] boundary_deletion;
+    }
+    if ( reference != codon_reference ) {
+        delete reference;
+    }
+    delete [] q_enc;
+    delete [] query_partials;
+    delete [] query_codons;
+    delete [] query_ambiguities;
+    delete [] ambiguity_scores;
+
+    return score;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name CodonSeedDiagonal
+ * Finds the dominant diagonal (query column - 3 x reference codon) of a codon alignment: the one with the most
+ * exact amino-acid k-mer matches between the translated reference and the query translated in all three frames.
+ *
+ * @param reference the prepared reference
+ * @param query the encoded query
+ * @param q_len the length of the query
+ * @param char_count the number of valid characters (nucleotides)
+ * @param translation_table the amino-acid index of each of the char_count^3 codons
+ * @param diagonal receives the dominant diagonal
+ *
+ * @return false if there are no matches
+ */
+
+static bool CodonSeedDiagonal ( CodonReference const * const reference
+                              , long const * query
+                              , const long q_len
+                              , const long char_count
+                              , long const * translation_table
+                              , long & diagonal
+                              )
+{
+    // amino-acid k-mers this long rarely match by chance, and survive most substitutions between related sequences
+    const long seed_length = 4,
+               codon_count = char_count * char_count * char_count,
+               // k-mers occurring more often in the reference (low complexity regions) do not cast votes past this many
+               max_repeats = 32;
+
+    long aa_count = 1;
+    for (long c = 0; c < codon_count; ++c ) {
+        aa_count = MAX_OP ( aa_count, translation_table[ c ] + 1 );
+    }
 
- 
-            if ( do_codon ) {
-                // encode both strings in [0, charCount],
-                // i.e. something that can be directly looked up in the scoring matrix
-                r_enc = (long*)alloca (sizeof (long) *  r_len );
-                q_enc = (long*)alloca (sizeof (long) *  q_len );
-                
-                for (long i = 0; i < r_len; ++i ) {
-                    r_enc[ i ] = char_map[ (unsigned char) r_str[ i ] ];
-                }
-                for (long i = 0; i < q_len; ++i ) {
-                    q_enc[ i ] = char_map[ (unsigned char) q_str[ i ] ];
-                }
+    // the k-mer of amino-acids aa[0..seed_length-1], or -1 if any of them is unresolved
+    auto seed_key = [&] ( long const * aa ) -> long {
+        long key = 0;
+        for (long k = 0; k < seed_length; ++k ) {
+            if ( aa[ k ] < 0 ) {
+                return -1;
             }
-            
-            //memset (score_matrix, 0, sizeof (cawlign_fp) * score_rows * score_cols);
-            
-
-            //if ( do_affine ) {
-            //    memset (insertion_matrix, 0, sizeof (cawlign_fp) * score_rows * score_cols);
-            //    memset (deletion_matrix , 0, sizeof (cawlign_fp) * score_rows * score_cols);
-            //}
-
-            score_matrix [ 0 ] = 0.;
-            // pre-initialize the values in the various matrices
-            if ( ! do_local ) {
-                // full global alignment, i.e. indels at the beginning and end ARE penalized
-                cawlign_fp cost;
-                 // initialize gap costs in first column and first row
-                // they are 0 for local alignments, so ignore
+            key = key * aa_count + aa[ k ];
+        }
+        return key;
+    };
 
-                if ( do_affine ) {
- 
-                    // first handle insertions
-                    cost = -open_insertion;
-                    insertion_matrix[ 0 ] = cost;
-
-                    for (long i = 1; i < score_cols; ++i, cost -= extend_insertion ) {
-                        score_matrix[ i ] = cost;
-                        insertion_matrix[ i ] = cost;
-                        deletion_matrix[ i ] = cost;
-                    }
+    const long r_codons = reference->codon_count;
 
-                    // then deletions
-                    cost = -open_deletion;
-                    deletion_matrix[ 0 ] = cost;
+    if ( r_codons < seed_length || q_len < 3 * seed_length ) {
+        return false;
+    }
 
-                    /** 20240219 : SLKP optimization note; may be faster to do 3 loops because of memory locality */
-                    for (long i = score_cols; i < score_rows * score_cols; i += score_cols, cost -= extend_deletion ) {
-                        score_matrix[ i ] = cost;
-                        insertion_matrix[ i ] = cost;
-                        deletion_matrix[ i ] = cost;
-                    }
-                } else {
-                    // no affine gaps
-                    if ( ! do_codon ) {
-                        cost = -open_insertion;
-                        for (long i = 1; i < score_cols; ++i, cost -= open_insertion )
-                            score_matrix[ i ] = cost;
+    long * const r_aa  = new long [ r_codons ],
+         * const q_aa  = new long [ q_len / 3 + 1 ],
+    // (k-mer << 32) | codon position of each reference k-mer, sorted
+         * const seeds = new long [ r_codons ],
+         * const votes = new long [ q_len + reference->length + 1 ] ();
 
-                        cost = -open_deletion;
-                        for (long i = score_cols; i < score_rows * score_cols; i += score_cols, cost -= open_deletion )
-                            score_matrix[ i ] = cost;
+    long seed_count = 0;
 
-                        // handle the do_local, do_codon case
-                    } else {
-                        cost = -open_insertion;
-                        /** 20240219 : SLKP optimization note; surely the next two loops don't need to do integer remainer at each iteration */
-                        for (long i = 1; i < score_cols; ++i, cost -= open_insertion )
-                            score_matrix[ i ] = cost - ( i % 3 != 1 ? miscall_cost : 0 );
-
-                        cost = -open_deletion;
-                        for (long i = score_cols, j = 0; i < score_rows * score_cols; i += score_cols, cost -= open_insertion, ++j )
-                            score_matrix[ i ] = cost - ( j % 3 != 0 ? miscall_cost : 0 );
-                    }
+    for (long i = 0; i < r_codons; ++i ) {
+        const long codon = reference->codons[ i ];
+        r_aa[ i ] = codon < codon_count ? translation_table[ codon ] : -1;
+    }
+    for (long i = 0; i + seed_length <= r_codons; ++i ) {
+        const long key = seed_key ( r_aa + i );
+        if ( key >= 0 ) {
+            seeds[ seed_count++ ] = ( key << 32 ) | i;
+        }
+    }
+    std::sort ( seeds, seeds + seed_count );
+
+    for (long frame = 0; frame < 3; ++frame ) {
+        const long q_codons = ( q_len - frame ) / 3;
+        for (long a = 0; a < q_codons; ++a ) {
+            long const * codon = query + frame + 3 * a;
+            q_aa[ a ] = ( codon[ 0 ] >= 0 && codon[ 1 ] >= 0 && codon[ 2 ] >= 0 )
+                      ? translation_table[ ( codon[ 0 ] * char_count + codon[ 1 ] ) * char_count + codon[ 2 ] ] : -1;
+        }
+        for (long a = 0; a + seed_length <= q_codons; ++a ) {
+            const long key = seed_key ( q_aa + a );
+            if ( key >= 0 ) {
+                long const * hit = std::lower_bound ( seeds, seeds + seed_count, key << 32 );
+                for (long repeats = 0; hit < seeds + seed_count && ( *hit >> 32 ) == key && repeats < max_repeats; ++hit, ++repeats ) {
+                    // the query column minus the reference nucleotide position where the match starts
+                    votes[ frame + 3 * a - 3 * ( *hit & 0xFFFFFFFFL ) + reference->length ] ++;
                 }
-             } else {
-                 // here we're doing a local alignment,
-                 // the costs of opening a deletion or an insertion
-                 // remain the same no matter how far down the ref or query
-                 // we've traveled, respectively
+            }
+        }
+    }
 
-                if ( do_affine ) {
-                    deletion_matrix [ 0 ] = 0.;
-                    insertion_matrix [ 0 ] = 0.;
-                    if ( do_codon ) {
-                        /** 20240219 : SLKP optimization note; surely the next two loops don't need to do integer remainer at each iteration */
-
-                        // XXX: should we be including the frameshift penalty here? I think not
-                        // fill in the first row of the affine deletion matrix
-                        // with the deletion cost plus the miscall penalty
-                        
-                        
-                        for (long i = 1; i < score_cols; ++i ) {
-                            deletion_matrix[ i ] = -open_deletion - ( i % 3 != 1 ? miscall_cost : 0 );
-                            insertion_matrix [ i ] = 0.;
-                            score_matrix [ i ] = 0.;
-                        }
+    long best_votes = 0;
+    for (long d = 0; d <= q_len + reference->length; ++d ) {
+        if ( votes[ d ] > best_votes ) {
+            best_votes = votes[ d ];
+            diagonal   = d - reference->length;
+        }
+    }
 
-                        // fill in the first column of the affine insertion matrix
-                        // with the insertion cost plus the miscall penalty
-                        for (long i = score_cols, j = 0; i < score_rows * score_cols; i += score_cols, ++j ) {
-                            
-                            cawlign_fp is = -open_insertion - ( j % 3 != 0 ? miscall_cost : 0 );
-                            
-                            insertion_matrix[ i ] = is;
-                            insertion_matrix[ i + 1 ] = 0.;//is;
-                            insertion_matrix[ i + 2 ] = 0.;// is;
-
-                            deletion_matrix [ i ] = 0.;
-                            deletion_matrix [ i + 1 ] = 0.;
-                            deletion_matrix [ i + 2 ] = 0.;
-                            
-                            score_matrix [ i ] = 0.;
-                        }
-                        
-                        //for (long i = score_cols + 1; i < score_rows * score_cols; i += score_cols ) {
-                        //}
-                        
+    delete [] r_aa;
+    delete [] q_aa;
+    delete [] seeds;
+    delete [] votes;
 
-                    } else {
-                        // fill in the first row of the affine deletion matrix
-                        // with the deletion cost
-                        for (long i = 1; i < score_cols; ++i ) {
-                            deletion_matrix[ i ] = -open_deletion;
-                            insertion_matrix [ i ] = 0.;
-                            score_matrix [ i ] = 0.;
-                        }
+    return best_votes > 0;
+}
 
-                        // fill in the first column of the affine insertion matrix
-                        // with the insertion cost
-                        for (long i = score_cols; i < score_rows * score_cols; i += score_cols ) {
-                            insertion_matrix[ i ] = -open_insertion;
-                            deletion_matrix [ i ] = 0.;
-                            score_matrix [ i ] = 0.;
-                        }
-                    }
-                } else {
-                    // init zeros in the score matrix for the non-affine case
-                    for (long i = 1; i < score_cols; ++i ) {
-                        score_matrix [ i ] = 0.;
-                    }
+//____________________________________________________________________________________
 
-                    // fill in the first column of the affine insertion matrix
-                    // with the insertion cost
-                    for (long i = score_cols; i < score_rows * score_cols; i += score_cols ) {
-                        score_matrix [ i ] = 0.;
-                    }
-                }
-            }
+/**
+ * @name CodonFillBand
+ * Fills the cells of a codon DP within a band of diagonals: row i (reference codon) covers query columns
+ * 3i + band_lo, ..., 3i + band_hi (clipped to the matrix). Rows are stored with a stride of band_hi - band_lo + 7,
+ * starting 3 columns before the band (cell (i,j) is at i * stride + j - 3i - band_lo + 3), so that the cells which the
+ * codon moves read outside the band are stored too (as -INFINITY, except for the boundary columns 0, 1 and 2).
+ *
+ * @param first_score, first_insertion, first_deletion row 0 of the DP matrices (all columns)
+ * @param other arguments are as in CodonFillRows
+ */
 
-            if ( do_codon ) {
-                /** populate the dynamic programming matrix here */
-                cawlign_fp score;
-                for (long i = 1; i < score_rows; ++i )
-                    for (long j = 1; j < score_cols; ++j )
-                        CodonAlignStringsStep( score_matrix
-                                             , r_enc
-                                             , q_enc
-                                             , i
-                                             , j
-                                             , score_cols
-                                             , char_count
-                                             , miscall_cost
-                                             , open_insertion
-                                             , open_deletion
-                                             , extend_insertion
-                                             , extend_deletion
-                                             , cost_matrix
-                                             , cost_stride
-                                             , insertion_matrix
-                                             , deletion_matrix
-                                             , codon3x5
-                                             , codon3x4
-                                             , codon3x2
-                                             , codon3x1
-                                             , do_true_local
-                                             , score
-                                             , resolution_map
-                                             );
-                // not doing codon alignment
-            } else {
-                /** populate the dynamic programming matrix here */
-                for (long i = 1; i < score_rows; ++i ) {
-                    const long r_char = char_map[ (unsigned char) r_str[ i - 1 ] ];
-                    for (long j = 1; j < score_cols; ++j ) {
-                        
-                        const long curr = ( i ) * score_cols + j,
-                                   prev = ( i - 1 ) * score_cols + j;
-
-                        // ref but not query is deletion
-                        // query but not ref is insertion
-                        cawlign_fp deletion  = score_matrix[ prev ] - open_deletion,
-                               insertion = score_matrix[ curr - 1 ] - open_insertion,
-                               match     = score_matrix[ prev - 1 ];
-
-                        // if there is a match bonus or penalty, add it in
-                        if ( r_char >= 0 ) {
-                            const long q_char = char_map[ (unsigned char) q_str[ j - 1 ] ];
-                            if ( q_char >= 0 ) {
-                                match += cost_matrix[ r_char * cost_stride + q_char ];
-                            }
-                        }
+void CodonFillBand ( CodonReference const * const reference
+                   , int32_t const * const query_partials
+                   , int32_t const * const query_codons
+                   , cawlign_fp const * const * const query_ambiguities
+                   , const long score_rows
+                   , const long score_cols
+                   , const long band_lo
+                   , const long band_hi
+                   , const cawlign_fp miscall_cost
+                   , const cawlign_fp open_insertion
+                   , const cawlign_fp extend_insertion
+                   , const cawlign_fp open_deletion
+                   , const cawlign_fp extend_deletion
+                   , const long cost_stride
+                   , const bool do_affine
+                   , const bool do_true_local
+                   , const cawlign_fp * const boundary_score
+                   , const cawlign_fp * const boundary_insertion
+                   , const cawlign_fp * const boundary_deletion
+                   , const cawlign_fp * const first_score
+                   , const cawlign_fp * const first_insertion
+                   , const cawlign_fp * const first_deletion
+                   , cawlign_fp * const score_matrix
+                   , cawlign_fp * const insertion_matrix
+                   , cawlign_fp * const deletion_matrix
+                   , unsigned char * const codon_moves
+                   )
+{
+    const long stride = band_hi - band_lo + 7;
 
-                        // if we're doing affine gaps,
-                        // look up potential moves in the affine gap matrices
-                        // 20240219: make sure this works as intended
-                        
-                        if ( do_affine ) {
-                            deletion  = MAX_OP( deletion,
-                                             deletion_matrix[ prev ] - ( i > 1 ? extend_deletion : open_deletion ) ),
-                            insertion = MAX_OP( insertion,
-                                             insertion_matrix[ curr - 1 ] - ( j > 1 ? extend_insertion : open_insertion ) ),
-                            // store the values back in the gap matrices
-                            deletion_matrix[ curr ] = deletion;
-                            insertion_matrix[ curr ] = insertion;
-                        }
+    for (long i = 0; i < score_rows; ++i ) {
+        const long row   = i * stride,
+                   first = 3 * i + band_lo - 3; // the first stored column
 
-                        score_matrix[ curr ] = MAX_OP( match, MAX_OP( deletion, insertion ) );
-                    }
+        for (long t = 0; t < stride; ++t ) {
+            score_matrix[ row + t ] = -INFINITY;
+            if ( do_affine ) {
+                insertion_matrix[ row + t ] = deletion_matrix[ row + t ] = -INFINITY;
+            }
+        }
+
+        if ( i == 0 ) {
+            for (long j = MAX_OP ( 0, first ); j < MIN_OP ( score_cols, first + stride ); ++j ) {
+                score_matrix[ row + j - first ] = first_score[ j ];
+                if ( do_affine ) {
+                    insertion_matrix[ row + j - first ] = first_insertion[ j ];
+                    deletion_matrix [ row + j - first ] = first_deletion[ j ];
                 }
             }
+            continue;
+        }
 
-            // set these indices to point at the ends
-            // of the ref and query, respectively
-            long index_R = r_len;
-            long index_Q = q_len;
-            
-            bool took_local_shortcut = false;
-
-            // grab maximum score from the last entry in the table
-            score = score_matrix[ score_rows * score_cols - 1 ];
-
-            // if we're doing a local alignment,
-            if ( do_true_local) {
-                // find the best score in the matrix
-                // except for the first row/first column 
-                // and start backtracking from there
-                const cawlign_fp * score_row = score_matrix + score_cols;
-                for (long m = 1; m < score_rows; m ++)  {
-                    for (long k = 1; k < score_cols; k ++) {
-                        if ( score_row[ k ] > score ) {
-                            score = score_row[ k ];
-                            index_R = ref_stride * m;
-                            index_Q = k;
-                        }
-                    }
-                    score_row += score_cols;
+        // the boundary columns, as in CodonFillRows
+        for (long j = MAX_OP ( 0, first ); j < 3 && j < first + stride; ++j ) {
+            if ( j == 0 ) {
+                score_matrix[ row - first ] = boundary_score[ 3 * i ];
+            }
+            if ( do_affine ) {
+                insertion_matrix[ row + j - first ] = boundary_insertion[ 3 * i + j ];
+                if ( j == 0 ) {
+                    deletion_matrix[ row - first ] = boundary_deletion[ 3 * i ];
                 }
-                               
-            } else 
-                // find the best score in the last row and column of the scoring matrix
-                // and start backtracking from there ( if it's better than the score
-                // we've already found, that is )
-                if ( do_local ) {
-                    // grab the best score from the last column of the score matrix,
-                    // skipping the very last entry ( we already checked it )
-                    
-                    for (long k = score_cols - 1; k < score_rows * score_cols - 1; k += score_cols )
-                        if ( score_matrix[ k ] > score ) {
-                            score = score_matrix[ k ];
-                            // if do_codon, k / score_cols indexes into the codon space
-                            // of the reference, which is resolved by multiplication
-                            // by ref_stride ( which is 3 ), otherwise this
-                            // directly indexes into the reference
-                            index_R = ref_stride * ( k / score_cols );
-                        }
+            }
+        }
 
-                    // grab the best score from the last row of the score matrix,
-                    // skipping the very last entry ( we already checked it )
-                    for (long k = ( score_rows - 1 ) * score_cols; k < score_rows * score_cols - 1; ++k )
-                        if ( score_matrix[ k ] > score ) {
-                            score = score_matrix[ k ];
-                            // if we've found a better score here,
-                            // don't forget to reset the ref index
-                            index_R = r_len;
-                            // remove the initial value!
-                            index_Q = k - ( score_rows - 1 ) * score_cols;
-                        }
+        const long q_from = MAX_OP ( 1, first + 3 ),
+                   q_to   = MIN_OP ( score_cols - 1, first + stride - 4 );
 
-                    // fill in the edit_ops with the difference
-                    // between r_len and i
-                    for (long k = index_R; k < r_len; ++k ) {
-                        edit_ops[ edit_ptr++ ] = -1;
-                    }
+        if ( q_from <= q_to ) {
+            CodonFillRow ( reference, query_partials, query_codons, query_ambiguities, i, q_from, q_to, score_cols, row + q_from - first, stride - 3
+                         , miscall_cost, open_insertion, extend_insertion, open_deletion, extend_deletion
+                         , cost_stride, do_affine, do_true_local
+                         , score_matrix, insertion_matrix, deletion_matrix, codon_moves + row + q_from - first );
+        }
+    }
+}
 
-                    // fill in the edit_ops with the difference
-                    // between q_len and j
-                    for (long k = index_Q; k < q_len; ++k ) {
-                        edit_ops[ edit_ptr++ ] = 1;
-                    }
-                }
+//____________________________________________________________________________________
 
-            // backtrack now
+/**
+ * @name AlignStringsCodonBanded
+ * Performs a codon alignment as AlignStrings (do_codon = TRUE), filling only a band of diagonals around the dominant
+ * diagonal of exact amino-acid k-mer matches between the translated strings (see CodonSeedDiagonal); for global
+ * alignments, the band also spans the diagonals of both corners of the DP matrix. The band starts 32 query
+ * columns wide on each side, and is doubled (and the band refilled) while the alignment runs within 5 columns of one
+ * of its edges. Unlike the nucleotide banded mode, this is a heuristic: an optimal alignment which leaves the band
+ * for longer than that may be missed.
+ *
+ * Falls back to AlignStrings for true local alignments, when there are no seed matches, and when the band would
+ * cover over a quarter of the columns.
+ *
+ * @param translation_table the amino-acid index of each of the char_count^3 codons
+ * @param other arguments are as in AlignStrings
+ * @return the score of the alignment
+ */
 
-            /*
-            // prints the score matrix
-            for ( long m = 0; m < score_rows; ++m ) {
-               for ( long n = 0; n < score_cols; ++n ) {
-                   if ( n > 0 )
-                       fprintf( stderr, "," );
-                   fprintf( stderr, "% 3.3g", score_matrix[ m * score_cols + n ] );
-               }
-               fprintf( stderr, "\n" );
-            }
-            fprintf( stderr, "\n" );
-            */
+cawlign_fp AlignStringsCodonBanded ( char const * r_str
+                                   , char const * q_str
+                                   , const long _r_len
+                                   , const long _q_len
+                                   , char * & r_res
+                                   , char * & q_res
+                                   , long * char_map
+                                   , cawlign_fp const * cost_matrix
+                                   , const long cost_stride
+                                   , const char gap
+                                   , cawlign_fp open_insertion
+                                   , cawlign_fp extend_insertion
+                                   , cawlign_fp open_deletion
+                                   , cawlign_fp extend_deletion
+                                   , cawlign_fp miscall_cost
+                                   , const bool do_local
+                                   , const bool do_affine
+                                   , const long char_count
+                                   , const cawlign_fp * codon3x2
+                                   , const cawlign_fp * codon3x1
+                                   , long const * translation_table
+                                   , const bool do_true_local
+                                   , const bool report_ref_insertions
+                                   , const long* resolution_map
+                                   , const CodonReference* codon_reference
+                                   )
+{
+    const long r_len = _r_len >= 0 ? _r_len : strlen( r_str ),
+               q_len = _q_len >= 0 ? _q_len : strlen( q_str ),
+               score_rows = r_len / 3 + 1,
+               score_cols = q_len + 1;
 
-            if ( do_codon ) {
-                // if either index hits 0, we're done
-                // or if both indices fall below 3, we're done
-
-                while ( index_R && index_Q && ( index_R >= 3 || index_Q >= 3 ) && !took_local_shortcut ) {
-                    // perform a step
-                    cawlign_fp local_score;
-                    long code = CodonAlignStringsStep( score_matrix
-                                                           , r_enc
-                                                           , q_enc
-                                                           // divide by 3 to index into codon space
-                                                           , ( index_R / 3 )
-                                                           , index_Q
-                                                           , score_cols
-                                                           , char_count
-                                                           , miscall_cost
-                                                           , open_insertion
-                                                           , open_deletion
-                                                           , extend_insertion
-                                                           , extend_deletion
-                                                           , cost_matrix
-                                                           , cost_stride
-                                                           , insertion_matrix
-                                                           , deletion_matrix
-                                                           , codon3x5
-                                                           , codon3x4
-                                                           , codon3x2
-                                                           , codon3x1
-                                                           , do_true_local
-                                                           , local_score
-                                                           , resolution_map
-                                                           );
+    if ( r_len % 3 != 0 ) {
+        return -INFINITY;
+    }
 
-                    
-                    // alter edit_ops and decrement i and j
-                    // according to the step k we took
-                    if (do_true_local && code < 0) {
-                         code = -code - 1;
-                         took_local_shortcut = true;
-                    }
-                    
-                    
-                    BacktrackAlignCodon( edit_ops, edit_ptr, index_R, index_Q, code );
-                    
-                    
-                    // if anything drops below 0, something bad happened
-                    if ( index_R < 0 || index_Q < 0 ) {
-                        //delete [] edit_ops;
-                        return -INFINITY;
-                    }
+    auto align_full = [&] (void) -> cawlign_fp {
+        return AlignStrings ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                            , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                            , do_local, do_affine, true, char_count, codon3x2, codon3x1
+                            , do_true_local, report_ref_insertions, NULL, NULL, NULL, resolution_map, codon_reference );
+    };
 
-                    // handle the affine cases
-                    if ( do_affine ) {
-                        // divide by 3 to index into codon space
-                        long k = ( index_R / 3 ) * score_cols + index_Q;
-                        // reference matched but not query, a deletion
-                        if ( code == HY_111_000 ) {
-                            // while deletion is preferential to match
-                            while ( index_R >= 3
-                                 && score_matrix[ k ] - open_deletion
-                                 <= deletion_matrix[ k ] - extend_deletion ) {
-                                // take a codon out of the reference
-                                index_R -= 3;
-                                edit_ops[ edit_ptr++ ] = -1;
-                                edit_ops[ edit_ptr++ ] = -1;
-                                edit_ops[ edit_ptr++ ] = -1;
-                                // move up a row in the score_matrix
-                                // which is a codon in the reference
-                                k -= score_cols;
-                            }
-                            // query matched but not reference, insertion
-                        } else if ( code == HY_000_111 ) {
-                            // while insertion is preferential to match
-                            while ( index_Q >= 3
-                                 && score_matrix[ k ] - open_insertion
-                                 <= insertion_matrix[ k ] - extend_insertion ) {
-                                // take a codon out of the query
-                                index_Q -= 3;
-                                edit_ops[ edit_ptr++ ] = 1;
-                                edit_ops[ edit_ptr++ ] = 1;
-                                edit_ops[ edit_ptr++ ] = 1;
-                                // move up 3 in the score_matrix
-                                // which is a codon in the query
-                                k -= 3;
-                            }
-                        }
-                    }
-                }
-            } else {
-                if ( do_affine ) {
-                    while ( index_R && index_Q ) {
-                        long curr = ( index_R ) * score_cols + index_Q,
-                             prev = ( index_R - 1 ) * score_cols + index_Q,
-                             best_choice = 0;
-
-                        // check the current affine scores and the match score
-                        cawlign_fp scores[ 3 ] = {
-                            deletion_matrix[ curr ],
-                            insertion_matrix[ curr ],
-                            score_matrix[ prev - 1 ]
-                        }, max_score = scores[ best_choice ];
-
-                        MatchScore( r_str, q_str, index_R, index_Q, char_map, cost_matrix, cost_stride, scores[2] );
-
-                        // look at choice other than 0
-                        if (scores[1] > max_score) {
-                            max_score = scores[1];
-                            best_choice = 1;
-                        }
-                        if (scores[2] > max_score) {
-                            best_choice = 2;
-                        }
-                        
-                        switch ( best_choice ) {
-                        case 0:
-                            // we have at least 1 deletion
-                            --index_R;
-                            edit_ops[ edit_ptr++ ] = -1;
-                            // deletion is travel in the reference but not query,
-                            // look at scores back in the reference,
-                            // and while they are better for the deletion case,
-                            // move backwards in the reference
-                            while ( index_R
-                                 && score_matrix[ curr - score_cols ] - open_deletion
-                                 <= deletion_matrix[ curr - score_cols ] - extend_deletion
-                                  ) {
-                                --index_R;
-                                edit_ops[ edit_ptr++ ] = -1;
-                                curr -= score_cols;
-                            }
-                            break;
-
-                        case 1:
-                            // we have at least 1 insertion
-                            --index_Q;
-                            edit_ops[ edit_ptr++ ] = 1;
-                            // insertion is travel in the query but not the reference,
-                            // look at scores back in the query,
-                            // and while they are better than for the insertion case,
-                            // move backwards in the query
-                            while ( index_Q
-                                 && score_matrix[ curr - 1 ] - open_insertion
-                                 <= insertion_matrix[ curr - 1 ] - extend_insertion
-                                  ) {
-                                --index_Q;
-                                edit_ops[ edit_ptr++ ] = 1;
-                                --curr;
-                            }
-                            break;
-
-                        case 2:
-                            // it's a match! move back in both
-                            --index_R;
-                            --index_Q;
-                            edit_ops[ edit_ptr++ ] = 0;
-                            break;
-                        }
-                    }
-                    // no affine gaps, no codons
-                } else {
-                    while ( index_R && index_Q ) {
-                        const long curr = ( index_R ) * score_cols + index_Q,
-                                   prev = ( index_R - 1 ) * score_cols + index_Q;
+    if ( do_true_local || score_rows <= 1 || score_cols <= 1 ) {
+        return align_full ();
+    }
 
-                        cawlign_fp deletion  = score_matrix[ prev ] - open_deletion,
-                               insertion = score_matrix[ curr - 1 ] - open_insertion,
-                               match     = score_matrix[ prev - 1 ];
+    CodonReference const * const reference = codon_reference ? codon_reference
+                                                             : new CodonReference ( r_str, r_len, char_map, cost_matrix, cost_stride, char_count
+                                                                                  , codon3x2, codon3x1 );
 
-                        MatchScore( r_str, q_str, index_R, index_Q, char_map, cost_matrix, cost_stride, match );
-                        BacktrackAlign( edit_ops, edit_ptr, index_R, index_Q, deletion, insertion, match );
-                    }
-                }
-            }
+    long * const q_enc = new long [ q_len ];
 
+    for (long i = 0; i < q_len; ++i ) {
+        q_enc[ i ] = char_map[ (unsigned char) q_str[ i ] ];
+    }
 
-            
-            if (!took_local_shortcut) {
-                // for anything that remains,
-                // don't forget it!!!
-                // reference
-                
-                
-                while ( --index_R >= 0 )
+    long diagonal  = 0;
+    bool aligned   = false;
+    cawlign_fp score = -INFINITY;
+
+    if ( CodonSeedDiagonal ( reference, q_enc, q_len, char_count, translation_table, diagonal ) ) {
+        int32_t * const query_partials = new int32_t [ score_cols * HY_QUERY_PARTIALS ],
+                * const query_codons   = new int32_t [ score_cols ];
+
+        CodonQueryCodes ( q_enc, q_len, char_count, query_partials, query_codons );
+
+        cawlign_fp const ** const query_ambiguities = new cawlign_fp const* [ score_cols ];
+        cawlign_fp        * const ambiguity_scores  = CodonQueryAmbiguities ( q_enc, q_len, char_count, query_codons, resolution_map
+                                                                            , cost_matrix, cost_stride, query_ambiguities );
+
+        // the first 3 columns of every row and the first row, as in AlignStringsCodonLinear
+        cawlign_fp * const boundary_score     = new cawlign_fp [ 3 * score_rows ](),
+                   * const boundary_insertion = do_affine ? new cawlign_fp [ 3 * score_rows ]() : NULL,
+                   * const boundary_deletion  = do_affine ? new cawlign_fp [ 3 * score_rows ]() : NULL,
+                   * const first_score        = new cawlign_fp [ score_cols ](),
+                   * const first_insertion    = do_affine ? new cawlign_fp [ score_cols ]() : NULL,
+                   * const first_deletion     = do_affine ? new cawlign_fp [ score_cols ]() : NULL;
+
+        InitAlignmentMatrices ( score_rows, 3, do_local, do_affine, true
+                              , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                              , boundary_score, boundary_insertion, boundary_deletion );
+        InitAlignmentMatrices ( 1, score_cols, do_local, do_affine, true
+                              , open_insertion, extend_insertion, open_deletion, extend_deletion, miscall_cost
+                              , first_score, first_insertion, first_deletion );
+
+        // a global alignment runs from the diagonal of the top left corner (0) to that of the bottom right one
+        const long seed_lo = do_local ? diagonal : MIN_OP ( diagonal, MIN_OP ( 0, q_len - r_len ) ),
+                   seed_hi = do_local ? diagonal : MAX_OP ( diagonal, MAX_OP ( 0, q_len - r_len ) );
+
+        for (long width = 32; ! aligned && 4 * ( seed_hi - seed_lo + 2 * width + 1 ) <= score_cols; width *= 2 ) {
+            const long band_lo = seed_lo - width,
+                       band_hi = seed_hi + width,
+                       stride  = band_hi - band_lo + 7,
+                       cells   = score_rows * stride;
+
+            cawlign_fp * const score_matrix     = new cawlign_fp [ cells ],
+                       * const insertion_matrix = do_affine ? new cawlign_fp [ cells ] : NULL,
+                       * const deletion_matrix  = do_affine ? new cawlign_fp [ cells ] : NULL;
+            unsigned char * const codon_moves   = new unsigned char [ cells ] ();
+
+            CodonFillBand ( reference, query_partials, query_codons, query_ambiguities, score_rows, score_cols, band_lo, band_hi
+                          , miscall_cost, open_insertion, extend_insertion, open_deletion, extend_deletion, cost_stride
+                          , do_affine, do_true_local, boundary_score, boundary_insertion, boundary_deletion
+                          , first_score, first_insertion, first_deletion
+                          , score_matrix, insertion_matrix, deletion_matrix, codon_moves );
+
+            // the stored value of cell (i, j), -INFINITY if it is not stored
+            auto cell = [&] ( const long i, const long j ) -> cawlign_fp {
+                const long t = j - 3 * i - band_lo + 3;
+                return t >= 0 && t < stride ? score_matrix[ i * stride + t ] : -INFINITY;
+            };
+
+            // locate the end cell of the alignment as AlignStringsCodonLinear does
+            signed char * const edit_ops = new signed char [ r_len + q_len ];
+            long edit_ptr = 0,
+                 index_R  = r_len,
+                 index_Q  = q_len;
+
+            score = cell ( score_rows - 1, q_len );
+
+            if ( do_local ) {
+                for (long m = 0; m < score_rows - 1; ++m ) {
+                    if ( cell ( m, q_len ) > score ) {
+                        score   = cell ( m, q_len );
+                        index_R = 3 * m;
+                    }
+                }
+                for (long k = 0; k < score_cols - 1; ++k ) {
+                    if ( cell ( score_rows - 1, k ) > score ) {
+                        score   = cell ( score_rows - 1, k );
+                        index_R = r_len;
+                        index_Q = k;
+                    }
+                }
+                for (long k = index_R; k < r_len; ++k ) {
                     edit_ops[ edit_ptr++ ] = -1;
-
-                // then query
-                while ( --index_Q >= 0 )
+                }
+                for (long k = index_Q; k < q_len; ++k ) {
                     edit_ops[ edit_ptr++ ] = 1;
+                }
             }
 
-            if ( edit_ptr > 0 ) {
-                // reset indices to 0
-                if (!took_local_shortcut){ 
-                    index_Q = index_R = 0;
+            // the alignment is only accepted if it keeps clear of the band edges (those inside the matrix)
+            bool touched = false;
+
+            const bool traced = BacktrackCodonMoves ( edit_ops, edit_ptr, index_R, index_Q, do_affine
+                                                    , [&] ( const long row, const long column ) -> unsigned char {
+                const long lo = 3 * row + band_lo,
+                           hi = 3 * row + band_hi;
+                if ( ( lo > 0 && column - lo < 6 ) || ( hi < q_len && hi - column < 6 ) ) {
+                    touched = true;
+                }
+                if ( column < lo || column > hi ) {
+                    return HY_111_111;
                 }
+                return codon_moves[ row * stride + column - lo + 3 ];
+            } );
 
-                // rebuild the strings from the edit_ops
-                // with room for the null terminator
-                r_res = new char[ edit_ptr + 1 ];
-                q_res = new char[ edit_ptr + 1 ];
-                --edit_ptr;
-                long k = 0;
-                for (; edit_ptr >= 0; --edit_ptr, ++k ) {
-                    switch ( edit_ops[ edit_ptr ] ) {
-                            // match! include characters from both strings
-                        case 0:
-                            r_res[ k ] = r_str[ index_R++ ];
-                            q_res[ k ] = q_str[ index_Q++ ];
-                            break;
-                            // insertion!
-                        case 1:
-                            if (report_ref_insertions) {
-                                r_res[ k ] = gap;
-                                q_res[ k ] = q_str[ index_Q++ ];
-                            } else {
-                                k --; index_Q++;
-                            }
-                            break;
-                        case 2:
-                            if (report_ref_insertions) {
-                                r_res[ k ] = gap;
-                                q_res[ k ] = tolower( q_str[ index_Q++ ] );
-                            } else {
-                                k --; index_Q++;
-                            }
-                            break;
-                        case -1:
-                            r_res[ k ] = r_str[ index_R++ ];
-                            q_res[ k ] = gap;
-                            break;
-                        case -2:
-                            r_res[ k ] = tolower( r_str[ index_R++ ] );
-                            q_res[ k ] = gap;
-                            break;
+            if ( ! touched ) {
+                aligned = true;
+                if ( ! traced ) {
+                    score = -INFINITY;
+                } else {
+                    // for anything that remains, reference then query
+                    while ( --index_R >= 0 )
+                        edit_ops[ edit_ptr++ ] = -1;
+                    while ( --index_Q >= 0 )
+                        edit_ops[ edit_ptr++ ] = 1;
+
+                    if ( edit_ptr > 0 ) {
+                        EditOpsToAlignment ( edit_ops, edit_ptr, r_str, q_str, r_res, q_res, gap, report_ref_insertions, 0, 0 );
                     }
                 }
-                // make sure to null-terminate
-                r_res[ k ] = '\0';
-                q_res[ k ] = '\0';
             }
 
-            //delete [] edit_ops;
-            if (score_matrix != score_matrix_cache) {
-                delete [] score_matrix;
+            delete [] edit_ops;
+            delete [] codon_moves;
+            delete [] score_matrix;
+            if ( do_affine ) {
+                delete [] insertion_matrix;
+                delete [] deletion_matrix;
             }
+        }
 
-            if ( do_affine ) {
-                if (insertion_matrix != insertion_matrix_cache) {
-                    delete [] insertion_matrix;
-                }
-                if (deletion_matrix != deletion_matrix_cache) {
-                    delete [] deletion_matrix;
+        delete [] boundary_score;
+        delete [] first_score;
+        if ( do_affine ) {
+            delete [] boundary_insertion;
+            delete [] boundary_deletion;
+            delete [] first_insertion;
+            delete [] first_deletion;
+        }
+        delete [] query_partials;
+        delete [] query_codons;
+        delete [] query_ambiguities;
+        delete [] ambiguity_scores;
+    }
+
+    delete [] q_enc;
+
+    if ( ! aligned ) {
+        score = align_full ();
+    }
+
+    if ( reference != codon_reference ) {
+        delete reference;
+    }
+
+    return score;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsWavefront
+ * Performs a pairwise (non-codon) alignment with the wavefront algorithm (see WavefrontAlign), whose running time
+ * grows with the divergence between the strings rather than with the product of their lengths.
+ *
+ * Scores are converted to equivalent penalties: with a = the largest score of any pair of characters
+ * found in the two strings (or 0, if larger), a pair (x,y) costs 2(a - s(x,y)), each gap character costs 2 * extend + a,
+ * and opening a gap costs 2 (open - extend); every prefix/suffix gap character in trim (do_local) mode costs a.
+ * The score of an alignment is then (a * (r_len + q_len) - penalty) / 2, so the optimal alignments are the same.
+ * When several alignments are optimal, the one reported may differ from that reported by AlignStrings.
+ *
+ * Falls back to AlignStrings for true local alignments, for scores which are not (scaled) integers, and
+ * when the alignment penalty is too high for the wavefront algorithm to be faster than the full DP.
+ *
+ * Arguments are as in AlignStrings
+ * @return the score of the alignment
+ */
+
+cawlign_fp AlignStringsWavefront ( char const * r_str
+                                 , char const * q_str
+                                 , const long r_len
+                                 , const long q_len
+                                 , char * & r_res
+                                 , char * & q_res
+                                 , long * char_map
+                                 , const cawlign_fp * cost_matrix
+                                 , const long cost_stride
+                                 , const char gap
+                                 , cawlign_fp open_insertion
+                                 , cawlign_fp extend_insertion
+                                 , cawlign_fp open_deletion
+                                 , cawlign_fp extend_deletion
+                                 , const bool do_local
+                                 , const bool do_affine
+                                 , const bool do_true_local
+                                 , const bool report_ref_insertions
+                                 )
+{
+    long s_min, s_max, od, ed, oi, ei;
+    const long scale = IntegerScoringScale ( cost_matrix, cost_stride, open_insertion, extend_insertion, open_deletion, extend_deletion
+                                           , 16, s_min, s_max, od, ed, oi, ei );
+    
+    if ( scale && ! do_true_local && r_len > 0 && q_len > 0 && ( ! do_affine || ( ed <= od && ei <= oi ) ) ) {
+        // code 0 is for characters which are not in the alphabet (their pairs are not scored)
+        const long stride = cost_stride + 1;
+        
+        bool * const present = new bool [ 2 * stride ] ();
+        for (long i = 0; i < r_len; ++i) {
+            present[ char_map[ (unsigned char) r_str[ i ] ] + 1 ] = true;
+        }
+        for (long j = 0; j < q_len; ++j) {
+            present[ stride + char_map[ (unsigned char) q_str[ j ] ] + 1 ] = true;
+        }
+        
+        auto pair_score = [&] ( const long r, const long q ) -> long {
+            return ( r && q ) ? lrint ( cost_matrix[ ( r - 1 ) * cost_stride + q - 1 ] * scale ) : 0;
+        };
+        
+        // a must not be negative, or prefix/suffix gaps would carry a negative penalty
+        long a = 0;
+        for (long r = 0; r < stride; ++r) {
+            for (long q = 0; q < stride; ++q) {
+                if ( present[ r ] && present[ stride + q ] ) {
+                    a = MAX_OP ( a, pair_score ( r, q ) );
                 }
             }
+        }
+        
+        long * const penalties = new long [ stride * stride ];
+        for (long r = 0; r < stride; ++r) {
+            for (long q = 0; q < stride; ++q) {
+                penalties[ r * stride + q ] = ( present[ r ] && present[ stride + q ] ) ? 2 * ( a - pair_score ( r, q ) ) : 0;
+            }
+        }
+        
+        const long extend_ins = 2 * ( do_affine ? ei : oi ) + a,
+                   extend_del = 2 * ( do_affine ? ed : od ) + a,
+                   open_ins   = do_affine ? 2 * ( oi - ei ) : 0,
+                   open_del   = do_affine ? 2 * ( od - ed ) : 0;
+        
+        long penalty = -1;
+        
+        if ( extend_ins > 0 && extend_del > 0 ) {
+            // give up once the wavefronts would have cost a sizable fraction of the full DP
+            const long max_cells = MIN_OP ( r_len * q_len / 64 + 1024, 1L << 24 );
+            
+            signed char * const edit_ops = new signed char [ r_len + q_len ];
+            long edit_ptr = 0;
+            
+            penalty = WavefrontAlign ( r_str, q_str, r_len, q_len, char_map, penalties, stride
+                                     , open_ins, extend_ins, open_del, extend_del, do_local ? a : -1, max_cells, edit_ops, edit_ptr );
+            
+            if ( penalty >= 0 ) {
+                EditOpsToAlignment ( edit_ops, edit_ptr, r_str, q_str, r_res, q_res, gap, report_ref_insertions, 0, 0 );
+            }
+            
+            delete [] edit_ops;
+        }
+        
+        delete [] penalties;
+        delete [] present;
+        
+        if ( penalty >= 0 ) {
+            return (cawlign_fp) ( a * ( r_len + q_len ) - penalty ) / (cawlign_fp) ( 2 * scale );
+        }
+    }
+    
+    return AlignStrings ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                        , open_insertion, extend_insertion, open_deletion, extend_deletion, 0., do_local, do_affine, false
+                        , cost_stride - 1, nullptr, nullptr, do_true_local, report_ref_insertions );
+}
 
-            /*
-            if (do_codon) {
-                delete [] r_enc;
-                delete [] q_enc;
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsBanded
+ * Performs a pairwise (non-codon) alignment restricted to a band of diagonals around those joining the corners of the
+ * DP matrix; the band starts 32 diagonals wide on either side and is doubled (Ukkonen style), or widened further if
+ * the score found so far shows that it must be, until the banded score is provably optimal. Any alignment which leaves the band has at least |r_len - q_len| + 2 (w + 1) gap characters,
+ * and, therefore, a score of at most s_max * (r_len + q_len - G) / 2 - g_min * G, where G is that number of gaps,
+ * s_max is the largest pair score, and g_min is the smallest cost of a gap character (0 for do_local, where all gaps
+ * could be prefix or suffix gaps; otherwise the excess cost of opening an insertion and a deletion is also subtracted). Once the banded score exceeds that bound, every optimal alignment is inside the band,
+ * and the result is identical to that of AlignStrings.
+ *
+ * Only the traceback codes of the band and two rows of scores are stored.
+ * Falls back to AlignStrings for true local alignments, when the gap costs do not allow a bound, and
+ * when the band would cover a large part of the DP matrix anyway.
+ *
+ * Arguments are as in AlignStrings
+ * @return the score of the alignment
+ */
+
+cawlign_fp AlignStringsBanded ( char const * r_str
+                              , char const * q_str
+                              , const long r_len
+                              , const long q_len
+                              , char * & r_res
+                              , char * & q_res
+                              , long * char_map
+                              , const cawlign_fp * cost_matrix
+                              , const long cost_stride
+                              , const char gap
+                              , cawlign_fp open_insertion
+                              , cawlign_fp extend_insertion
+                              , cawlign_fp open_deletion
+                              , cawlign_fp extend_deletion
+                              , const bool do_local
+                              , const bool do_affine
+                              , const bool do_true_local
+                              , const bool report_ref_insertions
+                              )
+{
+    // pairs of characters outside the alphabet score 0
+    double s_max = 0.;
+    for (long c = 0; c < cost_stride * cost_stride; ++c ) {
+        s_max = MAX_OP ( s_max, (double) cost_matrix[ c ] );
+    }
+    
+    double g_min = MIN_OP ( open_insertion, open_deletion );
+    if ( do_affine ) {
+        g_min = MIN_OP ( g_min, MIN_OP ( extend_insertion, extend_deletion ) );
+    }
+    
+    // how much the bound drops with each gap character forced by leaving the band; in global mode, leaving the band
+    // and coming back to it also takes at least one insertion and one deletion, each opened once
+    const double per_gap   = s_max / 2. + ( do_local ? 0. : g_min ),
+                 opens     = do_local ? 0. : ( open_insertion - g_min ) + ( open_deletion - g_min ),
+                 tolerance = 1e-5 * ( r_len + q_len ) * ( s_max + fabs ( g_min ) );
+    
+    const long diagonal = q_len - r_len;
+    
+    if ( ! do_true_local && r_len > 0 && q_len > 0 && per_gap > 0. ) {
+        cawlign_fp * const boundaries = new cawlign_fp [ 3 * ( q_len + 1 ) + 3 * ( r_len + 1 ) ],
+                   * const row_h = boundaries,
+                   * const row_i = row_h + ( q_len + 1 ),
+                   * const row_d = row_i + ( q_len + 1 ),
+                   * const col_h = row_d + ( q_len + 1 ),
+                   * const col_i = col_h + ( r_len + 1 ),
+                   * const col_d = col_i + ( r_len + 1 );
+        
+        InitAlignmentMatrices ( 1, q_len + 1, do_local, do_affine, false
+                              , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                              , row_h, row_i, row_d );
+        InitAlignmentMatrices ( r_len + 1, 1, do_local, do_affine, false
+                              , open_insertion, extend_insertion, open_deletion, extend_deletion, 0.
+                              , col_h, col_i, col_d );
+        
+        cawlign_fp * const last_row   = new cawlign_fp [ q_len + 1 ],
+                   * const last_col   = new cawlign_fp [ r_len + 1 ];
+        long       * const row_offset = new long [ r_len + 1 ];
+        
+        bool aligned = false;
+        
+        for (long width = 32; ; ) {
+            const long band_lo = MIN_OP ( 0, diagonal ) - width,
+                       band_hi = MAX_OP ( 0, diagonal ) + width;
+            
+            long cells = 0;
+            for (long i = 1; i <= r_len; ++i ) {
+                cells += MIN_OP ( q_len, i + band_hi ) - MAX_OP ( 1, i + band_lo ) + 1;
             }
-            */
+            
+            // the full DP (with its vectorized kernels) is cheaper at this point
+            if ( cells > r_len * q_len / 8 ) {
+                break;
+            }
+            
+            unsigned char * const traceback = new unsigned char [ TracebackCodeBytes ( cells ) ] ();
+            
+            cawlign_fp best;
+            long       index_R, index_Q;
+            
+            AlignStringsBandedFill ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride
+                                   , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, false
+                                   , band_lo, band_hi, row_h, row_d, col_h, col_i, row_offset, traceback, last_row, last_col
+                                   , best, index_R, index_Q );
+            
+            AlignmentEnd ( r_len, q_len, last_row, last_col, do_local, best, index_R, index_Q );
+            
+            const double forced_gaps = labs ( diagonal ) + 2 * ( width + 1 ),
+                         bound       = s_max * ( r_len + q_len ) / 2. - per_gap * forced_gaps - opens;
+            
+            if ( best > bound + tolerance ) {
+                BacktrackAlignmentCodes ( r_str, q_str, r_len, q_len, r_res, q_res, gap, do_local, do_affine, report_ref_insertions
+                                        , index_R, index_Q, best
+                                        , [&] ( const long i, const long j ) -> unsigned char {
+                                              return TracebackCode ( traceback, row_offset[ i ] + j - MAX_OP ( 1, i + band_lo ) );
+                                          } );
+                aligned = true;
+            }
+            
+            delete [] traceback;
+            
+            if ( aligned ) {
+                delete [] row_offset;
+                delete [] last_row;
+                delete [] last_col;
+                delete [] boundaries;
+                return best;
+            }
+            
+            // double the band, or widen it straight to where the score found so far would beat the bound
+            // (the banded score can only improve as the band gets wider)
+            const double needed = ( ( s_max * ( r_len + q_len ) / 2. - best + tolerance - opens ) / per_gap - labs ( diagonal ) ) / 2. - 1.;
+            width = MAX_OP ( 2 * width, (long) floor ( needed ) + 1 );
         }
+        
+        delete [] row_offset;
+        delete [] last_row;
+        delete [] last_col;
+        delete [] boundaries;
     }
+    
+    return AlignStrings ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, gap
+                        , open_insertion, extend_insertion, open_deletion, extend_deletion, 0., do_local, do_affine, false
+                        , cost_stride - 1, nullptr, nullptr, do_true_local, report_ref_insertions );
+}
 
+//____________________________________________________________________________________
+
+/**
+ * @name AlignStringsScore
+ * Computes the score that AlignStrings would return for two (non-codon) strings, without the alignment itself: the
+ * DP matrices are filled by the same kernels, but no traceback is stored or followed.
+ *
+ * Arguments are as in AlignStrings
+ * @return the alignment score
+ */
+
+cawlign_fp AlignStringsScore ( char const * r_str
+                             , char const * q_str
+                             , const long _r_len
+                             , const long _q_len
+                             , long * char_map
+                             , const cawlign_fp * cost_matrix
+                             , const long cost_stride
+                             , cawlign_fp open_insertion
+                             , cawlign_fp extend_insertion
+                             , cawlign_fp open_deletion
+                             , cawlign_fp extend_deletion
+                             , const bool do_local
+                             , const bool do_affine
+                             , const bool do_true_local
+                             )
+{
+    const long r_len = _r_len >= 0 ? _r_len : strlen( r_str ),
+               q_len = _q_len >= 0 ? _q_len : strlen( q_str );
+    
+    char * r_res = NULL,
+         * q_res = NULL;
+    
+    cawlign_fp score = 0.;
+    
+    // the all-gaps alignments of AlignStrings
+    if ( r_len == 0 || q_len == 0 ) {
+        const long       gap_len     = r_len + q_len;
+        const cawlign_fp open_cost   = r_len ? open_deletion : open_insertion,
+                         extend_cost = r_len ? extend_deletion : extend_insertion;
+        
+        if ( gap_len && ! do_local ) {
+            score = do_affine ? -open_cost - ( gap_len - 1 ) * extend_cost : -open_cost * gap_len;
+        }
+    } else if ( ! do_true_local
+                && AlignStringsDifference ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, '-'
+                                          , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                          , do_local, do_affine, true, true, score ) ) {
+        // scored by the anti-diagonal difference kernel
+    } else if ( AlignStringsInt16 ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, '-'
+                                  , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                  , do_local, do_affine, do_true_local, true, true, score ) ) {
+        // scored by the int16 striped kernel (scores did not saturate)
+    } else {
+        score = AlignStringsFloat ( r_str, q_str, r_len, q_len, r_res, q_res, char_map, cost_matrix, cost_stride, '-'
+                                  , open_insertion, extend_insertion, open_deletion, extend_deletion
+                                  , do_local, do_affine, do_true_local, true, true );
+    }
+    
     return score;
 }
 
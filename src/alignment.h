@@ -43,6 +43,72 @@
 
 typedef   float     cawlign_fp;
 
+// the default width (in query positions) of the tiles in which codon DP matrices are filled (see SetAlignmentTileSize)
+#define DEFAULT_TILE_COLUMNS 2048
+
+/**
+ * The part of a codon-aware alignment which only depends on the reference: the code of each reference codon
+ * and its rows of the codon scoring tables. The reference does not change during a run, so this is built once
+ * (after the reference is read) and shared, read-only, by all the threads.
+ */
+struct CodonReference {
+    CodonReference ( char const * r_str
+                   , const long r_len
+                   , long * char_map
+                   , const cawlign_fp * cost_matrix
+                   , const long cost_stride
+                   , const long char_count
+                   , const cawlign_fp * codon3x2
+                   , const cawlign_fp * codon3x1
+                   );
+    ~CodonReference (void);
+
+    CodonReference (const CodonReference&) = delete;
+    CodonReference& operator= (const CodonReference&) = delete;
+
+    long                  length,
+    // the length of the reference (nucleotides)
+                          codon_count,
+    // the number of reference codons
+                        * codons;
+    // the code of each reference codon (cost_stride - 1 if it is not fully resolved)
+
+    const cawlign_fp   ** cost_rows,
+                       ** rows3x2,
+                       ** rows3x1;
+    // for each reference codon, its rows of cost_matrix (which also scores the 3x5 and 3x4 moves) and of the 3x2 and 3x1 tables
+
+    cawlign_fp          * best_codon,
+                        * best3x2,
+                        * best3x1;
+    // for each reference codon, the best score in its row of cost_matrix (over resolved codons) and of the 3x2 and 3x1 tables
+};
+
+/**
+ * The nucleotide k-mers of the reference, used to tell which strand of a query matches the reference without
+ * aligning it (see QueryStrand). Like CodonReference, this is built once, after the reference is read, and
+ * shared, read-only, by all the threads.
+ */
+struct StrandIndex {
+    StrandIndex ( char const * r_str
+                , const long r_len
+                );
+    ~StrandIndex (void);
+
+    StrandIndex (const StrandIndex&) = delete;
+    StrandIndex& operator= (const StrandIndex&) = delete;
+
+    long                  kmer_count,
+    // the number of distinct k-mers in the reference
+                        * kmers;
+    // the distinct k-mers of the reference (two bits per nucleotide), sorted
+};
+
+long QueryStrand ( StrandIndex const * const index
+                 , char const * q_str
+                 , const long q_len
+                 );
+
 cawlign_fp AlignStrings( char const * r_str
                    , char const * q_str
                    , const long _r_len
@@ -62,8 +128,6 @@ cawlign_fp AlignStrings( char const * r_str
                    , const bool do_affine
                    , const bool do_codon
                    , const long char_count
-                   , const cawlign_fp * codon3x5
-                   , const cawlign_fp * codon3x4
                    , const cawlign_fp * codon3x2
                    , const cawlign_fp * codon3x1
                    , const bool do_true_local = false
@@ -72,9 +136,124 @@ cawlign_fp AlignStrings( char const * r_str
                    , cawlign_fp* insertion_matrix_cache = nullptr
                    , cawlign_fp* deletion_matrix_cache = nullptr
                    , const long* resolution_map = nullptr
-
+                   , const CodonReference* codon_reference = nullptr
                    );
 
+cawlign_fp AlignStringsScore ( char const * r_str
+                             , char const * q_str
+                             , const long _r_len
+                             , const long _q_len
+                             , long * char_map
+                             , const cawlign_fp * cost_matrix
+                             , const long cost_stride
+                             , cawlign_fp open_insertion
+                             , cawlign_fp extend_insertion
+                             , cawlign_fp open_deletion
+                             , cawlign_fp extend_deletion
+                             , const bool do_local
+                             , const bool do_affine
+                             , const bool do_true_local = false
+                             );
+
+void SetAlignmentTileSize ( const long columns );
+
+long AlignmentTileSize (void);
+
+void AlignmentThreadIdle (void);
+
+cawlign_fp AlignStringsWavefront( char const * r_str
+                                , char const * q_str
+                                , const long r_len
+                                , const long q_len
+                                , char * & r_res
+                                , char * & q_res
+                                , long * char_map
+                                , const cawlign_fp * cost_matrix
+                                , const long cost_stride
+                                , const char gap
+                                , cawlign_fp open_insertion
+                                , cawlign_fp extend_insertion
+                                , cawlign_fp open_deletion
+                                , cawlign_fp extend_deletion
+                                , const bool do_local
+                                , const bool do_affine
+                                , const bool do_true_local = false
+                                , const bool report_ref_insertions = true
+                                );
+
+cawlign_fp AlignStringsBanded( char const * r_str
+                             , char const * q_str
+                             , const long r_len
+                             , const long q_len
+                             , char * & r_res
+                             , char * & q_res
+                             , long * char_map
+                             , const cawlign_fp * cost_matrix
+                             , const long cost_stride
+                             , const char gap
+                             , cawlign_fp open_insertion
+                             , cawlign_fp extend_insertion
+                             , cawlign_fp open_deletion
+                             , cawlign_fp extend_deletion
+                             , const bool do_local
+                             , const bool do_affine
+                             , const bool do_true_local = false
+                             , const bool report_ref_insertions = true
+                             );
+
+cawlign_fp AlignStringsCodonLinear( char const * r_str
+                                  , char const * q_str
+                                  , const long _r_len
+                                  , const long _q_len
+                                  , char * & r_res
+                                  , char * & q_res
+                                  , long * char_map
+                                  , const cawlign_fp * cost_matrix
+                                  , const long cost_stride
+                                  , const char gap
+                                  , cawlign_fp open_insertion
+                                  , cawlign_fp extend_insertion
+                                  , cawlign_fp open_deletion
+                                  , cawlign_fp extend_deletion
+                                  , cawlign_fp miscall_cost
+                                  , const bool do_local
+                                  , const bool do_affine
+                                  , const long char_count
+                                  , const cawlign_fp * codon3x2
+                                  , const cawlign_fp * codon3x1
+                                  , const bool do_true_local = false
+                                  , const bool report_ref_insertions = true
+                                  , const long* resolution_map = nullptr
+                                  , const CodonReference* codon_reference = nullptr
+                                  );
+
+cawlign_fp AlignStringsCodonBanded( char const * r_str
+                                  , char const * q_str
+                                  , const long _r_len
+                                  , const long _q_len
+                                  , char * & r_res
+                                  , char * & q_res
+                                  , long * char_map
+                                  , const cawlign_fp * cost_matrix
+                                  , const long cost_stride
+                                  , const char gap
+                                  , cawlign_fp open_insertion
+                                  , cawlign_fp extend_insertion
+                                  , cawlign_fp open_deletion
+                                  , cawlign_fp extend_deletion
+                                  , cawlign_fp miscall_cost
+                                  , const bool do_local
+                                  , const bool do_affine
+                                  , const long char_count
+                                  , const cawlign_fp * codon3x2
+                                  , const cawlign_fp * codon3x1
+                                  , long const * translation_table
+                                  , const bool do_true_local = false
+                                  , const bool report_ref_insertions = true
+                                  , const long* resolution_map = nullptr
+                                  , const CodonReference* codon_reference = nullptr
+                                  );
+
 cawlign_fp LinearSpaceAlign(    const char * s1           // first string
                            , const char * s2           // second string
                            , const long s1L
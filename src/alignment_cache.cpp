@@ -0,0 +1,483 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "alignment_cache.h"
+#include "tn93_shared.h"
+
+// the first line of every cache entry; changing the layout of the entries (or how alignments are computed)
+// should change this, so that old entries are ignored
+#define CACHE_FORMAT "cawlign-cache 1"
+
+// how far ahead in the source string EncodeScript looks for the next aligned character
+#define CACHE_SKIP_SEARCH 4096
+
+//____________________________________________________________________________________
+
+uint64_t HashBytes ( uint64_t hash, const void * data, const size_t bytes ) {
+    unsigned char const * p = (unsigned char const *) data;
+    for (size_t k = 0; k < bytes; ++k ) {
+        hash = ( hash ^ p[ k ] ) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t HashSetting ( uint64_t hash, const void * data, const size_t bytes ) {
+    hash = HashBytes ( hash, &bytes, sizeof bytes );
+    return HashBytes ( hash, data, bytes );
+}
+
+uint64_t MixHash ( uint64_t hash ) {
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94d049bb133111ebULL;
+    return hash ^ ( hash >> 31 );
+}
+
+static std::string HexHash ( const uint64_t hash ) {
+    char buffer [ 17 ];
+    snprintf ( buffer, sizeof buffer, "%016llx", (unsigned long long) hash );
+    return buffer;
+}
+
+//____________________________________________________________________________________
+
+/**
+ * @name EncodeScript
+ * Encodes an aligned string as the operations which rebuild it from its source string: runs of copied source
+ * characters ("<n>M"), skipped source characters ("<n>S") and gaps ("<n>G"), and literal characters ("L<c>").
+ *
+ * @param aligned the aligned string (null is encoded as "-")
+ * @param source the source string
+ * @param s_len the length of the source string
+ * @param gap the gap character
+ * @param script receives the operations
+ * @return false if the aligned string has a character which can not be encoded
+ */
+
+static bool EncodeScript ( const char * aligned
+                         , const char * source
+                         , const long s_len
+                         , const char gap
+                         , std::string & script
+                         )
+{
+    script.clear ();
+
+    if ( ! aligned ) {
+        script = "-";
+        return true;
+    }
+
+    char op  = 0;
+    long run = 0,
+         p   = 0;
+
+    auto add_op = [&] ( const char next, const long count ) -> void {
+        if ( next != op ) {
+            if ( run ) {
+                script += std::to_string ( run );
+                script += op;
+            }
+            op  = next;
+            run = 0;
+        }
+        run += count;
+    };
+
+    for (const char * c = aligned; *c; ++c ) {
+        if ( *c == gap ) {
+            add_op ( 'G', 1 );
+            continue;
+        }
+
+        long k = p;
+        while ( k < s_len && k - p < CACHE_SKIP_SEARCH && source[ k ] != *c ) {
+            k++;
+        }
+
+        if ( k < s_len && source[ k ] == *c ) {
+            if ( k > p ) {
+                add_op ( 'S', k - p );
+            }
+            add_op ( 'M', 1 );
+            p = k + 1;
+        } else {
+            if ( *c == '\n' || *c == '\r' ) {
+                return false;
+            }
+            add_op ( 0, 0 );
+            script += 'L';
+            script += *c;
+        }
+    }
+
+    add_op ( 0, 0 );
+
+    if ( script.empty () ) {
+        // the empty string (rather than null)
+        script = "0M";
+    }
+    return true;
+}
+
+/**
+ * @name DecodeScript
+ * Rebuilds an aligned string from the operations encoded by EncodeScript
+ *
+ * @param result receives the aligned string (allocated with new [], or null if "-" was encoded)
+ * @return false if the operations are malformed, or run past the end of the source string
+ */
+
+static bool DecodeScript ( const std::string & script
+                         , const char * source
+                         , const long s_len
+                         , const char gap
+                         , char * & result
+                         )
+{
+    result = nullptr;
+
+    if ( script == "-" ) {
+        return true;
+    }
+
+    std::string aligned;
+    long        p = 0;
+
+    for (size_t i = 0; i < script.size (); ) {
+        if ( script[ i ] == 'L' ) {
+            if ( i + 1 >= script.size () ) {
+                return false;
+            }
+            aligned += script[ i + 1 ];
+            i += 2;
+            continue;
+        }
+
+        long count = 0;
+        while ( i < script.size () && script[ i ] >= '0' && script[ i ] <= '9' ) {
+            count = count * 10 + ( script[ i++ ] - '0' );
+        }
+        if ( i >= script.size () ) {
+            return false;
+        }
+
+        switch ( script[ i++ ] ) {
+            case 'M':
+                if ( p + count > s_len ) {
+                    return false;
+                }
+                aligned.append ( source + p, count );
+                p += count;
+                break;
+            case 'S':
+                if ( p + count > s_len ) {
+                    return false;
+                }
+                p += count;
+                break;
+            case 'G':
+                aligned.append ( count, gap );
+                break;
+            default:
+                return false;
+        }
+    }
+
+    result = new char [ aligned.size () + 1 ];
+    memcpy ( result, aligned.c_str (), aligned.size () + 1 );
+    return true;
+}
+
+/**
+ * @name ReadEntry
+ * Reads a file into a string
+ *
+ * @return false if the file can not be read
+ */
+
+static bool ReadEntry ( const std::string & path, std::string & content ) {
+    FILE * entry = fopen ( path.c_str (), "rb" );
+    if ( ! entry ) {
+        return false;
+    }
+
+    content.clear ();
+    char   buffer [ 4096 ];
+    size_t read;
+    while ( ( read = fread ( buffer, 1, sizeof buffer, entry ) ) > 0 ) {
+        content.append ( buffer, read );
+    }
+
+    const bool failed = ferror ( entry );
+    fclose ( entry );
+    return ! failed;
+}
+
+//____________________________________________________________________________________
+
+AlignmentCache::AlignmentCache ( const char * directory
+                               , const unsigned long max_bytes
+                               , const bool verify
+                               , const char * reference
+                               , const char gap
+                               , const uint64_t settings
+                               ) :
+    directory (directory),
+    reference (reference),
+    max_bytes (max_bytes),
+    verify (verify),
+    gap (gap),
+    hits (0),
+    stored (0),
+    checked (0),
+    mismatched (0)
+{
+    this->settings = HashSetting ( HashBytes ( HASH_BASIS, CACHE_FORMAT, strlen ( CACHE_FORMAT ) ), &settings, sizeof settings );
+}
+
+/**
+ * @return the path of the entry of a query (in a subdirectory named by the first two hexadecimal digits of the key,
+ *         so that no directory gets too large); check receives a second hash of the query and the settings,
+ *         which is stored in the entry, and tells it from one whose key merely collides
+ */
+
+std::string AlignmentCache::EntryPath ( const char * query, uint64_t & check ) const {
+    const size_t   q_len = strlen ( query );
+    const uint64_t key   = MixHash ( HashBytes ( settings, query, q_len ) );
+
+    check = MixHash ( HashBytes ( MixHash ( settings ), query, q_len ) );
+
+    const std::string hex = HexHash ( key );
+    return directory + "/" + hex.substr ( 0, 2 ) + "/" + hex + ".aln";
+}
+
+bool AlignmentCache::Lookup ( StringBuffer & query
+                            , const long q_len
+                            , char * & r_res
+                            , char * & q_res
+                            , bool & reversed
+                            )
+{
+    if ( verify ) {
+        return false;
+    }
+
+    uint64_t          check;
+    const std::string path = EntryPath ( query.getString (), check );
+    std::string       content;
+
+    if ( ! ReadEntry ( path, content ) ) {
+        return false;
+    }
+
+    // the header, the strand, the two scripts, and the checksum of the strand and the scripts
+    std::vector <std::string> lines;
+    for (size_t from = 0; from < content.size (); ) {
+        size_t to = content.find ( '\n', from );
+        if ( to == std::string::npos ) {
+            to = content.size ();
+        }
+        lines.push_back ( content.substr ( from, to - from ) );
+        from = to + 1;
+    }
+
+    if ( lines.size () != 5 || lines[ 0 ] != CACHE_FORMAT " " + HexHash ( check ) || ( lines[ 1 ] != "0" && lines[ 1 ] != "1" ) ) {
+        return false;
+    }
+
+    const std::string body = lines[ 1 ] + "\n" + lines[ 2 ] + "\n" + lines[ 3 ] + "\n";
+    if ( lines[ 4 ] != HexHash ( MixHash ( HashBytes ( 0, body.c_str (), body.size () ) ) ) ) {
+        return false;
+    }
+
+    reversed = lines[ 1 ] == "1";
+    if ( reversed ) {
+        reverseComplement ( query, 0, q_len - 1 );
+    }
+
+    if ( ! DecodeScript ( lines[ 2 ], reference.c_str (), reference.size (), gap, r_res ) ) {
+        if ( reversed ) {
+            reverseComplement ( query, 0, q_len - 1 );
+        }
+        return false;
+    }
+    if ( ! DecodeScript ( lines[ 3 ], query.getString (), q_len, gap, q_res ) ) {
+        delete [] r_res;
+        r_res = nullptr;
+        if ( reversed ) {
+            reverseComplement ( query, 0, q_len - 1 );
+        }
+        return false;
+    }
+
+    // the entry was used just now (see Evict)
+    utime ( path.c_str (), NULL );
+    hits++;
+    return true;
+}
+
+void AlignmentCache::Store ( const char * query
+                           , const char * aligned_query
+                           , const char * r_res
+                           , const char * q_res
+                           )
+{
+    static std::atomic <long> temporary_files (0);
+
+    std::string ref_script,
+                qry_script;
+
+    if ( ! EncodeScript ( r_res, reference.c_str (), reference.size (), gap, ref_script )
+      || ! EncodeScript ( q_res, aligned_query, strlen ( aligned_query ), gap, qry_script ) ) {
+        return;
+    }
+
+    uint64_t          check;
+    const std::string path = EntryPath ( query, check ),
+                      body = std::string ( strcmp ( query, aligned_query ) ? "1" : "0" ) + "\n" + ref_script + "\n" + qry_script + "\n",
+                      content = CACHE_FORMAT " " + HexHash ( check ) + "\n" + body
+                              + HexHash ( MixHash ( HashBytes ( 0, body.c_str (), body.size () ) ) ) + "\n";
+
+    if ( verify ) {
+        std::string existing;
+        if ( ReadEntry ( path, existing ) ) {
+            checked++;
+            if ( existing == content ) {
+                return;
+            }
+            mismatched++;
+        }
+    }
+
+    const std::string subdirectory = path.substr ( 0, path.rfind ( '/' ) ),
+                      temporary    = path + ".tmp." + std::to_string ( (long) getpid () ) + "." + std::to_string ( temporary_files++ );
+
+    mkdir ( subdirectory.c_str (), 0777 );
+
+    FILE * entry = fopen ( temporary.c_str (), "wb" );
+    if ( ! entry ) {
+        return;
+    }
+
+    const bool written = fwrite ( content.c_str (), 1, content.size (), entry ) == content.size ();
+    if ( fclose ( entry ) != 0 || ! written || rename ( temporary.c_str (), path.c_str () ) != 0 ) {
+        unlink ( temporary.c_str () );
+        return;
+    }
+
+    stored++;
+}
+
+void AlignmentCache::Evict ( void ) {
+    struct CacheEntry {
+        time_t        used;
+        unsigned long bytes;
+        std::string   path;
+    };
+
+    std::vector <CacheEntry> entries;
+    unsigned long            total = 0;
+
+    DIR * top = opendir ( directory.c_str () );
+    if ( ! top ) {
+        return;
+    }
+
+    while ( struct dirent * sub = readdir ( top ) ) {
+        if ( sub->d_name[ 0 ] == '.' ) {
+            continue;
+        }
+        const std::string subdirectory = directory + "/" + sub->d_name;
+        DIR * files = opendir ( subdirectory.c_str () );
+        if ( ! files ) {
+            continue;
+        }
+        while ( struct dirent * file = readdir ( files ) ) {
+            const size_t name_length = strlen ( file->d_name );
+            struct stat  info;
+            if ( name_length < 4 || strcmp ( file->d_name + name_length - 4, ".aln" ) ) {
+                continue;
+            }
+            const std::string path = subdirectory + "/" + file->d_name;
+            if ( stat ( path.c_str (), &info ) == 0 ) {
+                entries.push_back ( { info.st_mtime, (unsigned long) info.st_size, path } );
+                total += info.st_size;
+            }
+        }
+        closedir ( files );
+    }
+    closedir ( top );
+
+    if ( total <= max_bytes ) {
+        return;
+    }
+
+    std::sort ( entries.begin (), entries.end (), [] ( const CacheEntry & a, const CacheEntry & b ) -> bool {
+        return a.used < b.used;
+    });
+
+    for (const CacheEntry & entry : entries ) {
+        if ( total <= max_bytes ) {
+            break;
+        }
+        if ( unlink ( entry.path.c_str () ) == 0 ) {
+            total -= entry.bytes;
+        }
+    }
+}
+
+void AlignmentCache::ReportStatistics ( FILE * stream ) const {
+    fprintf ( stream, "alignment cache: %ld hits, %ld entries stored", hits.load (), stored.load () );
+    if ( verify ) {
+        fprintf ( stream, ", %ld entries checked, %ld did not match (replaced)", checked.load (), mismatched.load () );
+    }
+    fprintf ( stream, "\n" );
+}
@@ -0,0 +1,165 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef __ALIGNMENT_CACHE_HEADER_FILE__
+
+#define __ALIGNMENT_CACHE_HEADER_FILE__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "stringBuffer.h"
+
+// the initial value of the hashes computed by HashBytes
+#define HASH_BASIS 14695981039346656037ULL
+
+/**
+ * @name HashBytes
+ * Adds bytes to an FNV-1a hash
+ */
+
+uint64_t HashBytes ( uint64_t hash, const void * data, const size_t bytes );
+
+/**
+ * @name HashSetting
+ * Adds a setting to a hash of settings (the length is hashed too, so that consecutive settings can not run into each other)
+ */
+
+uint64_t HashSetting ( uint64_t hash, const void * data, const size_t bytes );
+
+/**
+ * @name MixHash
+ * Scrambles the bits of a hash (the SplitMix64 finalizer)
+ */
+
+uint64_t MixHash ( uint64_t hash );
+
+/**
+ * An on-disk cache of query alignments, shared by runs that align to the same reference with the same settings.
+ *
+ * Each entry is a file in the cache directory, named by a hash of the query (as read) and of the settings (the
+ * reference, the scoring and the alignment options). It stores the strand of the query and
+ * compact edit scripts which rebuild the aligned reference and query from the reference and the (oriented) query.
+ * Entries are written to a temporary file and renamed, so that concurrent runs and threads never read partial ones.
+ *
+ * Cache hits refresh the modification time of their entries; Evict removes the least recently used entries
+ * when the cache grows past its size limit.
+ */
+class AlignmentCache {
+    public:
+        /**
+         * @param directory the cache directory (created if needed)
+         * @param max_bytes the size limit of the cache (see Evict)
+         * @param verify if true, Lookup always misses, and Store checks the existing entries against the new
+         *               alignments (and replaces the ones which differ)
+         * @param reference the reference sequence
+         * @param gap the gap character of the alignments
+         * @param settings a hash (see HashSetting) of everything other than the query that the alignments depend on
+         */
+        AlignmentCache  ( const char * directory
+                        , const unsigned long max_bytes
+                        , const bool verify
+                        , const char * reference
+                        , const char gap
+                        , const uint64_t settings
+                        );
+
+        AlignmentCache (const AlignmentCache&) = delete;
+        AlignmentCache& operator= (const AlignmentCache&) = delete;
+
+        /**
+         * Looks up the alignment of a query.
+         *
+         * @param query the query (as read); on a hit, it is reverse complemented if its alignment is
+         * @param q_len the length of the query
+         * @param r_res, q_res receive the aligned reference and query (either may be null, as stored)
+         * @param reversed receives whether the alignment is that of the reverse complement of the query
+         * @return true on a hit
+         */
+        bool Lookup ( StringBuffer & query
+                    , const long q_len
+                    , char * & r_res
+                    , char * & q_res
+                    , bool & reversed
+                    );
+
+        /**
+         * Stores the alignment of a query.
+         *
+         * @param query the query (as read)
+         * @param aligned_query the query as aligned (the same as query, or its reverse complement)
+         * @param r_res, q_res the aligned reference and query
+         */
+        void Store ( const char * query
+                   , const char * aligned_query
+                   , const char * r_res
+                   , const char * q_res
+                   );
+
+        /**
+         * Removes the least recently used entries until the cache is within its size limit.
+         */
+        void Evict ( void );
+
+        /**
+         * Reports the number of hits, stored entries and (when verifying) mismatched entries to a stream.
+         */
+        void ReportStatistics ( FILE * stream ) const;
+
+    private:
+        std::string EntryPath ( const char * query, uint64_t & check ) const;
+
+        std::string           directory,
+                              reference;
+        unsigned long         max_bytes;
+        bool                  verify;
+        char                  gap;
+        uint64_t              settings;
+        // the hash of the settings (and of the cache format)
+
+        std::atomic <long>    hits,
+                              stored,
+                              checked,
+                              mismatched;
+};
+
+#endif
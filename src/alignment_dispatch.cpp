@@ -0,0 +1,298 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <string.h>
+
+#include <string>
+
+#include "alignment_simd.h"
+
+//____________________________________________________________________________________
+
+/**
+    The kernels of every build of alignment_simd.cpp (see AlignmentKernel); the baseline build uses the compiler
+    flags of the rest of the program, and the x86-64 builds (CAWLIGN_KERNEL_DISPATCH) add SSE4.1, AVX2 and AVX-512BW
+    versions, which are only selected on CPUs (and operating systems) that support them.
+*/
+
+namespace alignment_kernel_baseline { extern const AlignmentKernel kernel; }
+
+#ifdef CAWLIGN_KERNEL_DISPATCH
+namespace alignment_kernel_sse41    { extern const AlignmentKernel kernel; }
+namespace alignment_kernel_avx2     { extern const AlignmentKernel kernel; }
+namespace alignment_kernel_avx512bw { extern const AlignmentKernel kernel; }
+#endif
+
+#ifdef CAWLIGN_KERNEL_DISPATCH
+/**
+    the codon step is mostly scalar, and its AVX-512 build ran ~10% slower than the AVX2 one (HIV prrt codon
+    benchmark), so the avx512bw kernels fill codon rows with the latter
+*/
+
+static AlignmentKernel AVX512BWKernel (void) {
+    AlignmentKernel kernel = alignment_kernel_avx512bw::kernel;
+    kernel.codon_fill_row  = alignment_kernel_avx2::kernel.codon_fill_row;
+    return kernel;
+}
+
+static const AlignmentKernel avx512bw_kernel = AVX512BWKernel ();
+#endif
+
+struct AvailableKernel {
+    const AlignmentKernel * kernel;
+    bool                    supported;
+};
+
+/** the kernels, widest instruction set first */
+
+static long AvailableKernels ( AvailableKernel * kernels ) {
+    long count = 0;
+#ifdef CAWLIGN_KERNEL_DISPATCH
+    __builtin_cpu_init ();
+    kernels[ count++ ] = { &avx512bw_kernel,                   __builtin_cpu_supports ( "avx512f" ) && __builtin_cpu_supports ( "avx512bw" ) };
+    kernels[ count++ ] = { &alignment_kernel_avx2::kernel,     (bool) __builtin_cpu_supports ( "avx2" ) };
+    kernels[ count++ ] = { &alignment_kernel_sse41::kernel,    (bool) __builtin_cpu_supports ( "sse4.1" ) };
+#endif
+    kernels[ count++ ] = { &alignment_kernel_baseline::kernel, true };
+    return count;
+}
+
+static const AlignmentKernel * BestKernel (void) {
+    AvailableKernel kernels[ 4 ];
+    const long count = AvailableKernels ( kernels );
+    for (long k = 0; k < count; ++k ) {
+        if ( kernels[ k ].supported ) {
+            return kernels[ k ].kernel;
+        }
+    }
+    return &alignment_kernel_baseline::kernel;
+}
+
+static const AlignmentKernel * selected_kernel = BestKernel ();
+
+//____________________________________________________________________________________
+
+bool SelectAlignmentKernel ( const char * name ) {
+    if ( ! strcmp ( name, "auto" ) ) {
+        selected_kernel = BestKernel ();
+        return true;
+    }
+    AvailableKernel kernels[ 4 ];
+    const long count = AvailableKernels ( kernels );
+    for (long k = 0; k < count; ++k ) {
+        if ( kernels[ k ].supported && ! strcmp ( kernels[ k ].kernel->name, name ) ) {
+            selected_kernel = kernels[ k ].kernel;
+            return true;
+        }
+    }
+    return false;
+}
+
+//____________________________________________________________________________________
+
+const char * AlignmentKernelNames (void) {
+    static std::string names;
+    if ( names.empty () ) {
+        AvailableKernel kernels[ 4 ];
+        const long count = AvailableKernels ( kernels );
+        for (long k = 0; k < count; ++k ) {
+            if ( kernels[ k ].supported ) {
+                if ( ! names.empty () ) {
+                    names += ", ";
+                }
+                names += kernels[ k ].kernel->name;
+            }
+        }
+    }
+    return names.c_str ();
+}
+
+//____________________________________________________________________________________
+
+const char * AlignStringsSIMDName (void) {
+    return selected_kernel->name;
+}
+
+//____________________________________________________________________________________
+
+long AlignStringsSIMDWidth (void) {
+    return selected_kernel->width;
+}
+
+//____________________________________________________________________________________
+
+long AlignStringsDiffSIMDWidth (void) {
+    return selected_kernel->diff_width;
+}
+
+//____________________________________________________________________________________
+
+long AlignStringsInt16SIMDWidth (void) {
+    return selected_kernel->int16_width;
+}
+
+//____________________________________________________________________________________
+
+bool AlignStringsFillSIMD ( char const * r_str
+                          , char const * q_str
+                          , const long r_len
+                          , const long q_len
+                          , long * char_map
+                          , const cawlign_fp * cost_matrix
+                          , const long cost_stride
+                          , const cawlign_fp open_insertion
+                          , const cawlign_fp extend_insertion
+                          , const cawlign_fp open_deletion
+                          , const cawlign_fp extend_deletion
+                          , const bool do_affine
+                          , const bool do_true_local
+                          , const cawlign_fp * row_h
+                          , const cawlign_fp * row_d
+                          , const cawlign_fp * col_h
+                          , const cawlign_fp * col_i
+                          , unsigned char * traceback
+                          , cawlign_fp * last_row
+                          , cawlign_fp * last_col
+                          , cawlign_fp & best_score
+                          , long & best_R
+                          , long & best_Q
+                          , const FillBlock * block
+                          )
+{
+    return selected_kernel->fill ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride
+                                 , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                                 , row_h, row_d, col_h, col_i, traceback, last_row, last_col, best_score, best_R, best_Q, block );
+}
+
+//____________________________________________________________________________________
+
+bool AlignStringsFillDiffSIMD ( char const * r_str
+                              , char const * q_str
+                              , const long r_len
+                              , const long q_len
+                              , long * char_map
+                              , const cawlign_fp * cost_matrix
+                              , const long cost_stride
+                              , const long scale
+                              , const cawlign_fp open_insertion
+                              , const cawlign_fp extend_insertion
+                              , const cawlign_fp open_deletion
+                              , const cawlign_fp extend_deletion
+                              , const bool do_affine
+                              , const cawlign_fp * row_h
+                              , const cawlign_fp * row_d
+                              , const cawlign_fp * col_h
+                              , const cawlign_fp * col_i
+                              , unsigned char * traceback
+                              , long * diag_offset
+                              , long * last_row
+                              , long * last_col
+                              , const FillBlock * block
+                              )
+{
+    return selected_kernel->fill_diff ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride, scale
+                                      , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine
+                                      , row_h, row_d, col_h, col_i, traceback, diag_offset, last_row, last_col, block );
+}
+
+//____________________________________________________________________________________
+
+bool AlignStringsFillInt16SIMD ( char const * r_str
+                               , char const * q_str
+                               , const long r_len
+                               , const long q_len
+                               , long * char_map
+                               , const cawlign_fp * cost_matrix
+                               , const long cost_stride
+                               , const long scale
+                               , const cawlign_fp open_insertion
+                               , const cawlign_fp extend_insertion
+                               , const cawlign_fp open_deletion
+                               , const cawlign_fp extend_deletion
+                               , const bool do_affine
+                               , const bool do_true_local
+                               , const cawlign_fp * row_h
+                               , const cawlign_fp * row_d
+                               , const cawlign_fp * col_h
+                               , const cawlign_fp * col_i
+                               , unsigned char * traceback
+                               , long * last_row
+                               , long * last_col
+                               , long & best_score
+                               , long & best_R
+                               , long & best_Q
+                               , const FillBlock * block
+                               )
+{
+    return selected_kernel->fill_int16 ( r_str, q_str, r_len, q_len, char_map, cost_matrix, cost_stride, scale
+                                       , open_insertion, extend_insertion, open_deletion, extend_deletion, do_affine, do_true_local
+                                       , row_h, row_d, col_h, col_i, traceback, last_row, last_col, best_score, best_R, best_Q, block );
+}
+
+//____________________________________________________________________________________
+
+void CodonFillRow ( CodonReference const * const reference
+                  , int32_t const * const query_partials
+                  , int32_t const * const query_codons
+                  , cawlign_fp const * const * const query_ambiguities
+                  , const long r
+                  , const long q_from
+                  , const long q_to
+                  , const long score_cols
+                  , const long curr
+                  , const long row_stride
+                  , const cawlign_fp miscall_cost
+                  , const cawlign_fp open_insertion
+                  , const cawlign_fp extend_insertion
+                  , const cawlign_fp open_deletion
+                  , const cawlign_fp extend_deletion
+                  , const long cost_stride
+                  , const bool do_affine
+                  , const bool do_true_local
+                  , cawlign_fp * const score_matrix
+                  , cawlign_fp * const insertion_matrix
+                  , cawlign_fp * const deletion_matrix
+                  , unsigned char * const moves
+                  )
+{
+    selected_kernel->codon_fill_row ( reference, query_partials, query_codons, query_ambiguities, r, q_from, q_to, score_cols, curr, row_stride
+                                    , miscall_cost, open_insertion, extend_insertion, open_deletion, extend_deletion
+                                    , cost_stride, do_affine, do_true_local
+                                    , score_matrix, insertion_matrix, deletion_matrix, moves );
+}
@@ -0,0 +1,2084 @@
+/*
+ 
+ HyPhy - Hypothesis Testing Using Phylogenies.
+ 
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+ 
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+ 
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "alignment_simd.h"
+
+#define MAX_OP(a, b) ( (( a ) > ( b )) ? ( a ) : ( b ) )
+
+/**
+    This file is compiled once for every instruction set that the kernels are dispatched over (CAWLIGN_KERNEL names
+    the build, see CMakeLists.txt), and the kernels of each build go into their own namespace; the functions
+    declared in alignment_simd.h forward to one of the resulting AlignmentKernel tables (see alignment_dispatch.cpp)
+*/
+
+#ifndef CAWLIGN_KERNEL
+#define CAWLIGN_KERNEL baseline
+#endif
+
+#define CAWLIGN_KERNEL_NAMESPACE_(isa) alignment_kernel_ ## isa
+#define CAWLIGN_KERNEL_NAMESPACE(isa)  CAWLIGN_KERNEL_NAMESPACE_(isa)
+
+namespace CAWLIGN_KERNEL_NAMESPACE (CAWLIGN_KERNEL) {
+
+//____________________________________________________________________________________
+
+/**
+    Thin wrappers around the vector instructions used by the SIMD kernels.
+ 
+    v_max(a,b) MUST have the semantics of MAX_OP(a,b) in alignment.cpp, i.e. ( a > b ) ? a : b,
+    including the choice of the second operand on ties (+0/-0) and on NaN;
+    this is exactly what MAXPS does on x86, while the NEON version is built from a compare and a select.
+ 
+    v_shift_in(v,x) moves every lane up by one position (discarding the last lane) and places x into lane 0.
+    v_same(a,b) tests bitwise equality of all lanes.
+    v_gt(a,b) returns all-ones lanes where a > b, and v_andnot(a,b) computes (~a) & b (bitwise, on the float lanes).
+ 
+    The i8_ functions operate on vectors of signed bytes (used by the difference kernel); i8_adds/i8_subs saturate,
+    comparisons return all-ones lanes for TRUE, and i8_andnot(a,b) computes (~a) & b.
+    The i16_ functions are the signed 16-bit counterparts used by the integer striped kernel.
+*/
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+#define CAWLIGN_SIMD_WIDTH 16
+#define CAWLIGN_SIMD_NAME  "avx512bw"
+
+// AVX-512 comparisons return lane masks; they are expanded back into all-ones lanes, as the kernels expect
+
+typedef __m512 simd_fp;
+
+static inline simd_fp v_set1  (const cawlign_fp x)              { return _mm512_set1_ps (x); }
+static inline simd_fp v_load  (const cawlign_fp * p)            { return _mm512_load_ps (p); }
+static inline void    v_store (cawlign_fp * p, const simd_fp v) { _mm512_store_ps (p, v); }
+static inline simd_fp v_add   (const simd_fp a, const simd_fp b) { return _mm512_add_ps (a, b); }
+static inline simd_fp v_sub   (const simd_fp a, const simd_fp b) { return _mm512_sub_ps (a, b); }
+static inline simd_fp v_max   (const simd_fp a, const simd_fp b) { return _mm512_max_ps (a, b); }
+static inline simd_fp v_shift_in (const simd_fp v, const cawlign_fp x) {
+    return _mm512_castsi512_ps (_mm512_alignr_epi32 (_mm512_castps_si512 (v), _mm512_castps_si512 (_mm512_set1_ps (x)), 15));
+}
+static inline bool    v_same  (const simd_fp a, const simd_fp b) {
+    return _mm512_cmpeq_epi32_mask (_mm512_castps_si512 (a), _mm512_castps_si512 (b)) == 0xFFFF;
+}
+static inline simd_fp v_gt    (const simd_fp a, const simd_fp b) {
+    return _mm512_castsi512_ps (_mm512_maskz_mov_epi32 (_mm512_cmp_ps_mask (a, b, _CMP_GT_OQ), _mm512_set1_epi32 (-1)));
+}
+static inline simd_fp v_and   (const simd_fp a, const simd_fp b) {
+    return _mm512_castsi512_ps (_mm512_and_si512 (_mm512_castps_si512 (a), _mm512_castps_si512 (b)));
+}
+static inline simd_fp v_andnot(const simd_fp a, const simd_fp b) {
+    return _mm512_castsi512_ps (_mm512_andnot_si512 (_mm512_castps_si512 (a), _mm512_castps_si512 (b)));
+}
+static inline simd_fp v_or    (const simd_fp a, const simd_fp b) {
+    return _mm512_castsi512_ps (_mm512_or_si512 (_mm512_castps_si512 (a), _mm512_castps_si512 (b)));
+}
+
+
+typedef __m512i simd_i8;
+
+#define CAWLIGN_SIMD_I8_WIDTH 64
+
+static inline simd_i8 i8_set1  (const int x)                     { return _mm512_set1_epi8 ((char) x); }
+static inline simd_i8 i8_load  (const signed char * p)            { return _mm512_loadu_si512 ((const void*) p); }
+static inline void    i8_store (signed char * p, const simd_i8 v) { _mm512_storeu_si512 ((void*) p, v); }
+static inline simd_i8 i8_adds  (const simd_i8 a, const simd_i8 b) { return _mm512_adds_epi8 (a, b); }
+static inline simd_i8 i8_subs  (const simd_i8 a, const simd_i8 b) { return _mm512_subs_epi8 (a, b); }
+static inline simd_i8 i8_gt    (const simd_i8 a, const simd_i8 b) { return _mm512_movm_epi8 (_mm512_cmpgt_epi8_mask (a, b)); }
+static inline simd_i8 i8_eq    (const simd_i8 a, const simd_i8 b) { return _mm512_movm_epi8 (_mm512_cmpeq_epi8_mask (a, b)); }
+static inline simd_i8 i8_and   (const simd_i8 a, const simd_i8 b) { return _mm512_and_si512 (a, b); }
+static inline simd_i8 i8_andnot(const simd_i8 a, const simd_i8 b) { return _mm512_andnot_si512 (a, b); }
+static inline simd_i8 i8_or    (const simd_i8 a, const simd_i8 b) { return _mm512_or_si512 (a, b); }
+static inline simd_i8 i8_max   (const simd_i8 a, const simd_i8 b) { return _mm512_max_epi8 (a, b); }
+static inline simd_i8 i8_lanes (void) {
+    alignas (64) static const signed char lanes [64] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,
+                                                        32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,61,62,63};
+    return _mm512_load_si512 ((const void*) lanes);
+}
+
+typedef __m512i simd_i16;
+
+#define CAWLIGN_SIMD_I16_WIDTH 32
+
+static inline simd_i16 i16_set1  (const int x)                       { return _mm512_set1_epi16 ((short) x); }
+static inline simd_i16 i16_load  (const int16_t * p)                 { return _mm512_load_si512 ((const void*) p); }
+static inline void     i16_store (int16_t * p, const simd_i16 v)     { _mm512_store_si512 ((void*) p, v); }
+static inline simd_i16 i16_adds  (const simd_i16 a, const simd_i16 b) { return _mm512_adds_epi16 (a, b); }
+static inline simd_i16 i16_subs  (const simd_i16 a, const simd_i16 b) { return _mm512_subs_epi16 (a, b); }
+static inline simd_i16 i16_gt    (const simd_i16 a, const simd_i16 b) { return _mm512_movm_epi16 (_mm512_cmpgt_epi16_mask (a, b)); }
+static inline simd_i16 i16_max   (const simd_i16 a, const simd_i16 b) { return _mm512_max_epi16 (a, b); }
+static inline simd_i16 i16_min   (const simd_i16 a, const simd_i16 b) { return _mm512_min_epi16 (a, b); }
+static inline simd_i16 i16_and   (const simd_i16 a, const simd_i16 b) { return _mm512_and_si512 (a, b); }
+static inline simd_i16 i16_andnot(const simd_i16 a, const simd_i16 b) { return _mm512_andnot_si512 (a, b); }
+static inline simd_i16 i16_or    (const simd_i16 a, const simd_i16 b) { return _mm512_or_si512 (a, b); }
+static inline simd_i16 i16_shift_in (const simd_i16 v, const int x) {
+    alignas (64) static const int16_t up [32] = {0,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30};
+    return _mm512_mask_blend_epi16 (1, _mm512_permutexvar_epi16 (_mm512_load_si512 ((const void*) up), v), _mm512_set1_epi16 ((short) x));
+}
+static inline bool     i16_same  (const simd_i16 a, const simd_i16 b) {
+    return _mm512_cmpeq_epi16_mask (a, b) == 0xFFFFFFFFU;
+}
+
+#elif defined(__AVX2__)
+
+#define CAWLIGN_SIMD_WIDTH 8
+#define CAWLIGN_SIMD_NAME  "avx2"
+
+typedef __m256 simd_fp;
+
+static inline simd_fp v_set1  (const cawlign_fp x)              { return _mm256_set1_ps (x); }
+static inline simd_fp v_load  (const cawlign_fp * p)            { return _mm256_load_ps (p); }
+static inline void    v_store (cawlign_fp * p, const simd_fp v) { _mm256_store_ps (p, v); }
+static inline simd_fp v_add   (const simd_fp a, const simd_fp b) { return _mm256_add_ps (a, b); }
+static inline simd_fp v_sub   (const simd_fp a, const simd_fp b) { return _mm256_sub_ps (a, b); }
+static inline simd_fp v_max   (const simd_fp a, const simd_fp b) { return _mm256_max_ps (a, b); }
+static inline simd_fp v_shift_in (const simd_fp v, const cawlign_fp x) {
+    return _mm256_blend_ps (_mm256_permutevar8x32_ps (v, _mm256_setr_epi32 (0,0,1,2,3,4,5,6)), _mm256_set1_ps (x), 1);
+}
+static inline bool    v_same  (const simd_fp a, const simd_fp b) {
+    return _mm256_movemask_epi8 (_mm256_cmpeq_epi32 (_mm256_castps_si256 (a), _mm256_castps_si256 (b))) == -1;
+}
+static inline simd_fp v_gt    (const simd_fp a, const simd_fp b) { return _mm256_cmp_ps (a, b, _CMP_GT_OQ); }
+static inline simd_fp v_and   (const simd_fp a, const simd_fp b) { return _mm256_and_ps (a, b); }
+static inline simd_fp v_andnot(const simd_fp a, const simd_fp b) { return _mm256_andnot_ps (a, b); }
+static inline simd_fp v_or    (const simd_fp a, const simd_fp b) { return _mm256_or_ps (a, b); }
+
+
+typedef __m256i simd_i8;
+
+#define CAWLIGN_SIMD_I8_WIDTH 32
+
+static inline simd_i8 i8_set1  (const int x)                     { return _mm256_set1_epi8 ((char) x); }
+static inline simd_i8 i8_load  (const signed char * p)            { return _mm256_loadu_si256 ((const __m256i*) p); }
+static inline void    i8_store (signed char * p, const simd_i8 v) { _mm256_storeu_si256 ((__m256i*) p, v); }
+static inline simd_i8 i8_adds  (const simd_i8 a, const simd_i8 b) { return _mm256_adds_epi8 (a, b); }
+static inline simd_i8 i8_subs  (const simd_i8 a, const simd_i8 b) { return _mm256_subs_epi8 (a, b); }
+static inline simd_i8 i8_gt    (const simd_i8 a, const simd_i8 b) { return _mm256_cmpgt_epi8 (a, b); }
+static inline simd_i8 i8_eq    (const simd_i8 a, const simd_i8 b) { return _mm256_cmpeq_epi8 (a, b); }
+static inline simd_i8 i8_and   (const simd_i8 a, const simd_i8 b) { return _mm256_and_si256 (a, b); }
+static inline simd_i8 i8_andnot(const simd_i8 a, const simd_i8 b) { return _mm256_andnot_si256 (a, b); }
+static inline simd_i8 i8_or    (const simd_i8 a, const simd_i8 b) { return _mm256_or_si256 (a, b); }
+static inline simd_i8 i8_max   (const simd_i8 a, const simd_i8 b) { return _mm256_max_epi8 (a, b); }
+static inline simd_i8 i8_lanes (void) {
+    return _mm256_setr_epi8 (0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31);
+}
+
+typedef __m256i simd_i16;
+
+#define CAWLIGN_SIMD_I16_WIDTH 16
+
+static inline simd_i16 i16_set1  (const int x)                       { return _mm256_set1_epi16 ((short) x); }
+static inline simd_i16 i16_load  (const int16_t * p)                 { return _mm256_load_si256 ((const __m256i*) p); }
+static inline void     i16_store (int16_t * p, const simd_i16 v)     { _mm256_store_si256 ((__m256i*) p, v); }
+static inline simd_i16 i16_adds  (const simd_i16 a, const simd_i16 b) { return _mm256_adds_epi16 (a, b); }
+static inline simd_i16 i16_subs  (const simd_i16 a, const simd_i16 b) { return _mm256_subs_epi16 (a, b); }
+static inline simd_i16 i16_gt    (const simd_i16 a, const simd_i16 b) { return _mm256_cmpgt_epi16 (a, b); }
+static inline simd_i16 i16_max   (const simd_i16 a, const simd_i16 b) { return _mm256_max_epi16 (a, b); }
+static inline simd_i16 i16_min   (const simd_i16 a, const simd_i16 b) { return _mm256_min_epi16 (a, b); }
+static inline simd_i16 i16_and   (const simd_i16 a, const simd_i16 b) { return _mm256_and_si256 (a, b); }
+static inline simd_i16 i16_andnot(const simd_i16 a, const simd_i16 b) { return _mm256_andnot_si256 (a, b); }
+static inline simd_i16 i16_or    (const simd_i16 a, const simd_i16 b) { return _mm256_or_si256 (a, b); }
+static inline simd_i16 i16_shift_in (const simd_i16 v, const int x) {
+    return _mm256_insert_epi16 (_mm256_alignr_epi8 (v, _mm256_permute2x128_si256 (v, v, 0x08), 14), (short) x, 0);
+}
+static inline bool     i16_same  (const simd_i16 a, const simd_i16 b) {
+    return _mm256_movemask_epi8 (_mm256_cmpeq_epi16 (a, b)) == -1;
+}
+
+#elif defined(__SSE2__)
+
+#define CAWLIGN_SIMD_WIDTH 4
+#if defined(__SSE4_1__)
+#define CAWLIGN_SIMD_NAME  "sse4.1"
+#else
+#define CAWLIGN_SIMD_NAME  "sse2"
+#endif
+
+typedef __m128 simd_fp;
+
+static inline simd_fp v_set1  (const cawlign_fp x)              { return _mm_set1_ps (x); }
+static inline simd_fp v_load  (const cawlign_fp * p)            { return _mm_load_ps (p); }
+static inline void    v_store (cawlign_fp * p, const simd_fp v) { _mm_store_ps (p, v); }
+static inline simd_fp v_add   (const simd_fp a, const simd_fp b) { return _mm_add_ps (a, b); }
+static inline simd_fp v_sub   (const simd_fp a, const simd_fp b) { return _mm_sub_ps (a, b); }
+static inline simd_fp v_max   (const simd_fp a, const simd_fp b) { return _mm_max_ps (a, b); }
+static inline simd_fp v_shift_in (const simd_fp v, const cawlign_fp x) {
+    return _mm_move_ss (_mm_castsi128_ps (_mm_slli_si128 (_mm_castps_si128 (v), 4)), _mm_set_ss (x));
+}
+static inline bool    v_same  (const simd_fp a, const simd_fp b) {
+    return _mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_castps_si128 (a), _mm_castps_si128 (b))) == 0xFFFF;
+}
+static inline simd_fp v_gt    (const simd_fp a, const simd_fp b) { return _mm_cmpgt_ps (a, b); }
+static inline simd_fp v_and   (const simd_fp a, const simd_fp b) { return _mm_and_ps (a, b); }
+static inline simd_fp v_andnot(const simd_fp a, const simd_fp b) { return _mm_andnot_ps (a, b); }
+static inline simd_fp v_or    (const simd_fp a, const simd_fp b) { return _mm_or_ps (a, b); }
+
+
+typedef __m128i simd_i8;
+
+#define CAWLIGN_SIMD_I8_WIDTH 16
+
+static inline simd_i8 i8_set1  (const int x)                     { return _mm_set1_epi8 ((char) x); }
+static inline simd_i8 i8_load  (const signed char * p)            { return _mm_loadu_si128 ((const __m128i*) p); }
+static inline void    i8_store (signed char * p, const simd_i8 v) { _mm_storeu_si128 ((__m128i*) p, v); }
+static inline simd_i8 i8_adds  (const simd_i8 a, const simd_i8 b) { return _mm_adds_epi8 (a, b); }
+static inline simd_i8 i8_subs  (const simd_i8 a, const simd_i8 b) { return _mm_subs_epi8 (a, b); }
+static inline simd_i8 i8_gt    (const simd_i8 a, const simd_i8 b) { return _mm_cmpgt_epi8 (a, b); }
+static inline simd_i8 i8_eq    (const simd_i8 a, const simd_i8 b) { return _mm_cmpeq_epi8 (a, b); }
+static inline simd_i8 i8_and   (const simd_i8 a, const simd_i8 b) { return _mm_and_si128 (a, b); }
+static inline simd_i8 i8_andnot(const simd_i8 a, const simd_i8 b) { return _mm_andnot_si128 (a, b); }
+static inline simd_i8 i8_or    (const simd_i8 a, const simd_i8 b) { return _mm_or_si128 (a, b); }
+#if defined(__SSE4_1__)
+static inline simd_i8 i8_max   (const simd_i8 a, const simd_i8 b) { return _mm_max_epi8 (a, b); }
+#else
+// SSE2 has no signed byte maximum (PMAXSB is SSE4.1)
+static inline simd_i8 i8_max   (const simd_i8 a, const simd_i8 b) {
+    const simd_i8 gt = _mm_cmpgt_epi8 (a, b);
+    return _mm_or_si128 (_mm_and_si128 (gt, a), _mm_andnot_si128 (gt, b));
+}
+#endif
+static inline simd_i8 i8_lanes (void) {
+    return _mm_setr_epi8 (0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+}
+
+typedef __m128i simd_i16;
+
+#define CAWLIGN_SIMD_I16_WIDTH 8
+
+static inline simd_i16 i16_set1  (const int x)                       { return _mm_set1_epi16 ((short) x); }
+static inline simd_i16 i16_load  (const int16_t * p)                 { return _mm_load_si128 ((const __m128i*) p); }
+static inline void     i16_store (int16_t * p, const simd_i16 v)     { _mm_store_si128 ((__m128i*) p, v); }
+static inline simd_i16 i16_adds  (const simd_i16 a, const simd_i16 b) { return _mm_adds_epi16 (a, b); }
+static inline simd_i16 i16_subs  (const simd_i16 a, const simd_i16 b) { return _mm_subs_epi16 (a, b); }
+static inline simd_i16 i16_gt    (const simd_i16 a, const simd_i16 b) { return _mm_cmpgt_epi16 (a, b); }
+static inline simd_i16 i16_max   (const simd_i16 a, const simd_i16 b) { return _mm_max_epi16 (a, b); }
+static inline simd_i16 i16_min   (const simd_i16 a, const simd_i16 b) { return _mm_min_epi16 (a, b); }
+static inline simd_i16 i16_and   (const simd_i16 a, const simd_i16 b) { return _mm_and_si128 (a, b); }
+static inline simd_i16 i16_andnot(const simd_i16 a, const simd_i16 b) { return _mm_andnot_si128 (a, b); }
+static inline simd_i16 i16_or    (const simd_i16 a, const simd_i16 b) { return _mm_or_si128 (a, b); }
+static inline simd_i16 i16_shift_in (const simd_i16 v, const int x) {
+    return _mm_insert_epi16 (_mm_slli_si128 (v, 2), x, 0);
+}
+static inline bool     i16_same  (const simd_i16 a, const simd_i16 b) {
+    return _mm_movemask_epi8 (_mm_cmpeq_epi16 (a, b)) == 0xFFFF;
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+#define CAWLIGN_SIMD_WIDTH 4
+#define CAWLIGN_SIMD_NAME  "neon"
+
+typedef float32x4_t simd_fp;
+
+static inline simd_fp v_set1  (const cawlign_fp x)              { return vdupq_n_f32 (x); }
+static inline simd_fp v_load  (const cawlign_fp * p)            { return vld1q_f32 (p); }
+static inline void    v_store (cawlign_fp * p, const simd_fp v) { vst1q_f32 (p, v); }
+static inline simd_fp v_add   (const simd_fp a, const simd_fp b) { return vaddq_f32 (a, b); }
+static inline simd_fp v_sub   (const simd_fp a, const simd_fp b) { return vsubq_f32 (a, b); }
+static inline simd_fp v_max   (const simd_fp a, const simd_fp b) { return vbslq_f32 (vcgtq_f32 (a, b), a, b); }
+static inline simd_fp v_shift_in (const simd_fp v, const cawlign_fp x) { return vextq_f32 (vdupq_n_f32 (x), v, 3); }
+static inline bool    v_same  (const simd_fp a, const simd_fp b) {
+    return vminvq_u32 (vceqq_u32 (vreinterpretq_u32_f32 (a), vreinterpretq_u32_f32 (b))) == 0xFFFFFFFFU;
+}
+static inline simd_fp v_gt    (const simd_fp a, const simd_fp b) { return vreinterpretq_f32_u32 (vcgtq_f32 (a, b)); }
+static inline simd_fp v_and   (const simd_fp a, const simd_fp b) {
+    return vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (a), vreinterpretq_u32_f32 (b)));
+}
+static inline simd_fp v_andnot(const simd_fp a, const simd_fp b) {
+    return vreinterpretq_f32_u32 (vbicq_u32 (vreinterpretq_u32_f32 (b), vreinterpretq_u32_f32 (a)));
+}
+static inline simd_fp v_or    (const simd_fp a, const simd_fp b) {
+    return vreinterpretq_f32_u32 (vorrq_u32 (vreinterpretq_u32_f32 (a), vreinterpretq_u32_f32 (b)));
+}
+
+
+typedef int8x16_t simd_i8;
+
+#define CAWLIGN_SIMD_I8_WIDTH 16
+
+static inline simd_i8 i8_set1  (const int x)                     { return vdupq_n_s8 ((int8_t) x); }
+static inline simd_i8 i8_load  (const signed char * p)            { return vld1q_s8 ((const int8_t*) p); }
+static inline void    i8_store (signed char * p, const simd_i8 v) { vst1q_s8 ((int8_t*) p, v); }
+static inline simd_i8 i8_adds  (const simd_i8 a, const simd_i8 b) { return vqaddq_s8 (a, b); }
+static inline simd_i8 i8_subs  (const simd_i8 a, const simd_i8 b) { return vqsubq_s8 (a, b); }
+static inline simd_i8 i8_gt    (const simd_i8 a, const simd_i8 b) { return vreinterpretq_s8_u8 (vcgtq_s8 (a, b)); }
+static inline simd_i8 i8_eq    (const simd_i8 a, const simd_i8 b) { return vreinterpretq_s8_u8 (vceqq_s8 (a, b)); }
+static inline simd_i8 i8_and   (const simd_i8 a, const simd_i8 b) { return vandq_s8 (a, b); }
+static inline simd_i8 i8_andnot(const simd_i8 a, const simd_i8 b) { return vbicq_s8 (b, a); }
+static inline simd_i8 i8_or    (const simd_i8 a, const simd_i8 b) { return vorrq_s8 (a, b); }
+static inline simd_i8 i8_max   (const simd_i8 a, const simd_i8 b) { return vmaxq_s8 (a, b); }
+static inline simd_i8 i8_lanes (void) {
+    static const int8_t lanes [16] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
+    return vld1q_s8 (lanes);
+}
+
+typedef int16x8_t simd_i16;
+
+#define CAWLIGN_SIMD_I16_WIDTH 8
+
+static inline simd_i16 i16_set1  (const int x)                       { return vdupq_n_s16 ((int16_t) x); }
+static inline simd_i16 i16_load  (const int16_t * p)                 { return vld1q_s16 (p); }
+static inline void     i16_store (int16_t * p, const simd_i16 v)     { vst1q_s16 (p, v); }
+static inline simd_i16 i16_adds  (const simd_i16 a, const simd_i16 b) { return vqaddq_s16 (a, b); }
+static inline simd_i16 i16_subs  (const simd_i16 a, const simd_i16 b) { return vqsubq_s16 (a, b); }
+static inline simd_i16 i16_gt    (const simd_i16 a, const simd_i16 b) { return vreinterpretq_s16_u16 (vcgtq_s16 (a, b)); }
+static inline simd_i16 i16_max   (const simd_i16 a, const simd_i16 b) { return vmaxq_s16 (a, b); }
+static inline simd_i16 i16_min   (const simd_i16 a, const simd_i16 b) { return vminq_s16 (a, b); }
+static inline simd_i16 i16_and   (const simd_i16 a, const simd_i16 b) { return vandq_s16 (a, b); }
+static inline simd_i16 i16_andnot(const simd_i16 a, const simd_i16 b) { return vbicq_s16 (b, a); }
+static inline simd_i16 i16_or    (const simd_i16 a, const simd_i16 b) { return vorrq_s16 (a, b); }
+static inline simd_i16 i16_shift_in (const simd_i16 v, const int x) { return vextq_s16 (vdupq_n_s16 ((int16_t) x), v, 7); }
+static inline bool     i16_same  (const simd_i16 a, const simd_i16 b) {
+    return vminvq_u16 (vceqq_s16 (a, b)) == 0xFFFFU;
+}
+
+#else
+
+#define CAWLIGN_SIMD_NAME  "none"
+
+#endif
+
+//____________________________________________________________________________________
+
+constexpr const char * AlignStringsSIMDName (void) {
+    return CAWLIGN_SIMD_NAME;
+}
+
+//____________________________________________________________________________________
+
+constexpr long AlignStringsSIMDWidth (void) {
+#ifdef CAWLIGN_SIMD_WIDTH
+    return CAWLIGN_SIMD_WIDTH;
+#else
+    return 1;
+#endif
+}
+
+//____________________________________________________________________________________
+
+constexpr long AlignStringsDiffSIMDWidth (void) {
+#ifdef CAWLIGN_SIMD_I8_WIDTH
+    return CAWLIGN_SIMD_I8_WIDTH;
+#else
+    return 0;
+#endif
+}
+
+//____________________________________________________________________________________
+
+constexpr long AlignStringsInt16SIMDWidth (void) {
+#ifdef CAWLIGN_SIMD_I16_WIDTH
+    return CAWLIGN_SIMD_I16_WIDTH;
+#else
+    return 0;
+#endif
+}
+
+//____________________________________________________________________________________
+
+/** returns a pointer into storage aligned for vector loads and stores; storage must have W extra elements */
+
+template <class T> static inline T * AlignedStorage ( T * storage, const long W ) {
+    return (T*) ( ( (uintptr_t) storage + W * sizeof (T) - 1 ) & ~ ( W * sizeof (T) - 1 ) );
+}
+
+#ifdef CAWLIGN_SIMD_WIDTH
+
+/**
+    the traceback codes (see AlignStringsFillDiffSIMD) of a vector of cells as small (exact) floats,
+    from the same values that BacktrackAlignment would compare, and with the same tie-breaking
+*/
+
+static inline simd_fp v_traceback_code ( const bool do_affine
+                                       , const simd_fp match
+                                       , const simd_fp del
+                                       , const simd_fp ins
+                                       , const simd_fp h
+                                       , const simd_fp open_del
+                                       , const simd_fp extend_del
+                                       , const simd_fp open_ins
+                                       , const simd_fp extend_ins
+                                       ) {
+    const simd_fp one = v_set1 ( 1.f ),
+                  two = v_set1 ( 2.f );
+    
+    if ( do_affine ) {
+        const simd_fp is_match = v_gt ( match, v_max ( del, ins ) ),
+                      is_ins   = v_andnot ( is_match, v_gt ( ins, del ) ),
+                      is_del   = v_andnot ( v_or ( is_match, is_ins ), one );
+        
+        return v_add ( v_add ( is_del, v_and ( is_ins, two ) ),
+                       v_add ( v_andnot ( v_gt ( v_sub ( h, open_del ), v_sub ( del, extend_del ) ), v_set1 ( 4.f ) ),
+                               v_andnot ( v_gt ( v_sub ( h, open_ins ), v_sub ( ins, extend_ins ) ), v_set1 ( 8.f ) ) ) );
+    }
+    
+    const simd_fp not_match = v_or ( v_gt ( del, match ), v_gt ( ins, match ) ),
+                  is_del    = v_andnot ( v_gt ( ins, del ), not_match );
+    
+    return v_add ( v_and ( is_del, one ), v_and ( v_andnot ( is_del, not_match ), two ) );
+}
+
+#endif
+
+//____________________________________________________________________________________
+
+/**
+    Calls body with std::true_type / std::false_type arguments matching the runtime
+    flags, so that each kernel below is instantiated once per mode combination and
+    the per-cell mode tests (affine gaps, true local clamping) are folded away at
+    compile time rather than re-evaluated for every cell of the matrix.
+ */
+
+template <typename Body> static inline auto SpecializeFlags ( const bool flag, Body && body ) {
+    return flag ? body ( std::true_type () ) : body ( std::false_type () );
+}
+
+template <typename Body> static inline auto SpecializeFlags ( const bool flag, const bool flag2, Body && body ) {
+    return SpecializeFlags ( flag, [&] ( auto first ) {
+        return SpecializeFlags ( flag2, [&] ( auto second ) {
+            return body ( first, second );
+        } );
+    } );
+}
+
+template <bool DO_AFFINE, bool DO_TRUE_LOCAL> static bool AlignStringsFillSIMDFlags ( char const * r_str
+                                                                                    , char const * q_str
+                                                                                    , const long r_len
+                                                                                    , const long q_len
+                                                                                    , long * char_map
+                                                                                    , const cawlign_fp * cost_matrix
+                                                                                    , const long cost_stride
+                                                                                    , const cawlign_fp open_insertion
+                                                                                    , const cawlign_fp extend_insertion
+                                                                                    , const cawlign_fp open_deletion
+                                                                                    , const cawlign_fp extend_deletion
+                                                                                    , const cawlign_fp * row_h
+                                                                                    , const cawlign_fp * row_d
+                                                                                    , const cawlign_fp * col_h
+                                                                                    , const cawlign_fp * col_i
+                                                                                    , unsigned char * traceback
+                                                                                    , cawlign_fp * last_row
+                                                                                    , cawlign_fp * last_col
+                                                                                    , cawlign_fp & best_score
+                                                                                    , long & best_R
+                                                                                    , long & best_Q
+                                                                                    , const FillBlock * block
+                                                                                    )
+{
+    // constant in every specialization (see AlignStringsFillSIMD)
+    const bool do_affine = DO_AFFINE, do_true_local = DO_TRUE_LOCAL;
+#ifndef CAWLIGN_SIMD_WIDTH
+    return false;
+#else
+    /**
+        The query (columns of the DP matrix) is split into W = CAWLIGN_SIMD_WIDTH stripes of S consecutive positions;
+        vector k of a striped row holds query positions k, k + S, k + 2S, ... (0-based), so that
+        the vertical (deletion) and diagonal (match) dependencies are satisfied by whole vectors, and
+        the horizontal (insertion) dependency within a stripe is satisfied by processing the vectors in order.
+ 
+        The insertion dependency across stripes is resolved by the "lazy-F" loop: the values carried out of the
+        last vector of each stripe are shifted into the next stripe, and the row is re-evaluated until nothing changes.
+        Because every cell is always recomputed with the same operations, in the same order as the scalar code,
+        the fixed point is bit-identical to the scalar fill.
+ 
+        Only the previous and the current row are kept, and a traceback code is recorded for every cell.
+    */
+    
+    // the first row (column) of the matrix extends deletions (insertions) at the cost of opening them
+    const bool first_row    = ! block || block->first_row,
+               first_column = ! block || block->first_column;
+    
+    const long W          = CAWLIGN_SIMD_WIDTH,
+               S          = ( q_len + W - 1 ) / W,
+               seg        = S * W,
+               // row 0 of the profile is for reference characters which are not scored
+               profile_rows = cost_stride + 1;
+    
+    cawlign_fp * const storage = new cawlign_fp [ profile_rows * seg + 6 * seg + W ],
+               * const profile = AlignedStorage ( storage, W );
+    
+    cawlign_fp * h_prev      = profile + profile_rows * seg,
+               * h_curr      = h_prev + seg,
+               * const i_row = h_curr + seg,
+               * const d_row = i_row + seg,
+               * const valid = d_row + seg,
+               * const codes = valid + seg;
+    
+    const cawlign_fp neg_inf = -INFINITY;
+    
+    // build the striped query profile; unscored pairs receive -0.0, which leaves the added value unchanged
+    // (i.e. x + (-0.0) == x, the same as skipping the addition in the scalar code)
+    
+    long * const q_enc = new long [ seg ];
+    for (long q = 0; q < seg; ++q) {
+        q_enc [ q ] = q < q_len ? char_map[ (unsigned char) q_str[ q ] ] : -1;
+    }
+    
+    for (long c = -1; c < cost_stride; ++c ) {
+        cawlign_fp * const profile_row = profile + ( c + 1 ) * seg;
+        for (long k = 0; k < S; ++k) {
+            for (long l = 0; l < W; ++l) {
+                const long q_char = q_enc [ k + l * S ];
+                profile_row [ k * W + l ] = ( c >= 0 && q_char >= 0 ) ? cost_matrix[ c * cost_stride + q_char ] : -0.0f;
+            }
+        }
+    }
+    
+    delete [] q_enc;
+    
+    unsigned char * const row_codes = new unsigned char [ seg ];
+    
+    // stripe the first row; padding cells (past the end of the query) never feed back into real cells,
+    // and are masked out of the row maxima
+    
+    cawlign_fp all_ones;
+    memset ( &all_ones, 0xFF, sizeof ( all_ones ) );
+    
+    for (long k = 0; k < S; ++k) {
+        for (long l = 0; l < W; ++l) {
+            const long q = k + l * S;
+            valid  [ k * W + l ] = q < q_len ? all_ones : 0.f;
+            h_prev [ k * W + l ] = q < q_len ? row_h [ q + 1 ] : neg_inf;
+            d_row  [ k * W + l ] = q < q_len && do_affine ? row_d [ q + 1 ] : neg_inf;
+        }
+    }
+    
+    const simd_fp v_open_ins    = v_set1 ( open_insertion ),
+                  v_open_del    = v_set1 ( open_deletion ),
+                  v_extend_ins  = v_set1 ( extend_insertion ),
+                  v_ext_del     = v_set1 ( extend_deletion ),
+                  v_neg_inf     = v_set1 ( neg_inf ),
+                  // the first column of the query extends an insertion at the cost of opening one
+                  v_extend_ins0 = first_column ? v_shift_in ( v_extend_ins, open_insertion ) : v_extend_ins;
+    
+    alignas (64) cawlign_fp lanes [ CAWLIGN_SIMD_WIDTH ];
+    
+    best_score = neg_inf;
+    best_R = best_Q = 0;
+    
+    for (long i = 1; i <= r_len; ++i) {
+        const long r_char = char_map[ (unsigned char) r_str[ i - 1 ] ];
+        const cawlign_fp * const profile_row = profile + ( r_char >= 0 ? r_char + 1 : 0 ) * seg;
+        const simd_fp v_extend_del = i > 1 || ! first_row ? v_ext_del : v_open_del;
+        
+        const cawlign_fp h_diag0 = col_h [ i - 1 ],
+                         h_left0 = col_h [ i ],
+                         i_left0 = do_affine ? col_i [ i ] : 0.;
+        
+        simd_fp v_h_diag = v_shift_in ( v_load ( h_prev + ( S - 1 ) * W ), h_diag0 ),
+                v_h_left = v_shift_in ( v_neg_inf, h_left0 ),
+                v_i_left = v_shift_in ( v_neg_inf, i_left0 );
+        
+        // the traceback code of a cell is computed whenever the cell is, so that the last one computed is final
+        
+        for (long k = 0; k < S; ++k) {
+            const simd_fp v_h_up  = v_load ( h_prev + k * W ),
+                          v_match = v_add ( v_h_diag, v_load ( profile_row + k * W ) );
+            simd_fp v_del = v_sub ( v_h_up, v_open_del ),
+                    v_ins = v_sub ( v_h_left, v_open_ins );
+            
+            if ( do_affine ) {
+                v_del = v_max ( v_del, v_sub ( v_load ( d_row + k * W ), v_extend_del ) );
+                v_ins = v_max ( v_ins, v_sub ( v_i_left, k ? v_extend_ins : v_extend_ins0 ) );
+                v_store ( d_row + k * W, v_del );
+                v_store ( i_row + k * W, v_ins );
+                v_i_left = v_ins;
+            }
+            
+            v_h_left = v_max ( v_match, v_max ( v_del, v_ins ) );
+            v_store ( h_curr + k * W, v_h_left );
+            v_store ( codes + k * W, v_traceback_code ( do_affine, v_match, v_del, v_ins, v_h_left, v_open_del, v_ext_del, v_open_ins, v_extend_ins ) );
+            v_h_diag = v_h_up;
+        }
+        
+        // lazy-F: propagate insertions across stripe boundaries until the row settles
+        
+        for (bool settled = false; ! settled; ) {
+            v_h_diag = v_shift_in ( v_load ( h_prev + ( S - 1 ) * W ), h_diag0 );
+            v_h_left = v_shift_in ( v_load ( h_curr + ( S - 1 ) * W ), h_left0 );
+            if ( do_affine ) {
+                v_i_left = v_shift_in ( v_load ( i_row + ( S - 1 ) * W ), i_left0 );
+            }
+            
+            for (long k = 0; k < S; ++k) {
+                const simd_fp v_h_up  = v_load ( h_prev + k * W ),
+                              v_match = v_add ( v_h_diag, v_load ( profile_row + k * W ) );
+                simd_fp v_del = do_affine ? v_load ( d_row + k * W ) : v_sub ( v_h_up, v_open_del ),
+                        v_ins = v_sub ( v_h_left, v_open_ins );
+                
+                if ( do_affine ) {
+                    v_ins = v_max ( v_ins, v_sub ( v_i_left, k ? v_extend_ins : v_extend_ins0 ) );
+                }
+                
+                const simd_fp v_h = v_max ( v_match, v_max ( v_del, v_ins ) );
+                
+                // without affine gaps, the code also depends on the (possibly changed) cell to the left
+                v_store ( codes + k * W, v_traceback_code ( do_affine, v_match, v_del, v_ins, v_h, v_open_del, v_ext_del, v_open_ins, v_extend_ins ) );
+                
+                if ( v_same ( v_h, v_load ( h_curr + k * W ) ) && ( ! do_affine || v_same ( v_ins, v_load ( i_row + k * W ) ) ) ) {
+                    // the rest of the row was computed from exactly these values
+                    settled = true;
+                    break;
+                }
+                
+                v_store ( h_curr + k * W, v_h );
+                if ( do_affine ) {
+                    v_store ( i_row + k * W, v_ins );
+                    v_i_left = v_ins;
+                }
+                v_h_left = v_h;
+                v_h_diag = v_h_up;
+            }
+        }
+        
+        if ( do_true_local ) {
+            // the first cell (in row-major order) with the largest score seen so far
+            simd_fp v_row_max = v_neg_inf;
+            for (long k = 0; k < S; ++k) {
+                const simd_fp v_valid = v_load ( valid + k * W );
+                v_row_max = v_max ( v_row_max, v_or ( v_and ( v_valid, v_load ( h_curr + k * W ) ), v_andnot ( v_valid, v_neg_inf ) ) );
+            }
+            v_store ( lanes, v_row_max );
+            cawlign_fp row_max = lanes [ 0 ];
+            for (long l = 1; l < W; ++l) {
+                row_max = MAX_OP ( row_max, lanes [ l ] );
+            }
+            if ( row_max > best_score ) {
+                // lane l holds query positions l*S, ..., l*S + S - 1, so the first lane whose maximum is the
+                // row maximum holds its first occurrence; only that stripe needs to be searched
+                for (long l = 0; l < W && best_R != i; ++l) {
+                    if ( lanes [ l ] == row_max ) {
+                        for (long k = 0, q = l * S; k < S && q < q_len; ++k, ++q) {
+                            if ( h_curr [ k * W + l ] == row_max ) {
+                                best_score = row_max;
+                                best_R     = i;
+                                best_Q     = q + 1;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        
+        // de-stripe and pack the traceback codes
+        
+        if ( traceback ) {
+            for (long l = 0; l < W; ++l) {
+                const long q_from = l * S,
+                           q_to   = q_from + S < q_len ? q_from + S : q_len;
+                for (long q = q_from, k = l; q < q_to; ++q, k += W) {
+                    row_codes [ q ] = (unsigned char) codes [ k ];
+                }
+            }
+            
+            StoreTracebackCodes ( traceback, ( i - 1 ) * q_len, row_codes, q_len );
+        }
+        
+        last_col [ i ] = h_curr [ ( ( q_len - 1 ) % S ) * W + ( q_len - 1 ) / S ];
+        if ( do_affine && block ) {
+            block->last_col_i [ i ] = i_row [ ( ( q_len - 1 ) % S ) * W + ( q_len - 1 ) / S ];
+        }
+        
+        cawlign_fp * t = h_prev;
+        h_prev = h_curr;
+        h_curr = t;
+    }
+    
+    last_col [ 0 ] = row_h [ q_len ];
+    last_row [ 0 ] = col_h [ r_len ];
+    for (long q = 0; q < q_len; ++q) {
+        last_row [ q + 1 ] = h_prev [ ( q % S ) * W + q / S ];
+        if ( do_affine && block ) {
+            block->last_row_d [ q + 1 ] = d_row [ ( q % S ) * W + q / S ];
+        }
+    }
+    
+    delete [] storage;
+    delete [] row_codes;
+    return true;
+#endif
+}
+
+//____________________________________________________________________________________
+
+bool AlignStringsFillSIMD ( char const * r_str
+                          , char const * q_str
+                          , const long r_len
+                          , const long q_len
+                          , long * char_map
+                          , const cawlign_fp * cost_matrix
+                          , const long cost_stride
+                          , const cawlign_fp open_insertion
+                          , const cawlign_fp extend_insertion
+                          , const cawlign_fp open_deletion
+                          , const cawlign_fp extend_deletion
+                          , const bool do_affine
+                          , const bool do_true_local
+                          , const cawlign_fp * row_h
+                          , const cawlign_fp * row_d
+                          , const cawlign_fp * col_h
+                          , const cawlign_fp * col_i
+                          , unsigned char * traceback
+                          , cawlign_fp * last_row
+                          , cawlign_fp * last_col
+                          , cawlign_fp & best_score
+                          , long & best_R
+                          , long & best_Q
+                          , const FillBlock * block
+                          )
+{
+    return SpecializeFlags ( do_affine, do_true_local, [&] ( auto affine, auto true_local ) {
+        return AlignStringsFillSIMDFlags <decltype ( affine )::value, decltype ( true_local )::value>
+                   ( r_str, q_str, r_len, q_len, char_map, cost_matrix,
+                     cost_stride, open_insertion, extend_insertion, open_deletion, extend_deletion, row_h,
+                     row_d, col_h, col_i, traceback, last_row, last_col,
+                     best_score, best_R, best_Q, block );
+    } );
+}
+
+//____________________________________________________________________________________
+
+template <bool DO_AFFINE> static bool AlignStringsFillDiffSIMDFlags ( char const * r_str
+                                                                    , char const * q_str
+                                                                    , const long r_len
+                                                                    , const long q_len
+                                                                    , long * char_map
+                                                                    , const cawlign_fp * cost_matrix
+                                                                    , const long cost_stride
+                                                                    , const long scale
+                                                                    , const cawlign_fp open_insertion
+                                                                    , const cawlign_fp extend_insertion
+                                                                    , const cawlign_fp open_deletion
+                                                                    , const cawlign_fp extend_deletion
+                                                                    , const cawlign_fp * row_h
+                                                                    , const cawlign_fp * row_d
+                                                                    , const cawlign_fp * col_h
+                                                                    , const cawlign_fp * col_i
+                                                                    , unsigned char * traceback
+                                                                    , long * diag_offset
+                                                                    , long * last_row
+                                                                    , long * last_col
+                                                                    , const FillBlock * block
+                                                                    )
+{
+    // constant in every specialization (see AlignStringsFillDiffSIMD)
+    const bool do_affine = DO_AFFINE;
+#ifndef CAWLIGN_SIMD_I8_WIDTH
+    return false;
+#else
+    /**
+        With H, D (deletion) and I (insertion) as in AlignStrings, the kernel tracks, for cell (i,j)
+ 
+            a(i,j) = H(i,j) - H(i-1,j)          b(i,j) = H(i,j) - H(i,j-1)
+            x(i,j) = D(i+1,j) - H(i,j)          y(i,j) = I(i,j+1) - H(i,j)
+ 
+        which obey
+ 
+            z      = H(i,j) - H(i-1,j-1) = max ( s(i,j), x(i-1,j) + b(i-1,j), y(i,j-1) + a(i,j-1) )
+            a(i,j) = z - b(i-1,j)               b(i,j) = z - a(i,j-1)
+            x(i,j) = max ( -open_deletion,  x(i-1,j) + b(i-1,j) - z - extend_deletion )
+            y(i,j) = max ( -open_insertion, y(i,j-1) + a(i,j-1) - z - extend_insertion )
+ 
+        (without affine gaps x and y are constant). All cells on the anti-diagonal i + j = r depend only on
+        cells on the diagonal r - 1, so a whole run of consecutive rows on the diagonal is one vector.
+        a and y are stored by row (A[i], Y[i]), b and x by column, in reverse order (B[q_len - j], X[q_len - j])
+        so that they are also contiguous along the diagonal.
+    */
+    
+    const long W = CAWLIGN_SIMD_I8_WIDTH,
+               R = r_len,
+               Q = q_len;
+    
+    const long od = lrint ( open_deletion * scale ),
+               ed = lrint ( extend_deletion * scale ),
+               oi = lrint ( open_insertion * scale ),
+               ei = lrint ( extend_insertion * scale ),
+               // the first row (column) of the matrix extends deletions (insertions) at the cost of opening them
+               ed0 = ! block || block->first_row ? od : ed,
+               ei0 = ! block || block->first_column ? oi : ei;
+    
+    signed char * const storage = new signed char [ 5 * ( R + 1 + W ) + 4 * ( Q + 1 + W ) ],
+                * const A       = storage,
+                * const Y       = A + ( R + 1 + W ),
+                * const ref     = Y + ( R + 1 + W ),
+                * const B       = ref + ( R + 1 + W ),
+                * const X       = B + ( Q + 1 + W );
+    
+    // query profiles, for each character present in the reference (in reverse query order)
+    
+    long  present_count = 0,
+        * present = new long [ cost_stride ];
+    
+    memset ( storage, 0, sizeof (signed char) * ( 5 * ( R + 1 + W ) + 4 * ( Q + 1 + W ) ) );
+    
+    {
+        bool * seen = new bool [ cost_stride ] ();
+        for (long i = 1; i <= R; ++i) {
+            const long r_char = char_map[ (unsigned char) r_str[ i - 1 ] ];
+            ref [ i ] = r_char >= 0 ? r_char : -1;
+            if ( r_char >= 0 && ! seen [ r_char ] ) {
+                seen [ r_char ] = true;
+                present [ present_count++ ] = r_char;
+            }
+        }
+        delete [] seen;
+    }
+    
+    signed char * const profiles = new signed char [ present_count * ( Q + W ) ] ();
+    
+    // without a traceback, the codes of each diagonal are written to (and overwritten in) scratch storage
+    signed char * const scratch = traceback ? NULL : new signed char [ ( R < Q ? R : Q ) + W ];
+    
+    for (long c = 0; c < present_count; ++c) {
+        signed char * const profile = profiles + c * ( Q + W );
+        for (long k = 0; k < Q; ++k) {
+            const long q_char = char_map[ (unsigned char) q_str[ Q - k - 1 ] ];
+            profile [ k ] = q_char >= 0 ? lrint ( cost_matrix [ present[ c ] * cost_stride + q_char ] * scale ) : 0;
+        }
+    }
+    
+    // boundary conditions
+    
+    for (long i = 1; i <= R; ++i) {
+        const long h_prev = lrint ( col_h[ i - 1 ] * scale ),
+                   h      = lrint ( col_h[ i ] * scale );
+        A [ i ] = h - h_prev;
+        if ( do_affine ) {
+            const long ins = lrint ( col_i[ i ] * scale ) - ei0,
+                       opn = h - oi;
+            Y [ i ] = ( opn > ins ? opn : ins ) - h;
+        } else {
+            Y [ i ] = -oi;
+        }
+    }
+    
+    for (long j = 1; j <= Q; ++j) {
+        const long h_prev = lrint ( row_h[ j - 1 ] * scale ),
+                   h      = lrint ( row_h[ j ] * scale );
+        B [ Q - j ] = h - h_prev;
+        if ( do_affine ) {
+            const long del = lrint ( row_d[ j ] * scale ) - ed0,
+                       opn = h - od;
+            X [ Q - j ] = ( opn > del ? opn : del ) - h;
+        } else {
+            X [ Q - j ] = -od;
+        }
+    }
+    
+    const simd_i8 v_all   = i8_set1 ( -1 ),
+                  v_lanes = i8_lanes (),
+                  v_od    = i8_set1 ( -od ),
+                  v_oi    = i8_set1 ( -oi ),
+                  v_ed    = i8_set1 ( ed ),
+                  v_ei    = i8_set1 ( ei ),
+                  v_del   = i8_set1 ( 1 ),
+                  v_ins   = i8_set1 ( 2 ),
+                  v_dcont = i8_set1 ( 4 ),
+                  v_icont = i8_set1 ( 8 );
+    
+    long offset = 0;
+    
+    for (long r = 2; r <= R + Q; ++r) {
+        const long i_lo = r - Q > 1 ? r - Q : 1,
+                   i_hi = r - 1 < R ? r - 1 : R;
+        
+        diag_offset [ r ] = offset - i_lo;
+        signed char * const codes = ( traceback ? (signed char*) traceback + offset : scratch ) - i_lo;
+        
+        for (long i = i_lo; i <= i_hi; i += W) {
+            const long    k    = Q - r + i;
+            // lanes past the end of the diagonal must leave the stored differences untouched
+            const simd_i8 mask = i_hi - i + 1 >= W ? v_all : i8_gt ( i8_set1 ( i_hi - i + 1 ), v_lanes ),
+                          va   = i8_load ( A + i ),
+                          vb   = i8_load ( B + k ),
+                          vy   = i8_load ( Y + i ),
+                          vx   = i8_load ( X + k ),
+                          vr   = i8_load ( ref + i );
+            
+            simd_i8 vs = i8_set1 ( 0 );
+            for (long c = 0; c < present_count; ++c) {
+                vs = i8_or ( vs, i8_and ( i8_eq ( vr, i8_set1 ( present [ c ] ) ), i8_load ( profiles + c * ( Q + W ) + k ) ) );
+            }
+            
+            const simd_i8 dd  = i8_adds ( vx, vb ),
+                          ii  = i8_adds ( vy, va ),
+                          gap = i8_max ( dd, ii ),
+                          z   = i8_max ( vs, gap );
+            
+            simd_i8 is_match;
+            if ( do_affine ) {
+                // match if M > max (D, I), then insertion if I > D, deletion otherwise
+                is_match = i8_gt ( vs, gap );
+            } else {
+                // match if M >= D and M >= I, then deletion if D >= I, insertion otherwise
+                is_match = i8_andnot ( i8_or ( i8_gt ( dd, vs ), i8_gt ( ii, vs ) ), v_all );
+            }
+            
+            const simd_i8 is_ins = i8_andnot ( is_match, i8_gt ( ii, dd ) ),
+                          is_del = i8_andnot ( i8_or ( is_match, is_ins ), v_all );
+            
+            simd_i8 code = i8_or ( i8_and ( is_del, v_del ), i8_and ( is_ins, v_ins ) );
+            
+            const simd_i8 na = i8_subs ( z, vb ),
+                          nb = i8_subs ( z, va );
+            
+            i8_store ( A + i, i8_or ( i8_and ( mask, na ), i8_andnot ( mask, va ) ) );
+            i8_store ( B + k, i8_or ( i8_and ( mask, nb ), i8_andnot ( mask, vb ) ) );
+            
+            if ( do_affine ) {
+                const simd_i8 td = i8_subs ( i8_subs ( dd, z ), v_ed ),
+                              ti = i8_subs ( i8_subs ( ii, z ), v_ei ),
+                              nx = i8_max ( td, v_od ),
+                              ny = i8_max ( ti, v_oi );
+                
+                code = i8_or ( code, i8_andnot ( i8_gt ( v_od, td ), v_dcont ) );
+                code = i8_or ( code, i8_andnot ( i8_gt ( v_oi, ti ), v_icont ) );
+                
+                i8_store ( X + k, i8_or ( i8_and ( mask, nx ), i8_andnot ( mask, vx ) ) );
+                i8_store ( Y + i, i8_or ( i8_and ( mask, ny ), i8_andnot ( mask, vy ) ) );
+            }
+            
+            // codes past the end of the diagonal spill into the next one and get overwritten
+            i8_store ( codes + i, code );
+        }
+        
+        offset += i_hi - i_lo + 1;
+    }
+    
+    // recover the scores along the last row and the last column
+    
+    last_row [ 0 ] = lrint ( col_h [ R ] * scale );
+    for (long j = 1; j <= Q; ++j) {
+        last_row [ j ] = last_row [ j - 1 ] + B [ Q - j ];
+    }
+    
+    last_col [ 0 ] = lrint ( row_h [ Q ] * scale );
+    for (long i = 1; i <= R; ++i) {
+        last_col [ i ] = last_col [ i - 1 ] + A [ i ];
+    }
+    
+    if ( do_affine && block ) {
+        // x and y now hold MAX (h - open, d - extend) - h for the last row and column, which is all that the next
+        // block needs to know about their deletion and insertion scores d (see FillBlock)
+        for (long j = 1; j <= Q; ++j) {
+            block->last_row_d [ j ] = (cawlign_fp) ( last_row [ j ] + X [ Q - j ] + ed ) / (cawlign_fp) scale;
+        }
+        for (long i = 1; i <= R; ++i) {
+            block->last_col_i [ i ] = (cawlign_fp) ( last_col [ i ] + Y [ i ] + ei ) / (cawlign_fp) scale;
+        }
+    }
+    
+    delete [] profiles;
+    delete [] present;
+    delete [] storage;
+    delete [] scratch;
+    return true;
+#endif
+}
+
+//____________________________________________________________________________________
+
+bool AlignStringsFillDiffSIMD ( char const * r_str
+                              , char const * q_str
+                              , const long r_len
+                              , const long q_len
+                              , long * char_map
+                              , const cawlign_fp * cost_matrix
+                              , const long cost_stride
+                              , const long scale
+                              , const cawlign_fp open_insertion
+                              , const cawlign_fp extend_insertion
+                              , const cawlign_fp open_deletion
+                              , const cawlign_fp extend_deletion
+                              , const bool do_affine
+                              , const cawlign_fp * row_h
+                              , const cawlign_fp * row_d
+                              , const cawlign_fp * col_h
+                              , const cawlign_fp * col_i
+                              , unsigned char * traceback
+                              , long * diag_offset
+                              , long * last_row
+                              , long * last_col
+                              , const FillBlock * block
+                              )
+{
+    return SpecializeFlags ( do_affine, [&] ( auto affine ) {
+        return AlignStringsFillDiffSIMDFlags <decltype ( affine )::value>
+                   ( r_str, q_str, r_len, q_len, char_map, cost_matrix,
+                     cost_stride, scale, open_insertion, extend_insertion, open_deletion, extend_deletion,
+                     row_h, row_d, col_h, col_i, traceback, diag_offset,
+                     last_row, last_col, block );
+    } );
+}
+
+//____________________________________________________________________________________
+
+template <bool DO_AFFINE, bool DO_TRUE_LOCAL> static bool AlignStringsFillInt16SIMDFlags ( char const * r_str
+                                                                                         , char const * q_str
+                                                                                         , const long r_len
+                                                                                         , const long q_len
+                                                                                         , long * char_map
+                                                                                         , const cawlign_fp * cost_matrix
+                                                                                         , const long cost_stride
+                                                                                         , const long scale
+                                                                                         , const cawlign_fp open_insertion
+                                                                                         , const cawlign_fp extend_insertion
+                                                                                         , const cawlign_fp open_deletion
+                                                                                         , const cawlign_fp extend_deletion
+                                                                                         , const cawlign_fp * row_h
+                                                                                         , const cawlign_fp * row_d
+                                                                                         , const cawlign_fp * col_h
+                                                                                         , const cawlign_fp * col_i
+                                                                                         , unsigned char * traceback
+                                                                                         , long * last_row
+                                                                                         , long * last_col
+                                                                                         , long & best_score
+                                                                                         , long & best_R
+                                                                                         , long & best_Q
+                                                                                         , const FillBlock * block
+                                                                                         )
+{
+    // constant in every specialization (see AlignStringsFillInt16SIMD)
+    const bool do_affine = DO_AFFINE, do_true_local = DO_TRUE_LOCAL;
+#ifndef CAWLIGN_SIMD_I16_WIDTH
+    return false;
+#else
+    /**
+        This is AlignStringsFillSIMD with (scaled) 16-bit integer lanes instead of floats; see the comments there
+        for the striped layout and the lazy-F loop. Instead of writing the DP matrices, the kernel records
+        the traceback code of every cell once its row has settled.
+ 
+        The arithmetic saturates; to guarantee that no intermediate value ever does, every stored value
+        (and every boundary value) must lie within [lo, hi], i.e. at least "margin" away from the int16 limits,
+        where margin is the largest magnitude that can be added to or subtracted from a stored value.
+        The first value to leave that range is still computed exactly, and causes the kernel to give up.
+    */
+    
+    // the first row (column) of the matrix extends deletions (insertions) at the cost of opening them
+    const bool first_row    = ! block || block->first_row,
+               first_column = ! block || block->first_column;
+    
+    const long W          = CAWLIGN_SIMD_I16_WIDTH,
+               S          = ( q_len + W - 1 ) / W,
+               seg        = S * W,
+               profile_rows = cost_stride + 1,
+               od         = lrint ( open_deletion * scale ),
+               ed         = lrint ( extend_deletion * scale ),
+               oi         = lrint ( open_insertion * scale ),
+               ei         = lrint ( extend_insertion * scale );
+    
+    long margin = MAX_OP ( MAX_OP ( od, oi ), MAX_OP ( ed, ei ) );
+    for (long k = 0; k < cost_stride * cost_stride; ++k) {
+        margin = MAX_OP ( margin, labs ( lrint ( cost_matrix [ k ] * scale ) ) );
+    }
+    
+    const long lo = INT16_MIN + margin,
+               hi = INT16_MAX - margin;
+    
+    if ( lo >= 0 || hi <= 0 ) {
+        return false;
+    }
+    
+    // scale the boundary values (first row and first column)
+    
+    long * const boundary = new long [ 2 * ( q_len + 1 ) + 2 * ( r_len + 1 ) ],
+         * const row_h_s  = boundary,
+         * const row_d_s  = row_h_s + q_len + 1,
+         * const col_h_s  = row_d_s + q_len + 1,
+         * const col_i_s  = col_h_s + r_len + 1;
+    
+    bool in_range = true;
+    
+    auto scale_boundary = [&] ( const cawlign_fp * from, long * to, const long n, const long start ) -> void {
+        for (long k = 0; k < n; ++k) {
+            if ( k < start ) {
+                to [ k ] = 0;
+            } else {
+                const cawlign_fp v = from [ k ] * scale;
+                if ( ! ( v >= lo && v <= hi ) ) {
+                    in_range = false;
+                    to [ k ] = 0;
+                } else {
+                    to [ k ] = lrint ( v );
+                }
+            }
+        }
+    };
+    
+    scale_boundary ( row_h, row_h_s, q_len + 1, 0 );
+    scale_boundary ( col_h, col_h_s, r_len + 1, 0 );
+    if ( do_affine ) {
+        scale_boundary ( row_d, row_d_s, q_len + 1, 1 );
+        scale_boundary ( col_i, col_i_s, r_len + 1, 1 );
+    }
+    
+    if ( ! in_range ) {
+        delete [] boundary;
+        return false;
+    }
+    
+    int16_t * const storage = new int16_t [ profile_rows * seg + 6 * seg + W ],
+            * const profile = AlignedStorage ( storage, W );
+    
+    int16_t * h_prev      = profile + profile_rows * seg,
+            * h_curr      = h_prev + seg,
+            * const i_row = h_curr + seg,
+            * const d_row = i_row + seg,
+            * const valid = d_row + seg,
+            * const codes = valid + seg;
+    
+    // the striped query profile; unscored pairs add 0
+    
+    long * const q_enc = new long [ seg ];
+    for (long q = 0; q < seg; ++q) {
+        q_enc [ q ] = q < q_len ? char_map[ (unsigned char) q_str[ q ] ] : -1;
+    }
+    
+    for (long c = -1; c < cost_stride; ++c ) {
+        int16_t * const profile_row = profile + ( c + 1 ) * seg;
+        for (long k = 0; k < S; ++k) {
+            for (long l = 0; l < W; ++l) {
+                const long q_char = q_enc [ k + l * S ];
+                profile_row [ k * W + l ] = ( c >= 0 && q_char >= 0 ) ? lrint ( cost_matrix[ c * cost_stride + q_char ] * scale ) : 0;
+            }
+        }
+    }
+    
+    delete [] q_enc;
+    
+    // stripe the first row; padding cells are masked out of the range checks
+    for (long k = 0; k < S; ++k) {
+        for (long l = 0; l < W; ++l) {
+            const long q = k + l * S;
+            valid  [ k * W + l ] = q < q_len ? -1 : 0;
+            h_prev [ k * W + l ] = q < q_len ? row_h_s [ q + 1 ] : INT16_MIN;
+            d_row  [ k * W + l ] = q < q_len && do_affine ? row_d_s [ q + 1 ] : INT16_MIN;
+        }
+    }
+    
+    const simd_i16 v_open_ins    = i16_set1 ( oi ),
+                   v_open_del    = i16_set1 ( od ),
+                   v_extend_ins  = i16_set1 ( ei ),
+                   v_ext_del     = i16_set1 ( ed ),
+                   v_neg_inf     = i16_set1 ( INT16_MIN ),
+                   v_one         = i16_set1 ( 1 ),
+                   v_two         = i16_set1 ( 2 ),
+                   v_four        = i16_set1 ( 4 ),
+                   v_eight       = i16_set1 ( 8 ),
+                   v_extend_ins0 = first_column ? i16_shift_in ( v_extend_ins, oi ) : v_extend_ins;
+    
+    alignas (64) int16_t range [ 2 * CAWLIGN_SIMD_I16_WIDTH ];
+    
+    best_score = LONG_MIN;
+    best_R = best_Q = 0;
+    
+    for (long i = 1; i <= r_len && in_range; ++i) {
+        const long r_char = char_map[ (unsigned char) r_str[ i - 1 ] ];
+        const int16_t * const profile_row = profile + ( r_char >= 0 ? r_char + 1 : 0 ) * seg;
+        const simd_i16 v_extend_del = i > 1 || ! first_row ? v_ext_del : v_open_del;
+        
+        const long h_diag0 = col_h_s [ i - 1 ],
+                   h_left0 = col_h_s [ i ],
+                   i_left0 = do_affine ? col_i_s [ i ] : 0;
+        
+        simd_i16 v_h_diag = i16_shift_in ( i16_load ( h_prev + ( S - 1 ) * W ), h_diag0 ),
+                 v_h_left = i16_shift_in ( v_neg_inf, h_left0 ),
+                 v_i_left = i16_shift_in ( v_neg_inf, i_left0 );
+        
+        for (long k = 0; k < S; ++k) {
+            const simd_i16 v_h_up = i16_load ( h_prev + k * W );
+            simd_i16 v_del = i16_subs ( v_h_up, v_open_del ),
+                     v_ins = i16_subs ( v_h_left, v_open_ins );
+            
+            if ( do_affine ) {
+                v_del = i16_max ( v_del, i16_subs ( i16_load ( d_row + k * W ), v_extend_del ) );
+                v_ins = i16_max ( v_ins, i16_subs ( v_i_left, k ? v_extend_ins : v_extend_ins0 ) );
+                i16_store ( d_row + k * W, v_del );
+                i16_store ( i_row + k * W, v_ins );
+                v_i_left = v_ins;
+            }
+            
+            v_h_left = i16_max ( i16_adds ( v_h_diag, i16_load ( profile_row + k * W ) ), i16_max ( v_del, v_ins ) );
+            i16_store ( h_curr + k * W, v_h_left );
+            v_h_diag = v_h_up;
+        }
+        
+        // lazy-F: propagate insertions across stripe boundaries until the row settles
+        
+        for (bool settled = false; ! settled; ) {
+            v_h_diag = i16_shift_in ( i16_load ( h_prev + ( S - 1 ) * W ), h_diag0 );
+            v_h_left = i16_shift_in ( i16_load ( h_curr + ( S - 1 ) * W ), h_left0 );
+            if ( do_affine ) {
+                v_i_left = i16_shift_in ( i16_load ( i_row + ( S - 1 ) * W ), i_left0 );
+            }
+            
+            for (long k = 0; k < S; ++k) {
+                const simd_i16 v_h_up = i16_load ( h_prev + k * W );
+                simd_i16 v_del = do_affine ? i16_load ( d_row + k * W ) : i16_subs ( v_h_up, v_open_del ),
+                         v_ins = i16_subs ( v_h_left, v_open_ins );
+                
+                if ( do_affine ) {
+                    v_ins = i16_max ( v_ins, i16_subs ( v_i_left, k ? v_extend_ins : v_extend_ins0 ) );
+                }
+                
+                const simd_i16 v_h = i16_max ( i16_adds ( v_h_diag, i16_load ( profile_row + k * W ) ), i16_max ( v_del, v_ins ) );
+                
+                if ( i16_same ( v_h, i16_load ( h_curr + k * W ) ) && ( ! do_affine || i16_same ( v_ins, i16_load ( i_row + k * W ) ) ) ) {
+                    settled = true;
+                    break;
+                }
+                
+                i16_store ( h_curr + k * W, v_h );
+                if ( do_affine ) {
+                    i16_store ( i_row + k * W, v_ins );
+                    v_i_left = v_ins;
+                }
+                v_h_left = v_h;
+                v_h_diag = v_h_up;
+            }
+        }
+        
+        // traceback codes (with the same tie-breaking as BacktrackAlignment), range checks and the row maximum
+        
+        simd_i16 v_min     = i16_set1 ( 0 ),
+                 v_max     = i16_set1 ( 0 ),
+                 v_row_max = v_neg_inf;
+        
+        v_h_diag = i16_shift_in ( i16_load ( h_prev + ( S - 1 ) * W ), h_diag0 );
+        v_h_left = i16_shift_in ( i16_load ( h_curr + ( S - 1 ) * W ), h_left0 );
+        
+        for (long k = 0; k < S; ++k) {
+            const simd_i16 v_h_up  = i16_load ( h_prev + k * W ),
+                           v_h     = i16_load ( h_curr + k * W ),
+                           v_valid = i16_load ( valid + k * W ),
+                           v_match = i16_adds ( v_h_diag, i16_load ( profile_row + k * W ) );
+            simd_i16 v_code;
+            
+            if ( do_affine ) {
+                const simd_i16 v_del    = i16_load ( d_row + k * W ),
+                               v_ins    = i16_load ( i_row + k * W ),
+                               is_match = i16_gt ( v_match, i16_max ( v_del, v_ins ) ),
+                               is_ins   = i16_andnot ( is_match, i16_gt ( v_ins, v_del ) ),
+                               is_del   = i16_andnot ( i16_or ( is_match, is_ins ), v_one );
+                
+                v_code = i16_or ( i16_or ( is_del, i16_and ( is_ins, v_two ) ),
+                                  i16_or ( i16_andnot ( i16_gt ( i16_subs ( v_h, v_open_del ), i16_subs ( v_del, v_ext_del ) ), v_four ),
+                                           i16_andnot ( i16_gt ( i16_subs ( v_h, v_open_ins ), i16_subs ( v_ins, v_extend_ins ) ), v_eight ) ) );
+                
+                v_min = i16_min ( v_min, i16_min ( i16_and ( v_valid, v_del ), i16_and ( v_valid, v_ins ) ) );
+                v_max = i16_max ( v_max, i16_max ( i16_and ( v_valid, v_del ), i16_and ( v_valid, v_ins ) ) );
+            } else {
+                const simd_i16 v_del     = i16_subs ( v_h_up, v_open_del ),
+                               v_ins     = i16_subs ( v_h_left, v_open_ins ),
+                               not_match = i16_or ( i16_gt ( v_del, v_match ), i16_gt ( v_ins, v_match ) ),
+                               is_del    = i16_andnot ( i16_gt ( v_ins, v_del ), not_match );
+                
+                v_code = i16_or ( i16_and ( is_del, v_one ), i16_and ( i16_andnot ( is_del, not_match ), v_two ) );
+            }
+            
+            v_min = i16_min ( v_min, i16_and ( v_valid, v_h ) );
+            v_max = i16_max ( v_max, i16_and ( v_valid, v_h ) );
+            if ( do_true_local ) {
+                v_row_max = i16_max ( v_row_max, i16_or ( i16_and ( v_valid, v_h ), i16_andnot ( v_valid, v_neg_inf ) ) );
+            }
+            
+            i16_store ( codes + k * W, v_code );
+            v_h_diag = v_h_up;
+            v_h_left = v_h;
+        }
+        
+        i16_store ( range, v_min );
+        i16_store ( range + W, v_max );
+        for (long l = 0; l < W; ++l) {
+            if ( range [ l ] < lo || range [ W + l ] > hi ) {
+                in_range = false;
+            }
+        }
+        
+        if ( do_true_local ) {
+            // the first cell (in row-major order) with the largest score seen so far
+            i16_store ( range, v_row_max );
+            long row_max = range [ 0 ];
+            for (long l = 1; l < W; ++l) {
+                row_max = MAX_OP ( row_max, (long) range [ l ] );
+            }
+            if ( row_max > best_score ) {
+                // lane l holds query positions l*S, ..., l*S + S - 1, so the first lane whose maximum is the
+                // row maximum holds its first occurrence; only that stripe needs to be searched
+                for (long l = 0; l < W && best_R != i; ++l) {
+                    if ( range [ l ] == row_max ) {
+                        for (long k = 0, q = l * S; k < S && q < q_len; ++k, ++q) {
+                            if ( h_curr [ k * W + l ] == row_max ) {
+                                best_score = row_max;
+                                best_R     = i;
+                                best_Q     = q + 1;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        
+        // de-stripe the traceback codes
+        
+        if ( traceback ) {
+            unsigned char * const t_row = traceback + ( i - 1 ) * q_len;
+            
+            for (long l = 0; l < W; ++l) {
+                const long q_from = l * S,
+                           q_to   = q_from + S < q_len ? q_from + S : q_len;
+                for (long q = q_from, k = l; q < q_to; ++q, k += W) {
+                    t_row [ q ] = codes [ k ];
+                }
+            }
+        }
+        
+        last_col [ i ] = h_curr [ ( ( q_len - 1 ) % S ) * W + ( q_len - 1 ) / S ];
+        if ( do_affine && block ) {
+            block->last_col_i [ i ] = (cawlign_fp) i_row [ ( ( q_len - 1 ) % S ) * W + ( q_len - 1 ) / S ] / (cawlign_fp) scale;
+        }
+        
+        int16_t * t = h_prev;
+        h_prev = h_curr;
+        h_curr = t;
+    }
+    
+    if ( in_range ) {
+        last_col [ 0 ] = row_h_s [ q_len ];
+        last_row [ 0 ] = col_h_s [ r_len ];
+        for (long q = 0; q < q_len; ++q) {
+            last_row [ q + 1 ] = h_prev [ ( q % S ) * W + q / S ];
+            if ( do_affine && block ) {
+                block->last_row_d [ q + 1 ] = (cawlign_fp) d_row [ ( q % S ) * W + q / S ] / (cawlign_fp) scale;
+            }
+        }
+    }
+    
+    delete [] storage;
+    delete [] boundary;
+    return in_range;
+#endif
+}
+
+//____________________________________________________________________________________
+
+bool AlignStringsFillInt16SIMD ( char const * r_str
+                               , char const * q_str
+                               , const long r_len
+                               , const long q_len
+                               , long * char_map
+                               , const cawlign_fp * cost_matrix
+                               , const long cost_stride
+                               , const long scale
+                               , const cawlign_fp open_insertion
+                               , const cawlign_fp extend_insertion
+                               , const cawlign_fp open_deletion
+                               , const cawlign_fp extend_deletion
+                               , const bool do_affine
+                               , const bool do_true_local
+                               , const cawlign_fp * row_h
+                               , const cawlign_fp * row_d
+                               , const cawlign_fp * col_h
+                               , const cawlign_fp * col_i
+                               , unsigned char * traceback
+                               , long * last_row
+                               , long * last_col
+                               , long & best_score
+                               , long & best_R
+                               , long & best_Q
+                               , const FillBlock * block
+                               )
+{
+    return SpecializeFlags ( do_affine, do_true_local, [&] ( auto affine, auto true_local ) {
+        return AlignStringsFillInt16SIMDFlags <decltype ( affine )::value, decltype ( true_local )::value>
+                   ( r_str, q_str, r_len, q_len, char_map, cost_matrix,
+                     cost_stride, scale, open_insertion, extend_insertion, open_deletion, extend_deletion,
+                     row_h, row_d, col_h, col_i, traceback, last_row,
+                     last_col, best_score, best_R, best_Q, block );
+    } );
+}
+
+//____________________________________________________________________________________
+
+#if defined(__AVX2__) || defined(__SSE2__) || ( defined(__ARM_NEON) && defined(__aarch64__) )
+
+#define CAWLIGN_CODON_SIMD
+
+#if defined(__AVX2__) || defined(__SSE2__)
+typedef __m128      codon_fp4;
+#else
+typedef float32x4_t codon_fp4;
+#endif
+
+/**
+ * @name CodonPartialMoveScores
+ * Vector evaluation of the 3x5 and 3x4 moves of CodonAlignStringsStep for a cell away from the ragged edges
+ * of the query (5 < q < score_cols - 1), where every 3x5 move is penalized by 2 miscalls and every 3x4 move by 1.
+ * Each score is computed with the same operations, in the same order, as by the scalar code;
+ * the moves of unresolved partial codons score -INFINITY.
+ *
+ * @param partials the partial codons of the query position (see CodonQueryCodes)
+ * @param cost_row the row of the codon scoring matrix for the reference codon (3x5 and 3x4 moves score the
+ *        partial codon they keep as a full codon)
+ * @param base3x5 the score 5 columns back in the previous row, minus the 3x5 penalty
+ * @param base3x4 the score 4 columns back in the previous row, minus the 3x4 penalty
+ * @param scores3x5 receives the scores of the HY_3X5_COUNT moves (in the first 10 lanes; the last 2 are -INFINITY)
+ * @param scores3x4 receives the scores of the HY_3X4_COUNT moves
+ */
+
+static inline void CodonPartialMoveScores ( int32_t const * partials
+                                          , cawlign_fp const * cost_row
+                                          , const cawlign_fp base3x5
+                                          , const cawlign_fp base3x4
+                                          , codon_fp4 * scores3x5
+                                          , codon_fp4 & scores3x4
+                                          )
+{
+#if defined(__AVX2__)
+    const __m256i none = _mm256_set1_epi32 ( -1 ),
+    // 3x5 moves 0-7
+                  p0   = _mm256_loadu_si256 ( (const __m256i*) ( partials + HY_QUERY_3X5 ) ),
+    // 3x5 moves 8-9 (lanes 0-1; lanes 2-3 are unresolved) and the 3x4 moves (lanes 4-7)
+                  p1   = _mm256_blend_epi32 ( _mm256_permutevar8x32_epi32 ( _mm256_loadu_si256 ( (const __m256i*) ( partials + HY_QUERY_3X5 + 8 ) )
+                                                                          , _mm256_setr_epi32 ( 0, 1, 0, 0, 2, 3, 4, 5 ) )
+                                            , none, 0x0C );
+
+    const __m256 valid0 = _mm256_castsi256_ps ( _mm256_cmpgt_epi32 ( p0, none ) ),
+                 valid1 = _mm256_castsi256_ps ( _mm256_cmpgt_epi32 ( p1, none ) );
+
+    const __m256 cost0 = _mm256_mask_i32gather_ps ( _mm256_setzero_ps (), cost_row, p0, valid0, 4 ),
+                 cost1 = _mm256_mask_i32gather_ps ( _mm256_setzero_ps (), cost_row, p1, valid1, 4 );
+
+    const __m256 minus_inf = _mm256_set1_ps ( -INFINITY ),
+                 scores0   = _mm256_blendv_ps ( minus_inf, _mm256_add_ps ( _mm256_set1_ps ( base3x5 ), cost0 ), valid0 ),
+                 scores1   = _mm256_blendv_ps ( minus_inf
+                                              , _mm256_add_ps ( _mm256_setr_ps ( base3x5, base3x5, base3x5, base3x5, base3x4, base3x4, base3x4, base3x4 ), cost1 )
+                                              , valid1 );
+
+    scores3x5[ 0 ] = _mm256_castps256_ps128 ( scores0 );
+    scores3x5[ 1 ] = _mm256_extractf128_ps ( scores0, 1 );
+    scores3x5[ 2 ] = _mm256_castps256_ps128 ( scores1 );
+    scores3x4      = _mm256_extractf128_ps ( scores1, 1 );
+#else
+    int32_t const * const partial = partials + HY_QUERY_3X5;
+
+    // there is no gather instruction: look the costs up one at a time (those of unresolved partial codons are not used)
+    auto cost3x5 = [&] ( const long i ) -> cawlign_fp {
+        return cost_row[ partial[ i ] >= 0 ? partial[ i ] : 0 ];
+    };
+    auto cost3x4 = [&] ( const long i ) -> cawlign_fp {
+        const long p = partials[ HY_QUERY_3X4 + i ];
+        return cost_row[ p >= 0 ? p : 0 ];
+    };
+
+#if defined(__SSE2__)
+    const __m128 minus_inf = _mm_set1_ps ( -INFINITY ),
+                 base5     = _mm_set1_ps ( base3x5 );
+
+    auto valid = [&] ( const long a, const long b, const long c, const long d ) -> __m128 {
+        return _mm_castsi128_ps ( _mm_setr_epi32 ( a >= 0 ? -1 : 0, b >= 0 ? -1 : 0, c >= 0 ? -1 : 0, d >= 0 ? -1 : 0 ) );
+    };
+    auto select = [&] ( const __m128 mask, const __m128 value ) -> __m128 {
+#if defined(__SSE4_1__)
+        return _mm_blendv_ps ( minus_inf, value, mask );
+#else
+        return _mm_or_ps ( _mm_and_ps ( mask, value ), _mm_andnot_ps ( mask, minus_inf ) );
+#endif
+    };
+
+    scores3x5[ 0 ] = select ( valid ( partial[ 0 ], partial[ 1 ], partial[ 2 ], partial[ 3 ] )
+                            , _mm_add_ps ( base5, _mm_setr_ps ( cost3x5 ( 0 ), cost3x5 ( 1 ), cost3x5 ( 2 ), cost3x5 ( 3 ) ) ) );
+    scores3x5[ 1 ] = select ( valid ( partial[ 4 ], partial[ 5 ], partial[ 6 ], partial[ 7 ] )
+                            , _mm_add_ps ( base5, _mm_setr_ps ( cost3x5 ( 4 ), cost3x5 ( 5 ), cost3x5 ( 6 ), cost3x5 ( 7 ) ) ) );
+    scores3x5[ 2 ] = select ( valid ( partial[ 8 ], partial[ 9 ], -1, -1 )
+                            , _mm_add_ps ( base5, _mm_setr_ps ( cost3x5 ( 8 ), cost3x5 ( 9 ), 0., 0. ) ) );
+    scores3x4      = select ( valid ( partials[ HY_QUERY_3X4 ], partials[ HY_QUERY_3X4 + 1 ], partials[ HY_QUERY_3X4 + 2 ], partials[ HY_QUERY_3X4 + 3 ] )
+                            , _mm_add_ps ( _mm_set1_ps ( base3x4 ), _mm_setr_ps ( cost3x4 ( 0 ), cost3x4 ( 1 ), cost3x4 ( 2 ), cost3x4 ( 3 ) ) ) );
+#else
+    const float32x4_t minus_inf = vdupq_n_f32 ( -INFINITY ),
+                      base5     = vdupq_n_f32 ( base3x5 );
+
+    auto vector4 = [] ( const cawlign_fp a, const cawlign_fp b, const cawlign_fp c, const cawlign_fp d ) -> float32x4_t {
+        const cawlign_fp lanes[ 4 ] = { a, b, c, d };
+        return vld1q_f32 ( lanes );
+    };
+    auto valid = [] ( const long a, const long b, const long c, const long d ) -> uint32x4_t {
+        const uint32_t lanes[ 4 ] = { a >= 0 ? 0xFFFFFFFFU : 0U, b >= 0 ? 0xFFFFFFFFU : 0U, c >= 0 ? 0xFFFFFFFFU : 0U, d >= 0 ? 0xFFFFFFFFU : 0U };
+        return vld1q_u32 ( lanes );
+    };
+
+    scores3x5[ 0 ] = vbslq_f32 ( valid ( partial[ 0 ], partial[ 1 ], partial[ 2 ], partial[ 3 ] )
+                               , vaddq_f32 ( base5, vector4 ( cost3x5 ( 0 ), cost3x5 ( 1 ), cost3x5 ( 2 ), cost3x5 ( 3 ) ) ), minus_inf );
+    scores3x5[ 1 ] = vbslq_f32 ( valid ( partial[ 4 ], partial[ 5 ], partial[ 6 ], partial[ 7 ] )
+                               , vaddq_f32 ( base5, vector4 ( cost3x5 ( 4 ), cost3x5 ( 5 ), cost3x5 ( 6 ), cost3x5 ( 7 ) ) ), minus_inf );
+    scores3x5[ 2 ] = vbslq_f32 ( valid ( partial[ 8 ], partial[ 9 ], -1, -1 )
+                               , vaddq_f32 ( base5, vector4 ( cost3x5 ( 8 ), cost3x5 ( 9 ), 0., 0. ) ), minus_inf );
+    scores3x4      = vbslq_f32 ( valid ( partials[ HY_QUERY_3X4 ], partials[ HY_QUERY_3X4 + 1 ], partials[ HY_QUERY_3X4 + 2 ], partials[ HY_QUERY_3X4 + 3 ] )
+                               , vaddq_f32 ( vdupq_n_f32 ( base3x4 ), vector4 ( cost3x4 ( 0 ), cost3x4 ( 1 ), cost3x4 ( 2 ), cost3x4 ( 3 ) ) ), minus_inf );
+#endif
+#endif
+}
+
+/**
+ * @name CodonBestChoice
+ * The search for the best move in CodonAlignStringsStep when the 3x4 and 3x5 moves were scored by CodonPartialMoveScores:
+ * returns the index of the first move whose score is larger than those of all the previous moves
+ * (0 if none is larger than -INFINITY), and stores that score in max_score
+ *
+ * @param choices the scores of the moves other than 3x4 and 3x5 (the rest are ignored)
+ * @param scores3x5 the scores of the 3x5 moves (as returned by CodonPartialMoveScores)
+ * @param scores3x4 the scores of the 3x4 moves (as returned by CodonPartialMoveScores)
+ */
+
+static inline long CodonBestChoice ( cawlign_fp const * choices
+                                   , const codon_fp4 * scores3x5
+                                   , const codon_fp4 scores3x4
+                                   , cawlign_fp & max_score
+                                   )
+{
+    long best_choice = 0;
+    max_score = -INFINITY;
+    for (long i = 0; i < HY_3X4_START; ++i ) {
+        if ( choices[ i ] > max_score ) {
+            best_choice = i;
+            max_score = choices[ i ];
+        }
+    }
+
+    // the 3x4 moves come right before the 3x5 moves, and the move after those (HY_LOCAL_ALIGN_SHORTCUT) is never taken
+    alignas (16) cawlign_fp lanes[ 16 ];
+#if defined(__AVX2__) || defined(__SSE2__)
+    __m128 m = _mm_max_ps ( _mm_max_ps ( scores3x4, scores3x5[ 0 ] ), _mm_max_ps ( scores3x5[ 1 ], scores3x5[ 2 ] ) );
+    m = _mm_max_ps ( m, _mm_shuffle_ps ( m, m, 0x4E ) );
+    m = _mm_max_ps ( m, _mm_shuffle_ps ( m, m, 0xB1 ) );
+    if ( _mm_cvtss_f32 ( m ) > max_score ) {
+        const unsigned mask = (unsigned) _mm_movemask_ps ( _mm_cmpeq_ps ( scores3x4, m ) )
+                            | (unsigned) _mm_movemask_ps ( _mm_cmpeq_ps ( scores3x5[ 0 ], m ) ) << 4
+                            | (unsigned) _mm_movemask_ps ( _mm_cmpeq_ps ( scores3x5[ 1 ], m ) ) << 8
+                            | (unsigned) _mm_movemask_ps ( _mm_cmpeq_ps ( scores3x5[ 2 ], m ) ) << 12;
+        const long lane = __builtin_ctz ( mask );
+        _mm_store_ps ( lanes,      scores3x4 );
+        _mm_store_ps ( lanes + 4,  scores3x5[ 0 ] );
+        _mm_store_ps ( lanes + 8,  scores3x5[ 1 ] );
+        _mm_store_ps ( lanes + 12, scores3x5[ 2 ] );
+        best_choice = HY_3X4_START + lane;
+        max_score   = lanes[ lane ];
+    }
+#else
+    const float m = vmaxvq_f32 ( vmaxq_f32 ( vmaxq_f32 ( scores3x4, scores3x5[ 0 ] ), vmaxq_f32 ( scores3x5[ 1 ], scores3x5[ 2 ] ) ) );
+    if ( m > max_score ) {
+        vst1q_f32 ( lanes,      scores3x4 );
+        vst1q_f32 ( lanes + 4,  scores3x5[ 0 ] );
+        vst1q_f32 ( lanes + 8,  scores3x5[ 1 ] );
+        vst1q_f32 ( lanes + 12, scores3x5[ 2 ] );
+        for (long lane = 0; lane < 16; ++lane ) {
+            if ( lanes[ lane ] == m ) {
+                best_choice = HY_3X4_START + lane;
+                max_score   = lanes[ lane ];
+                break;
+            }
+        }
+    }
+#endif
+    return best_choice;
+}
+
+#endif
+
+//____________________________________________________________________________________
+
+/**
+ * @name CodonAlignStringsStep
+ * Perform a single step in the codon alignment algorithm; returns the best operation and updates DP matrices
+ *
+ * @param score_matrix an NxN score matrix (N = 65, to accommodate all 64 codons plus an explicit "unresolved" character)
+ * @param reference the prepared reference (its codons and their rows of the scoring matrices)
+ * @param query_partials the partial codons of each query position (see CodonQueryCodes)
+ * @param query_codons the full codon ending at each query position (see CodonQueryCodes)
+ * @param query_ambiguities the scores of each unresolved query codon against every reference codon (see CodonQueryAmbiguities)
+ * @param r index in reference (counted out in codons)
+ * @param q index in query (counted out in nucleotides)
+ * @param score_cols the number of columns in the (full) DP matrix
+ * @param curr the index of cell (r, q) in the DP matrices
+ * @param row_stride how far back the same column of the previous row is stored in the DP matrices
+ *        (score_cols when they hold complete rows)
+ * @param miscall_cost the cost of introducing an out-of-frame indel
+ * @param open_deletion the cost of opening an indel in the reference 
+ * @param extend_deletion the cost of extending an indel in the reference
+ * @param open_inserion the cost of opening an indel in the query
+ * @param extend_inserion the cost of extending an indel in the query
+ * @param cost_stride the number of columns in the DP matrix
+ * @param insertion_matrix the DP matrix for affine insertions
+ * @param deletion_matrix the DP matrix for affine deletions
+ * @tparam DO_AFFINE whether insertion_matrix and deletion_matrix are in use
+ * @param do_local if TRUE, perform a local alignment (no prefix/suffix indel cost)
+ *
+ * @return the best scoring alignment operation
+
+ */
+
+template <bool DO_AFFINE> static inline long CodonAlignStringsStep( cawlign_fp * const score_matrix
+                                                                 , CodonReference const * const reference
+                                                                 , int32_t const * const query_partials
+                                                                 , int32_t const * const query_codons
+                                                                 , cawlign_fp const * const * const query_ambiguities
+                                                                 , const long r
+                                                                 , const long q
+                                                                 , const long score_cols
+                                                                 , const long curr
+                                                                 , const long row_stride
+                                                                 , const cawlign_fp miscall_cost
+                                                                 , const cawlign_fp open_insertion
+                                                                 , const cawlign_fp open_deletion
+                                                                 , const cawlign_fp extend_insertion
+                                                                 , const cawlign_fp extend_deletion
+                                                                 , const long cost_stride
+                                                                 , cawlign_fp * const insertion_matrix
+                                                                 , cawlign_fp * const deletion_matrix
+                                                                 , const    bool  do_local
+                                                                 , cawlign_fp& score
+                                                                 )
+{
+    /**
+     * r is CODON position in the reference,
+     * q is NUC position in the query,
+     * curr is a pointer to the current position in the scoring matrix,
+     * prev is a pointer to the previous CODON in the scoring matrix
+     * NOTE: moving by row_stride in the scoring matrix changes the CODON
+     *       position in the scoring matrix, as we're only interested in CODON
+     *       alignments to the reference
+     * do_local is true if we wish to perform a local alignment 
+     */
+    const long prev = curr - row_stride; // upstream a codon in the reference for the DP matrix
+    
+    // mutable vars
+    long r_codon = -1,
+         q_codon = -1,
+         best_choice = 0,
+         //i,
+         choice;
+
+    int32_t const * const partials = query_partials + q * HY_QUERY_PARTIALS;
+
+    // the rows of the scoring matrices for the reference codon
+    cawlign_fp const * cost_row = NULL,
+                     * row3x2   = NULL,
+                     * row3x1   = NULL;
+    
+
+    long    local_shortcut_came_from_this_move = -1;
+
+#if defined(CAWLIGN_CODON_SIMD)
+    // the scores of the 3x5 and 3x4 moves, when they are computed by CodonPartialMoveScores; they are only read
+    // when vector_moves is set, but zeroed so that the compiler does not need to prove that
+    codon_fp4 scores3x5[ 3 ] = {},
+              scores3x4      = {};
+    bool      vector_moves = false;
+#endif
+
+    cawlign_fp choices[ HY_ALIGNMENT_TYPES_COUNT ],
+           max_score = -INFINITY,
+           penalty;
+
+    // store the scores of our choices in choices,
+    // pre-initialize to -infinity
+    for (long i = 0; i < HY_ALIGNMENT_TYPES_COUNT; i++ ) {
+        choices[ i ] = -INFINITY;
+    }
+    
+    // if we're at least a CODON away from the edge...
+    // (psst, r is CODONs remember?)
+    if ( r >= 1 ) {
+        // if we're doing affine gaps (deletions)
+        if ( DO_AFFINE ) {
+            choices[ HY_111_000 ] = MAX_OP(
+                score_matrix[ prev ] - open_deletion,
+                deletion_matrix[ prev ] - ( r > 1 ? extend_deletion : open_deletion )
+            );
+            deletion_matrix[ curr ] = choices[ HY_111_000 ];
+            
+            //printf ("%ld/%ld %g %g \n", r, q, deletion_matrix[ prev ] , deletion_matrix[ curr ]);
+        } else {
+            choices[ HY_111_000 ] = score_matrix[ prev ] - open_deletion;
+        }
+
+        // anything other than a fully resolved codon has been mapped to the "generic unresolved" character
+        r_codon  = reference->codons   [ r - 1 ];
+        cost_row = reference->cost_rows[ r - 1 ];
+        row3x2   = reference->rows3x2  [ r - 1 ];
+        row3x1   = reference->rows3x1  [ r - 1 ];
+    }
+
+    // if we're at least 1 codon away from the edge
+    if ( q >= 3 ) {
+        // if we're doing affine gaps (insertions)
+        if ( DO_AFFINE ) {
+            choices[ HY_000_111 ] = MAX_OP(
+                score_matrix[ curr - 3 ] - open_insertion,
+                insertion_matrix[ curr - 3 ] - ( q > 3 ? extend_insertion : open_insertion )
+            );
+            insertion_matrix[ curr ] = choices[ HY_000_111 ];
+        } else {
+            choices[ HY_000_111 ] = score_matrix[ curr - 3 ] - open_insertion;
+        }
+
+        q_codon = query_codons[ q ];
+    }
+
+    // if q_codon and r_codon both exist, set the score equal to match
+    if ( r_codon >= 0 && q >= 3) {
+        if (q_codon < 0) {
+            // the best of the resolutions (if there are any) was found by CodonQueryAmbiguities
+            choices[ HY_111_111 ] = score_matrix[ prev - 3 ] + query_ambiguities[ q ][ r_codon ];
+            q_codon = cost_stride - 1;
+        } else {
+            
+            if (q_codon >= 0) {
+                const cawlign_fp move_cost = cost_row[ q_codon ];
+                choices[ HY_111_111 ] = score_matrix[ prev - 3 ] + move_cost;
+            }
+        }
+        //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
+        //    local_shortcut_came_from_this_move = HY_111_111;
+        //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
+        //}
+    }
+
+    // the frameshift moves (3x5, 3x4, 3x2 and 3x1) come after the in-frame ones, so they only win the cell by strictly
+    // beating all of them; away from the ragged edges, where each kind has a fixed penalty, skip them all if even
+    // the best partial codon scores for the reference codon could not (rounding is monotonic, so the bound is exact)
+    bool frameshifts = r_codon >= 0;
+
+    if ( frameshifts && q > 5 && q < score_cols - 1 ) {
+        const cawlign_fp penalty1 = miscall_cost,
+                         penalty2 = 2. * miscall_cost,
+                         in_frame = MAX_OP ( choices[ HY_111_111 ], MAX_OP ( choices[ HY_111_000 ], choices[ HY_000_111 ] ) ),
+                         bound3x5 = MAX_OP ( score_matrix[ prev - 5 ] - penalty2 + reference->best_codon[ r - 1 ],
+                                             score_matrix[ prev - 4 ] - penalty1 + reference->best_codon[ r - 1 ] ),
+                         bound3x2 = MAX_OP ( score_matrix[ prev - 2 ] - penalty1 + reference->best3x2[ r - 1 ],
+                                             score_matrix[ prev - 1 ] - penalty2 + reference->best3x1[ r - 1 ] );
+
+        frameshifts = MAX_OP ( bound3x5, bound3x2 ) > in_frame;
+    }
+
+    // we disallow partial moves in the reference, so those used to be here but are now gone
+
+    // HERE BE DRAGONS!!!!
+
+    // miscall matches, starting with 3x5, then 3x4, then 3x2, finally 3x1
+    if ( frameshifts ) {
+#if defined(CAWLIGN_CODON_SIMD)
+        if ( q > 5 && q < score_cols - 1 ) {
+            // no ragged edges here, so all 3x5 and 3x4 moves of a kind carry the same penalty
+            const cawlign_fp penalty3x5 = 2. * miscall_cost,
+                             penalty3x4 = miscall_cost;
+            CodonPartialMoveScores ( partials, cost_row
+                                   , score_matrix[ prev - 5 ] - penalty3x5, score_matrix[ prev - 4 ] - penalty3x4
+                                   , scores3x5, scores3x4 );
+            vector_moves = true;
+        } else {
+#endif
+        // 3x5 partial codons
+        if ( q >= 5 ) {
+            // go over each choice, fill it in
+            for (long i = 0; i < HY_3X5_COUNT; ++i ) {
+                if ( partials[ HY_QUERY_3X5 + i ] >= 0 ) {
+                    // this partial codon is resolved
+                    choice = HY_3X5_START + i;
+                    // if we have a cawlign_fp ragged edge, don't penalize
+                    if ( ( q == 5              && choice == HY_00111_11111 )
+                      || ( q == score_cols - 1 && choice == HY_11100_11111 ) )
+                        penalty = 0.;
+                    // if we have a single ragged edge, penalize by a single miscall
+                    // we don't have to worry about specifying each case here,
+                    // as the 00111_11111 case takes preference above,
+                    // so we don't have to explicitly avoid it
+                    else if ( q == 5 && choice >= HY_01110_11111 )
+                        penalty = miscall_cost;
+                    // if we have a single ragged edge, penalize by a single miscall
+                    // unfortunately these cases are spread out,
+                    // so we have to enumerate them explicitly here
+                    else if ( q == score_cols - 1
+                           && ( choice == HY_11010_11111
+                             || choice == HY_10110_11111
+                             || choice == HY_01110_11111 ) )
+                        penalty = miscall_cost;
+                    // if we don't fit into any of these special cases,
+                    // the miscall penalty is cawlign_fp (as we're matching 3 to 5)
+                    else
+                        penalty = 2. * miscall_cost;
+                        
+                    const cawlign_fp move_cost = cost_row[ partials[ HY_QUERY_3X5 + i ] ];
+                    
+                    choices[ choice ] = score_matrix[ prev - 5 ] - penalty + move_cost;
+                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
+                    //    local_shortcut_came_from_this_move = choice;
+                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
+                    //}
+                }
+            }
+        }
+
+        // 3x4 partial codons
+        if ( q >= 4 ) {
+            // fill in choices
+            for (long i = 0; i < HY_3X4_COUNT; ++i ) {
+                if ( partials[ HY_QUERY_3X4 + i ] >= 0 ) {
+                    choice = HY_3X4_START + i;
+                    // if we have a ragged edge,
+                    // penalize it not at all
+                    if ( ( q == 4              && choice == HY_0111_1111 )
+                      || ( q == score_cols - 1 && choice == HY_1110_1111 ) )
+                        penalty = 0.;
+                    // otherwise it's just a single miscall penalty
+                    else
+                        penalty = miscall_cost;
+
+                    const cawlign_fp move_cost = cost_row[ partials[ HY_QUERY_3X4 + i ] ];
+
+                    choices[ choice ] = score_matrix[ prev - 4 ] - penalty + move_cost;
+                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
+                    //    local_shortcut_came_from_this_move = choice;
+                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
+                    //}
+                }
+            }
+        }
+#if defined(CAWLIGN_CODON_SIMD)
+        }
+#endif
+        // 3x2
+        if ( q >= 2 ) {
+            // only a single partial codon
+            const long partial_codon = partials[ HY_QUERY_3X2 ];
+            // fill in choices
+            if ( partial_codon >= 0 ) {
+                for (long i = 0; i < HY_3X2_COUNT; ++i ) {
+                    choice = HY_3X2_START + i;
+                    // if we have a ragged edge at the beginning or end,
+                    // respectively, don't penalize it
+                    if ( ( q == 2              && choice == HY_111_011 )
+                      || ( q == score_cols - 1 && choice == HY_111_110 ) )
+                        penalty = 0.;
+                    // otherwise it's just a single miscall penalty
+                    else
+                        penalty = miscall_cost;
+                        
+                                                                
+                    const cawlign_fp move_cost = row3x2[ HY_3X2_COUNT * partial_codon + i ];
+
+                    choices[ choice ] = score_matrix[ prev - 2 ] - penalty + move_cost;
+                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
+                    //    local_shortcut_came_from_this_move = choice;
+                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
+                    //}
+                }
+            }
+        }
+        // 3x1
+        if ( q >= 1 ) {
+            // only a single partial codon
+            const long partial_codon = partials[ HY_QUERY_3X1 ];
+            // fill in choices
+            if ( partial_codon >= 0 ) {
+                for (long i = 0; i < HY_3X1_COUNT; ++i ) {
+                    choice = HY_3X1_START + i;
+                    // if we have a cawlign_fp ragged edge,
+                    // don't enforce a miscall penalty
+                    if ( ( q == 1              && choice == HY_111_001 )
+                      || ( q == score_cols - 1 && choice == HY_111_100 ) )
+                        penalty = 0.;
+                    // if we have a single ragged edge,
+                    // enforce only a single miscall penalty
+                    else if ( ( q == 1              && choice == HY_111_010 )
+                           || ( q == score_cols - 1 && choice == HY_111_010 ) )
+                        penalty = miscall_cost;
+                    // otherwise we need a cawlign_fp miscall penalty,
+                    // for the two positions we're inserting
+                    else
+                        penalty = 2. * miscall_cost;
+
+                    const cawlign_fp move_cost = row3x1[ HY_3X1_COUNT * partial_codon + i ];
+
+                    choices[ choice ] = score_matrix[ prev - 1 ] - penalty + move_cost;
+                    //if (do_local && choices [HY_LOCAL_ALIGN_SHORTCUT] < move_cost) {
+                    //    local_shortcut_came_from_this_move = choice;
+                    //    choices [HY_LOCAL_ALIGN_SHORTCUT]  = move_cost;
+                    //}
+                }
+            }
+        }
+    }
+
+    // find the best possible choice
+#if defined(CAWLIGN_CODON_SIMD)
+    if ( vector_moves ) {
+        best_choice = CodonBestChoice ( choices, scores3x5, scores3x4, max_score );
+    } else
+#endif
+    //if (do_local) {
+        for (long i = 0; i < ( frameshifts ? HY_ALIGNMENT_TYPES_COUNT : HY_000_111 + 1 ) ; ++i ) {
+            if ( choices[ i ] > max_score ) {
+                best_choice = i;
+                max_score = choices[ i ];
+            }
+        }
+    /*} else {
+        for (long i = 0; i < HY_ALIGNMENT_TYPES_COUNT - 1 ; ++i ) {
+            if ( choices[ i ] > max_score ) {
+                best_choice = i;
+                max_score = choices[ i ];
+            }
+        }
+    }*/
+    
+    
+    //fprintf( stderr, "\nscore: %.3g best: %ld\n", max_score, best_choice );
+
+    // assign the score to the current position
+    score_matrix[ curr ] = max_score;
+
+    //if (do_local && best_choice == HY_LOCAL_ALIGN_SHORTCUT) {
+    //    return -local_shortcut_came_from_this_move - 1;
+    //}
+    score = max_score;
+    return best_choice;
+}
+
+//____________________________________________________________________________________
+
+template <bool DO_AFFINE> static void CodonFillRowFlags ( CodonReference const * const reference
+                                                        , int32_t const * const query_partials
+                                                        , int32_t const * const query_codons
+                                                        , cawlign_fp const * const * const query_ambiguities
+                                                        , const long r
+                                                        , const long q_from
+                                                        , const long q_to
+                                                        , const long score_cols
+                                                        , const long curr
+                                                        , const long row_stride
+                                                        , const cawlign_fp miscall_cost
+                                                        , const cawlign_fp open_insertion
+                                                        , const cawlign_fp extend_insertion
+                                                        , const cawlign_fp open_deletion
+                                                        , const cawlign_fp extend_deletion
+                                                        , const long cost_stride
+                                                        , const bool do_true_local
+                                                        , cawlign_fp * const score_matrix
+                                                        , cawlign_fp * const insertion_matrix
+                                                        , cawlign_fp * const deletion_matrix
+                                                        , unsigned char * const moves
+                                                        )
+{
+    cawlign_fp score;
+    for (long q = q_from, k = curr; q <= q_to; ++q, ++k ) {
+        unsigned char move = (unsigned char) CodonAlignStringsStep <DO_AFFINE> ( score_matrix, reference, query_partials, query_codons, query_ambiguities, r, q, score_cols, k, row_stride, miscall_cost
+                                                                              , open_insertion, open_deletion, extend_insertion, extend_deletion
+                                                                              , cost_stride, insertion_matrix, deletion_matrix
+                                                                              , do_true_local, score );
+        if ( moves ) {
+            // the same tests as the affine backtrack would make on the full matrices
+            if ( DO_AFFINE ) {
+                if ( score_matrix[ k ] - open_deletion <= deletion_matrix[ k ] - extend_deletion ) {
+                    move |= HY_CODON_DELETION_CONTINUES;
+                }
+                if ( q >= 3 && score_matrix[ k ] - open_insertion <= insertion_matrix[ k ] - extend_insertion ) {
+                    move |= HY_CODON_INSERTION_CONTINUES;
+                }
+            }
+            moves[ q - q_from ] = move;
+        }
+    }
+}
+
+//____________________________________________________________________________________
+
+void CodonFillRow ( CodonReference const * const reference
+                  , int32_t const * const query_partials
+                  , int32_t const * const query_codons
+                  , cawlign_fp const * const * const query_ambiguities
+                  , const long r
+                  , const long q_from
+                  , const long q_to
+                  , const long score_cols
+                  , const long curr
+                  , const long row_stride
+                  , const cawlign_fp miscall_cost
+                  , const cawlign_fp open_insertion
+                  , const cawlign_fp extend_insertion
+                  , const cawlign_fp open_deletion
+                  , const cawlign_fp extend_deletion
+                  , const long cost_stride
+                  , const bool do_affine
+                  , const bool do_true_local
+                  , cawlign_fp * const score_matrix
+                  , cawlign_fp * const insertion_matrix
+                  , cawlign_fp * const deletion_matrix
+                  , unsigned char * const moves
+                  )
+{
+    SpecializeFlags ( do_affine, [&] ( auto affine ) {
+        CodonFillRowFlags <decltype ( affine )::value>
+            ( reference, query_partials, query_codons, query_ambiguities, r, q_from,
+              q_to, score_cols, curr, row_stride, miscall_cost, open_insertion,
+              extend_insertion, open_deletion, extend_deletion, cost_stride, do_true_local, score_matrix,
+              insertion_matrix, deletion_matrix, moves );
+    } );
+}
+
+//____________________________________________________________________________________
+
+extern const AlignmentKernel kernel = { AlignStringsSIMDName (), AlignStringsSIMDWidth (), AlignStringsDiffSIMDWidth (), AlignStringsInt16SIMDWidth ()
+                                      , &AlignStringsFillSIMD, &AlignStringsFillDiffSIMD, &AlignStringsFillInt16SIMD
+                                      , &CodonFillRow };
+
+}
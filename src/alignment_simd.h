@@ -0,0 +1,465 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef __ALIGNMENT_SIMD_HEADER_FILE__
+
+#define __ALIGNMENT_SIMD_HEADER_FILE__
+
+#include "alignment.h"
+
+/**
+    The following numerical codes define "moves" available to the algorithm working in codon space for pairwise alignment.
+    The first (reference( sequence (represented by ROWS in the dynamic programming matrix) is the "blessed" reference sequence, i.e. it's in frame (no stop codons, divisble by 3)
+    The second (query) sequence (represented by COLUMNS in the dynamic programming matrix) is the one being mapped to the reference, and it admits out-of-frame indels
+ 
+    The mnemonic for each macro is as follows
+        HY_XXX_YYY
+                Len (X) = Len (Y) = the number of characters output in the final alignment
+                Each '1' in the pattern corresponds to an actual alignment character being consumed from the input, and '0' - to a gap (indel)
+ 
+        For example, i.f the pattern is
+ 
+            HY_1101_1111, and the current context of the strings being aligned is
+ 
+        REF: ... AGTACA ...
+        QRY: ...AAGTACA...
+ 
+            then the output will receive
+        A-GT
+        AaGT
+            and the counter will advance 3 characters in the reference and 4 characters in the query
+ 
+*/
+
+
+#define HY_ALIGNMENT_TYPES_COUNT 24
+
+// match or skip whole codons
+#define HY_111_111 0
+#define HY_111_000 1
+#define HY_000_111 2
+
+// match 3 in the ref to 1 in the query
+#define HY_111_100 3
+#define HY_111_010 4
+#define HY_111_001 5
+
+#define HY_3X1_START 3
+#define HY_3X1_COUNT 3
+
+// match 3 in the ref to 2 in the query
+#define HY_111_110 6
+#define HY_111_101 7
+#define HY_111_011 8
+
+/** 
+ all operations consuming 3 chars in the reference and 2 in the query start with index 6 and there are 3 of them
+*/
+#define HY_3X2_START 6
+#define HY_3X2_COUNT 3
+
+// match 3 in the ref to 4 in the query
+#define HY_1110_1111 9
+#define HY_1101_1111 10
+#define HY_1011_1111 11
+#define HY_0111_1111 12
+
+/**
+ all operations consuming 3 chars in the reference and 4 in the query start with index 9 and there are 4 of them
+*/
+#define HY_3X4_START 9
+#define HY_3X4_COUNT 4
+
+// match 3 in the ref to 5 in the query
+
+#define HY_11100_11111 13
+#define HY_11010_11111 14
+#define HY_11001_11111 15
+#define HY_10110_11111 16
+#define HY_10101_11111 17
+#define HY_10011_11111 18
+#define HY_01110_11111 19
+#define HY_01101_11111 20
+#define HY_01011_11111 21
+#define HY_00111_11111 22
+
+/**
+ all operations consuming 3 chars in the reference and 5 in the query start with index 13 and there are 10 of them
+*/
+#define HY_3X5_START   13
+#define HY_3X5_COUNT   10
+
+
+// the local align move (i.e. take a direct shortcut to any internal position in the alignment matrix)
+
+#define HY_LOCAL_ALIGN_SHORTCUT 23
+
+#define HY_MAXIMUM_RESOLUTIONS  8
+
+/**
+ each cell of a codon DP matrix records the move that won it (one of the HY_ALIGNMENT_TYPES_COUNT operations, in the
+ low 5 bits), and, for affine gaps, whether a codon deletion / insertion ending in the cell extends an earlier one
+*/
+#define HY_CODON_MOVE_MASK           0x1F
+#define HY_CODON_DELETION_CONTINUES  0x20
+#define HY_CODON_INSERTION_CONTINUES 0x40
+
+/**
+ the partial codons which the 3x5, 3x4, 3x2 and 3x1 moves ending at a given query position take from the query
+ are stored (see CodonQueryCodes) as HY_QUERY_PARTIALS codes per position, starting at these offsets
+*/
+#define HY_QUERY_PARTIALS 16
+#define HY_QUERY_3X5      0
+#define HY_QUERY_3X4      10
+#define HY_QUERY_3X2      14
+#define HY_QUERY_3X1      15
+
+//____________________________________________________________________________________
+
+/**
+ * @name StoreTracebackCode, TracebackCode
+ * The float kernels (AlignStringsFillSIMD and the scalar fill in alignment.cpp) keep 4-bit traceback codes
+ * (same encoding as AlignStringsFillDiffSIMD), packed two to a byte: code k is stored in the low (k even) or the
+ * high (k odd) half of byte k / 2. The storage must be zeroed before any code is stored.
+ */
+
+inline void StoreTracebackCode ( unsigned char * traceback, const long k, const unsigned char code ) {
+    traceback [ k >> 1 ] |= code << ( ( k & 1 ) << 2 );
+}
+
+inline unsigned char TracebackCode ( const unsigned char * traceback, const long k ) {
+    return ( traceback [ k >> 1 ] >> ( ( k & 1 ) << 2 ) ) & 0x0F;
+}
+
+/**
+ * @name StoreTracebackCodes
+ * Stores the (unpacked) codes [0,n) as codes k, k+1, ..., k+n-1; none of these may have been stored before.
+ */
+
+inline void StoreTracebackCodes ( unsigned char * traceback, long k, const unsigned char * codes, long n ) {
+    if ( n > 0 && ( k & 1 ) ) {
+        StoreTracebackCode ( traceback, k++, *codes++ );
+        n--;
+    }
+    unsigned char * const packed = traceback + ( k >> 1 );
+    for (long p = 0; p + 1 < n; p += 2) {
+        packed [ p >> 1 ] = codes [ p ] | ( codes [ p + 1 ] << 4 );
+    }
+    if ( n & 1 ) {
+        packed [ n >> 1 ] = codes [ n - 1 ];
+    }
+}
+
+/**
+ * @name TracebackCodeBytes
+ * @return the number of bytes needed to store n packed traceback codes
+ */
+
+inline long TracebackCodeBytes ( const long n ) {
+    return ( n + 1 ) >> 1;
+}
+
+/**
+ * @name FillBlock
+ * Places the cells filled by one call of AlignStringsFillSIMD, AlignStringsFillDiffSIMD or AlignStringsFillInt16SIMD
+ * in a larger DP matrix (see FillBlocks in alignment.cpp): the strings and lengths passed to the kernel are then those
+ * of the block, and row_h, row_d, col_h and col_i are the scores of the row above and of the column to the left of the
+ * block (row_h [0] and col_h [0] being the cell above and to the left). A NULL block stands for the entire matrix.
+ */
+
+struct FillBlock {
+    // whether the first row (column) of the block is row (column) 1 of the matrix, whose deletions (insertions)
+    // extend the first row (column) at the cost of opening a gap
+    bool         first_row,
+                 first_column;
+    // (do_affine only) will receive the deletion scores in the last row (columns 1, ..., q_len) and the insertion
+    // scores in the last column (rows 1, ..., r_len) of the block; the difference kernel may store a larger value
+    // in place of a deletion (insertion) score which can not extend into the next row (column), i.e. any x with
+    // MAX (h - open, x - extend) == MAX (h - open, d - extend), where h and d are the scores of the cell
+    cawlign_fp * last_row_d,
+               * last_col_i;
+};
+
+/**
+ * @name AlignStringsFillSIMD
+ * Fills the (non-codon) DP matrix with a striped (Farrar) SIMD kernel, keeping only two rows of scores and
+ * recording the (packed, see StoreTracebackCode) traceback code of every cell. The scores are bit-for-bit identical
+ * to those of the scalar fill, and the codes are those which the backtrack would derive from the full matrices.
+ *
+ * Traceback code for cell (i,j), 1 <= i <= r_len, 1 <= j <= q_len is code number (i-1)*q_len + j-1
+ *
+ * @param row_h, row_d the first row (q_len + 1 values) of the score and deletion (if do_affine) matrices
+ * @param col_h, col_i the first column (r_len + 1 values) of the score and insertion (if do_affine) matrices
+ * @param traceback zeroed storage for r_len * q_len packed traceback codes (NULL if only the scores are needed)
+ * @param last_row will receive the scores in the last row of the DP matrix (q_len + 1 values)
+ * @param last_col will receive the scores in the last column of the DP matrix (r_len + 1 values)
+ * @param best_score, best_R, best_Q (do_true_local only) will receive the best score in rows and columns
+ *                                   1 and above, and the first cell (in row-major order) where it is found
+ * @param block the block of a larger DP matrix to fill (see FillBlock), or NULL for the entire matrix
+ * @return false if no SIMD instruction set was available at compile time (nothing is filled)
+ */
+
+bool AlignStringsFillSIMD ( char const * r_str
+                          , char const * q_str
+                          , const long r_len
+                          , const long q_len
+                          , long * char_map
+                          , const cawlign_fp * cost_matrix
+                          , const long cost_stride
+                          , const cawlign_fp open_insertion
+                          , const cawlign_fp extend_insertion
+                          , const cawlign_fp open_deletion
+                          , const cawlign_fp extend_deletion
+                          , const bool do_affine
+                          , const bool do_true_local
+                          , const cawlign_fp * row_h
+                          , const cawlign_fp * row_d
+                          , const cawlign_fp * col_h
+                          , const cawlign_fp * col_i
+                          , unsigned char * traceback
+                          , cawlign_fp * last_row
+                          , cawlign_fp * last_col
+                          , cawlign_fp & best_score
+                          , long & best_R
+                          , long & best_Q
+                          , const FillBlock * block = NULL
+                          );
+
+/**
+ * @name AlignStringsFillDiffSIMD
+ * Fills the (non-codon) DP matrix along anti-diagonals, keeping only the differences between adjacent cells
+ * (Suzuki-Kasahara / ksw2 formulation) as signed bytes, and records a traceback code for every cell.
+ * All scores and gap costs must be integers after multiplication by scale, and must be small enough that every
+ * difference fits into a signed byte (this is checked by the caller, see DifferenceKernelScale in alignment.cpp).
+ *
+ * Traceback code for cell (i,j), 1 <= i <= r_len, 1 <= j <= q_len is stored at traceback [diag_offset[i+j] + i];
+ *      bits 0-1 : the move used to enter the cell (0 : match, 1 : deletion, 2 : insertion), chosen with the same
+ *                 tie-breaking rules as the backtrack in AlignStrings (affine or not)
+ *      bit 2    : (do_affine only) score[i][j] - open_deletion <= deletion[i][j] - extend_deletion
+ *      bit 3    : (do_affine only) score[i][j] - open_insertion <= insertion[i][j] - extend_insertion
+ *
+ * @param row_h, row_d the first row (q_len + 1 values) of the score and deletion (if do_affine) matrices
+ * @param col_h, col_i the first column (r_len + 1 values) of the score and insertion (if do_affine) matrices
+ * @param traceback storage for r_len * q_len + AlignStringsDiffSIMDWidth() traceback codes (NULL if only the scores
+ *                  are needed)
+ * @param diag_offset storage for r_len + q_len + 1 diagonal offsets
+ * @param last_row will receive the (scaled) scores in the last row of the DP matrix (q_len + 1 values)
+ * @param last_col will receive the (scaled) scores in the last column of the DP matrix (r_len + 1 values)
+ * @param block the block of a larger DP matrix to fill (see FillBlock), or NULL for the entire matrix
+ * @return false if no SIMD instruction set was available at compile time (nothing is filled)
+ */
+
+bool AlignStringsFillDiffSIMD ( char const * r_str
+                              , char const * q_str
+                              , const long r_len
+                              , const long q_len
+                              , long * char_map
+                              , const cawlign_fp * cost_matrix
+                              , const long cost_stride
+                              , const long scale
+                              , const cawlign_fp open_insertion
+                              , const cawlign_fp extend_insertion
+                              , const cawlign_fp open_deletion
+                              , const cawlign_fp extend_deletion
+                              , const bool do_affine
+                              , const cawlign_fp * row_h
+                              , const cawlign_fp * row_d
+                              , const cawlign_fp * col_h
+                              , const cawlign_fp * col_i
+                              , unsigned char * traceback
+                              , long * diag_offset
+                              , long * last_row
+                              , long * last_col
+                              , const FillBlock * block = NULL
+                              );
+
+/**
+ * @name AlignStringsFillInt16SIMD
+ * Fills the (non-codon) DP matrix with a striped kernel using scaled 16-bit integer lanes (twice as many lanes as
+ * AlignStringsFillSIMD), recording the traceback code of every cell (same encoding as AlignStringsFillDiffSIMD).
+ * All scores and gap costs must be integers after multiplication by scale. If any DP value gets too close to
+ * the int16 limits for the saturating arithmetic to be exact, the kernel gives up and the caller must use floats.
+ *
+ * Traceback code for cell (i,j), 1 <= i <= r_len, 1 <= j <= q_len is stored at traceback [(i-1)*q_len + j-1]
+ *
+ * @param row_h, row_d the first row (q_len + 1 values) of the score and deletion (if do_affine) matrices
+ * @param col_h, col_i the first column (r_len + 1 values) of the score and insertion (if do_affine) matrices
+ * @param traceback storage for r_len * q_len traceback codes (NULL if only the scores are needed)
+ * @param last_row will receive the (scaled) scores in the last row of the DP matrix (q_len + 1 values)
+ * @param last_col will receive the (scaled) scores in the last column of the DP matrix (r_len + 1 values)
+ * @param best_score, best_R, best_Q (do_true_local only) will receive the best (scaled) score in rows and columns
+ *                                   1 and above, and the first cell (in row-major order) where it is found
+ * @param block the block of a larger DP matrix to fill (see FillBlock), or NULL for the entire matrix
+ * @return false if no SIMD instruction set was available at compile time, or if the scores did not fit into int16
+ */
+
+bool AlignStringsFillInt16SIMD ( char const * r_str
+                               , char const * q_str
+                               , const long r_len
+                               , const long q_len
+                               , long * char_map
+                               , const cawlign_fp * cost_matrix
+                               , const long cost_stride
+                               , const long scale
+                               , const cawlign_fp open_insertion
+                               , const cawlign_fp extend_insertion
+                               , const cawlign_fp open_deletion
+                               , const cawlign_fp extend_deletion
+                               , const bool do_affine
+                               , const bool do_true_local
+                               , const cawlign_fp * row_h
+                               , const cawlign_fp * row_d
+                               , const cawlign_fp * col_h
+                               , const cawlign_fp * col_i
+                               , unsigned char * traceback
+                               , long * last_row
+                               , long * last_col
+                               , long & best_score
+                               , long & best_R
+                               , long & best_Q
+                               , const FillBlock * block = NULL
+                               );
+
+/**
+ * @name AlignStringsDiffSIMDWidth
+ * @return the number of byte lanes used by AlignStringsFillDiffSIMD (0 if there is no SIMD support)
+ */
+
+long AlignStringsDiffSIMDWidth (void);
+
+/**
+ * @name AlignStringsInt16SIMDWidth
+ * @return the number of int16 lanes used by AlignStringsFillInt16SIMD (0 if there is no SIMD support)
+ */
+
+long AlignStringsInt16SIMDWidth (void);
+
+/**
+ * @name AlignStringsSIMDWidth
+ * @return the number of single precision lanes in the vectors used by the SIMD kernels (1 if scalar)
+ */
+
+long AlignStringsSIMDWidth (void);
+
+/**
+ * @name CodonFillRow
+ * Fills cells (r, q_from), ..., (r, q_to) of a codon DP matrix (r >= 1, q_from >= 1), one CodonAlignStringsStep at a time,
+ * and records the move code of every cell (see HY_CODON_MOVE_MASK): the winning move, and for affine gaps, whether
+ * a codon deletion / insertion ending in the cell extends an earlier one.
+ *
+ * @param reference, query_partials, query_codons, query_ambiguities the prepared strings (see CodonReference,
+ *        CodonQueryCodes and CodonQueryAmbiguities)
+ * @param r the row (reference codon) to fill
+ * @param q_from, q_to the first and the last column (query nucleotide) to fill
+ * @param score_cols the number of columns in the (full) DP matrix
+ * @param curr the index of cell (r, q_from) in the DP matrices; the other cells of the row follow it
+ * @param row_stride how far back the same column of the previous row is stored in the DP matrices
+ * @param moves receives the move code of cell (r, q_from + t) at moves [t] (may be NULL)
+ * @param other arguments are as in AlignStrings
+ */
+
+void CodonFillRow ( CodonReference const * const reference
+                  , int32_t const * const query_partials
+                  , int32_t const * const query_codons
+                  , cawlign_fp const * const * const query_ambiguities
+                  , const long r
+                  , const long q_from
+                  , const long q_to
+                  , const long score_cols
+                  , const long curr
+                  , const long row_stride
+                  , const cawlign_fp miscall_cost
+                  , const cawlign_fp open_insertion
+                  , const cawlign_fp extend_insertion
+                  , const cawlign_fp open_deletion
+                  , const cawlign_fp extend_deletion
+                  , const long cost_stride
+                  , const bool do_affine
+                  , const bool do_true_local
+                  , cawlign_fp * const score_matrix
+                  , cawlign_fp * const insertion_matrix
+                  , cawlign_fp * const deletion_matrix
+                  , unsigned char * const moves
+                  );
+
+/**
+ * @name AlignStringsSIMDName
+ * @return a short human readable name of the instruction set used by AlignStringsFillSIMD ("none" if scalar)
+ */
+
+const char * AlignStringsSIMDName (void);
+
+/**
+ * @name AlignmentKernel
+ * alignment_simd.cpp is compiled once for every instruction set in the kernel list (see CMakeLists.txt), each time
+ * into its own namespace; the kernels of one build are collected in this table, and the functions declared above
+ * forward to the table which was selected at startup (see SelectAlignmentKernel in alignment_dispatch.cpp)
+ */
+
+struct AlignmentKernel {
+    const char * name;
+    long         width,
+                 diff_width,
+                 int16_width;
+
+    decltype (&AlignStringsFillSIMD)      fill;
+    decltype (&AlignStringsFillDiffSIMD)  fill_diff;
+    decltype (&AlignStringsFillInt16SIMD) fill_int16;
+    decltype (&CodonFillRow)              codon_fill_row;
+};
+
+/**
+ * @name SelectAlignmentKernel
+ * Selects the kernels used for all subsequent alignments; by default (and for "auto"), the kernels for the widest
+ * instruction set which this CPU supports are used
+ *
+ * @param name the instruction set (as reported by AlignStringsSIMDName), or "auto"
+ * @return false if there are no kernels by that name, or this CPU does not support them (nothing is changed)
+ */
+
+bool SelectAlignmentKernel ( const char * name );
+
+/**
+ * @name AlignmentKernelNames
+ * @return the names of the kernels which this CPU supports (widest instruction set first, separated by commas)
+ */
+
+const char * AlignmentKernelNames (void);
+
+#endif
@@ -0,0 +1,366 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <limits.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "alignment_wfa.h"
+
+#define MAX_OP(a, b) ( (( a ) > ( b )) ? ( a ) : ( b ) )
+#define MIN_OP(a, b) ( (( a ) < ( b )) ? ( a ) : ( b ) )
+
+//____________________________________________________________________________________
+
+/**
+    Wavefronts are indexed by penalty (s) and diagonal (k = j - i, where i indexes the reference and j the query);
+    each stores the furthest reaching reference offset i on every diagonal, for the three states of the gap-affine
+    model: M (any move), I (ending with an insertion) and D (ending with a deletion).
+ 
+    Substitution penalties vary between character pairs, so the match state at penalty s is reached from the
+    match state at penalty s - p on the same diagonal only if the pair that follows it actually costs p.
+    The furthest reaching points still dominate all other points on the same diagonal with the same penalty,
+    because the cost of aligning the remaining suffixes never increases along a diagonal.
+*/
+
+namespace {
+    
+    const int32_t kNoOffset = INT32_MIN / 2;
+    
+    struct Wavefront {
+        long                 lo,
+                             hi;
+        std::vector<int32_t> m,
+                             ins,
+                             del;
+        
+        Wavefront (void) : lo (1), hi (0) {}
+        
+        static int32_t at ( const std::vector<int32_t> & v, const long lo, const long hi, const long k ) {
+            return ( v.empty () || k < lo || k > hi ) ? kNoOffset : v[ k - lo ];
+        }
+        
+        int32_t m_at   ( const long k ) const { return at ( m,   lo, hi, k ); }
+        int32_t ins_at ( const long k ) const { return at ( ins, lo, hi, k ); }
+        int32_t del_at ( const long k ) const { return at ( del, lo, hi, k ); }
+    };
+}
+
+//____________________________________________________________________________________
+
+long WavefrontAlign ( char const * r_str
+                    , char const * q_str
+                    , const long r_len
+                    , const long q_len
+                    , long * char_map
+                    , const long * penalties
+                    , const long stride
+                    , const long open_insertion
+                    , const long extend_insertion
+                    , const long open_deletion
+                    , const long extend_deletion
+                    , const long end_gap
+                    , const long max_cells
+                    , signed char * edit_ops
+                    , long & edit_ptr
+                    )
+{
+    // encode the strings as rows / columns of the penalty table
+    
+    std::vector<long> r_enc ( r_len ),
+                      q_enc ( q_len ),
+                      mismatch_penalties;
+    
+    for (long i = 0; i < r_len; ++i) {
+        r_enc[ i ] = ( char_map[ (unsigned char) r_str[ i ] ] + 1 ) * stride;
+    }
+    for (long j = 0; j < q_len; ++j) {
+        q_enc[ j ] = char_map[ (unsigned char) q_str[ j ] ] + 1;
+    }
+    
+    for (long c = 0; c < stride * stride; ++c) {
+        const long p = penalties[ c ];
+        bool seen = p <= 0;
+        for (long known : mismatch_penalties) {
+            seen = seen || known == p;
+        }
+        if ( ! seen ) {
+            mismatch_penalties.push_back ( p );
+        }
+    }
+    
+    auto penalty = [&] ( const long i, const long k ) -> long {
+        return penalties[ r_enc[ i ] + q_enc[ i + k ] ];
+    };
+    
+    // prefix gaps: in ends-free mode every (i,0) and (0,j) cell is a starting point, at penalty end_gap * (i or j)
+    
+    auto seed = [&] ( const long s, const long k ) -> int32_t {
+        if ( end_gap < 0 ) {
+            return s == 0 && k == 0 ? 0 : kNoOffset;
+        }
+        const long t = k < 0 ? -k : k;
+        return ( s == end_gap * t ) ? ( k < 0 ? t : 0 ) : kNoOffset;
+    };
+    
+    std::vector<Wavefront> fronts;
+    
+    auto front = [&] ( const long s ) -> const Wavefront * {
+        return ( s >= 0 && s < (long) fronts.size () && fronts[ s ].lo <= fronts[ s ].hi ) ? & fronts[ s ] : nullptr;
+    };
+    
+    const long k_end = q_len - r_len;
+    
+    long cells      = 0,
+         best_total = LONG_MAX,
+         best_s     = -1,
+         best_k     = 0,
+         best_i     = 0;
+    
+    for (long s = 0; best_total > s - 1; ++s) {
+        // (added first, so that the pointers to earlier wavefronts stay valid)
+        fronts.push_back ( Wavefront () );
+        
+        const Wavefront * const ins_open  = front ( s - open_insertion - extend_insertion ),
+                        * const ins_ext   = front ( s - extend_insertion ),
+                        * const del_open  = front ( s - open_deletion - extend_deletion ),
+                        * const del_ext   = front ( s - extend_deletion );
+        
+        long lo = LONG_MAX,
+             hi = LONG_MIN;
+        
+        for (long p : mismatch_penalties) {
+            if ( const Wavefront * const f = front ( s - p ) ) {
+                lo = MIN_OP ( lo, f->lo );
+                hi = MAX_OP ( hi, f->hi );
+            }
+        }
+        if ( ins_open ) { lo = MIN_OP ( lo, ins_open->lo + 1 ); hi = MAX_OP ( hi, ins_open->hi + 1 ); }
+        if ( ins_ext && ! ins_ext->ins.empty () ) { lo = MIN_OP ( lo, ins_ext->lo + 1 ); hi = MAX_OP ( hi, ins_ext->hi + 1 ); }
+        if ( del_open ) { lo = MIN_OP ( lo, del_open->lo - 1 ); hi = MAX_OP ( hi, del_open->hi - 1 ); }
+        if ( del_ext && ! del_ext->del.empty () ) { lo = MIN_OP ( lo, del_ext->lo - 1 ); hi = MAX_OP ( hi, del_ext->hi - 1 ); }
+        
+        if ( end_gap < 0 ) {
+            if ( s == 0 ) {
+                lo = MIN_OP ( lo, 0 );
+                hi = MAX_OP ( hi, 0 );
+            }
+        } else if ( end_gap == 0 ) {
+            if ( s == 0 ) {
+                lo = -r_len;
+                hi = q_len;
+            }
+        } else if ( s % end_gap == 0 ) {
+            const long t = s / end_gap;
+            if ( t <= r_len ) { lo = MIN_OP ( lo, -t ); hi = MAX_OP ( hi, -t ); }
+            if ( t <= q_len ) { lo = MIN_OP ( lo,  t ); hi = MAX_OP ( hi,  t ); }
+        }
+        
+        lo = MAX_OP ( lo, -r_len );
+        hi = MIN_OP ( hi,  q_len );
+        
+        if ( lo > hi ) {
+            continue;
+        }
+        
+        cells += hi - lo + 1;
+        if ( cells > max_cells ) {
+            return -1;
+        }
+        
+        Wavefront & w = fronts.back ();
+        w.lo = lo;
+        w.hi = hi;
+        w.m.assign ( hi - lo + 1, kNoOffset );
+        if ( ins_open || ins_ext ) {
+            w.ins.assign ( hi - lo + 1, kNoOffset );
+        }
+        if ( del_open || del_ext ) {
+            w.del.assign ( hi - lo + 1, kNoOffset );
+        }
+        
+        for (long k = lo; k <= hi; ++k) {
+            int32_t best = kNoOffset;
+            
+            if ( ! w.ins.empty () ) {
+                int32_t ins = MAX_OP ( ins_open ? ins_open->m_at ( k - 1 ) : kNoOffset, ins_ext ? ins_ext->ins_at ( k - 1 ) : kNoOffset );
+                if ( ins + k > q_len ) {
+                    ins = kNoOffset;
+                }
+                w.ins[ k - lo ] = ins;
+                best = ins;
+            }
+            
+            if ( ! w.del.empty () ) {
+                int32_t del = MAX_OP ( del_open ? del_open->m_at ( k + 1 ) : kNoOffset, del_ext ? del_ext->del_at ( k + 1 ) : kNoOffset ) + 1;
+                if ( del > r_len || del <= kNoOffset + 1 ) {
+                    del = kNoOffset;
+                }
+                w.del[ k - lo ] = del;
+                best = MAX_OP ( best, del );
+            }
+            
+            for (long p : mismatch_penalties) {
+                if ( const Wavefront * const f = front ( s - p ) ) {
+                    const int32_t from = f->m_at ( k );
+                    if ( from >= 0 && from < r_len && from + k < q_len && penalty ( from, k ) == p ) {
+                        best = MAX_OP ( best, from + 1 );
+                    }
+                }
+            }
+            
+            best = MAX_OP ( best, seed ( s, k ) );
+            
+            if ( best < 0 ) {
+                continue;
+            }
+            
+            // follow the free pairs along the diagonal
+            while ( best < r_len && best + k < q_len && penalty ( best, k ) == 0 ) {
+                ++best;
+            }
+            
+            w.m[ k - lo ] = best;
+            
+            if ( end_gap < 0 ) {
+                if ( k == k_end && best == r_len && best_s < 0 ) {
+                    best_total = s;
+                    best_s = s;
+                    best_k = k;
+                    best_i = best;
+                }
+            } else if ( best == r_len || best + k == q_len ) {
+                const long total = s + end_gap * ( ( r_len - best ) + ( q_len - best - k ) );
+                if ( total < best_total ) {
+                    best_total = total;
+                    best_s = s;
+                    best_k = k;
+                    best_i = best;
+                }
+            }
+        }
+    }
+    
+    // backtrack from the end cell
+    
+    edit_ptr = 0;
+    
+    for (long i = best_i; i < r_len; ++i) {
+        edit_ops[ edit_ptr++ ] = -1;
+    }
+    for (long j = best_i + best_k; j < q_len; ++j) {
+        edit_ops[ edit_ptr++ ] = 1;
+    }
+    
+    enum { kMatch, kInsertion, kDeletion } state = kMatch;
+    
+    long s = best_s,
+         k = best_k,
+         i = best_i;
+    
+    while ( true ) {
+        if ( state == kMatch ) {
+            const Wavefront & w = fronts[ s ];
+            
+            int32_t from = MAX_OP ( w.ins_at ( k ), w.del_at ( k ) ),
+                    mismatch = kNoOffset;
+            long    mismatch_penalty = 0;
+            
+            for (long p : mismatch_penalties) {
+                if ( const Wavefront * const f = front ( s - p ) ) {
+                    const int32_t prev = f->m_at ( k );
+                    if ( prev >= 0 && prev < r_len && prev + k < q_len && penalty ( prev, k ) == p && prev + 1 > mismatch ) {
+                        mismatch = prev + 1;
+                        mismatch_penalty = p;
+                    }
+                }
+            }
+            
+            const int32_t start = seed ( s, k );
+            from = MAX_OP ( MAX_OP ( from, mismatch ), start );
+            
+            for (; i > from; --i) {
+                edit_ops[ edit_ptr++ ] = 0;
+            }
+            
+            if ( mismatch == from ) {
+                edit_ops[ edit_ptr++ ] = 0;
+                s -= mismatch_penalty;
+                --i;
+            } else if ( w.del_at ( k ) == from ) {
+                state = kDeletion;
+            } else if ( w.ins_at ( k ) == from ) {
+                state = kInsertion;
+            } else {
+                // reached the start (a prefix gap in ends-free mode)
+                for (long t = i; t > 0; --t) {
+                    edit_ops[ edit_ptr++ ] = -1;
+                }
+                for (long t = i + k; t > 0; --t) {
+                    edit_ops[ edit_ptr++ ] = 1;
+                }
+                break;
+            }
+        } else if ( state == kDeletion ) {
+            edit_ops[ edit_ptr++ ] = -1;
+            const Wavefront * const f = front ( s - open_deletion - extend_deletion );
+            if ( f && f->m_at ( k + 1 ) + 1 == i ) {
+                state = kMatch;
+                s -= open_deletion + extend_deletion;
+            } else {
+                s -= extend_deletion;
+            }
+            --i;
+            ++k;
+        } else {
+            edit_ops[ edit_ptr++ ] = 1;
+            const Wavefront * const f = front ( s - open_insertion - extend_insertion );
+            if ( f && f->m_at ( k - 1 ) == i ) {
+                state = kMatch;
+                s -= open_insertion + extend_insertion;
+            } else {
+                s -= extend_insertion;
+            }
+            --k;
+        }
+    }
+    
+    return best_total;
+}
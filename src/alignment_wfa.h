@@ -0,0 +1,83 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef __ALIGNMENT_WFA_HEADER_FILE__
+
+#define __ALIGNMENT_WFA_HEADER_FILE__
+
+#include "alignment.h"
+
+/**
+ * @name WavefrontAlign
+ * Computes an optimal (minimum penalty) alignment of two (non-codon) strings with the gap-affine wavefront
+ * algorithm (WFA); the work grows with the penalty of the alignment rather than with r_len * q_len.
+ *
+ * Penalties are non-negative integers; pairs with penalty 0 are "free" and extended along the diagonals.
+ * A gap of length L costs open + L * extend (extend > 0).
+ *
+ * @param penalties substitution penalties, indexed by [(r_code + 1) * stride + (q_code + 1)], where codes are
+ *                  looked up in char_map (-1 for characters which are not in the alphabet)
+ * @param stride the number of codes + 1
+ * @param end_gap the penalty for each character of a prefix or suffix gap (ends-free alignment),
+ *                or -1 if prefix and suffix gaps are scored as all other gaps (global alignment)
+ * @param max_cells the maximum number of wavefront cells to compute before giving up
+ * @param edit_ops will receive the edit operations (last one first, 0 : match, -1 : deletion, 1 : insertion);
+ *                 must have room for r_len + q_len operations
+ * @param edit_ptr will receive the number of edit operations
+ * @return the penalty of the alignment, or -1 if max_cells was exceeded (nothing is returned in edit_ops)
+ */
+
+long WavefrontAlign ( char const * r_str
+                    , char const * q_str
+                    , const long r_len
+                    , const long q_len
+                    , long * char_map
+                    , const long * penalties
+                    , const long stride
+                    , const long open_insertion
+                    , const long extend_insertion
+                    , const long open_deletion
+                    , const long extend_deletion
+                    , const long end_gap
+                    , const long max_cells
+                    , signed char * edit_ops
+                    , long & edit_ptr
+                    );
+
+#endif
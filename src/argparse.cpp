@@ -7,11 +7,17 @@
 #include <cctype>
 #include <fstream>
 
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
 using namespace std;
 
 #include "argparse.hpp"
 #include "stringBuffer.h"
 #include "configparser.hpp"
+#include "alignment.h"
+#include "alignment_simd.h"
 
 
 // some crazy shit for stringifying preprocessor directives
@@ -33,6 +39,15 @@ const char usage[] =
 "[-q] "
 "[-I] "
 "[-R] "
+"[--kernel KERNEL] "
+"[--tile-size COLUMNS] "
+"[--dedup] "
+"[--counts COUNTS] "
+"[--cache DIR] "
+"[--cache-size MB] "
+"[--verify-cache] "
+"[--index] "
+"[--previous PREVIOUS] "
 "[FASTA]\n";
 
 const char help_msg[] =
@@ -40,7 +55,7 @@ const char help_msg[] =
 "\n"
 "optional arguments:\n"
 "  -h, --help               show this help message and exit\n"
-"  -v, --version            show " TO_STR (PROGNAME) " version \n"
+"  -v, --version            show " TO_STR (PROGNAME) " version and the alignment kernel in use\n"
 "  -o OUTPUT                direct the output to a file named OUTPUT (default=stdout)\n"
 "  -r REFERENCE             read the reference sequence from this file (default=" TO_STR (DEFAULT_REFERENCE)")\n"
 "                           first checks to see if the filepath exists, if not looks inside the res/references directory\n"
@@ -59,6 +74,7 @@ const char help_msg[] =
 "                           silent     : align both the sequence and its rc to the reference, select the one with the highest score and report it;\n"
 "                           annotated  : align both the sequence and its rc to the reference, select the one with the highest score and report it\n"
 "                                        annotate sequences whose reverse complements were reported in the FASTA by appending '|RC' to the sequence name;\n"
+"                           (a sequence whose k-mers clearly match one strand of the reference is only aligned on that strand)\n"
 "  -l LOCAL_ALIGNMENT       global/local alignment (default=" TO_STR (DEFAULT_LOCAL_TYPE)")\n"
 "                           global : full string alignment; all gaps in the alignments are scored the same\n"
 "                           local  : partial string local (smith-waterman type) alignment which maximizes the alignment score\n"
@@ -71,9 +87,34 @@ const char help_msg[] =
 "  -S SPACE                 which version of the algorithm to use (an integer >0, default=" TO_STR( DEFAULT_SPACE ) "):\n"
 "                           quadratic : build the entire dynamic programming matrix (NxM);\n"
 "                           linear    : use the divide and conquer recursion to keep only 6 columns in memory (~ max (N,M));\n"
-"                                       NOT IMPLEMENTED FOR CODON DATA\n"
+"                                       for codon data, keep ~sqrt (N/3) rows of the matrix and recompute the rest (~2x slower)\n"
+"                           wavefront : use the wavefront algorithm, whose cost grows with the divergence between the sequences\n"
+"                                       (fast for highly similar sequences); falls back to quadratic for divergent sequences,\n"
+"                                       local (-l local) alignments, and non-integer scores; NOT IMPLEMENTED FOR CODON DATA\n"
+"                           banded    : fill only a band of diagonals, widened until the result is provably the same as quadratic;\n"
+"                                       fast for sequences with few and short indels; falls back to quadratic otherwise,\n"
+"                                       and for local (-l local) alignments; for codon data, the band follows the diagonal with\n"
+"                                       the most amino-acid k-mer matches, and is widened while the alignment runs near its edge\n"
+"                                       (a heuristic: may differ from quadratic)\n"
 "  -a                       do NOT use affine gap scoring (use by default)\n"
 "  -I                       write out the reference sequence for refmap and refalign output options (default = no) \n"
+"  --kernel KERNEL          the instruction set of the alignment kernels (default=auto: the widest one this CPU supports)\n"
+"                           auto, avx512bw, avx2, sse4.1, sse2 (x86-64 builds)\n"
+"  --tile-size COLUMNS      fill codon DP matrices in tiles this many query positions wide, which stay in cache\n"
+"                           (default=" TO_STR( DEFAULT_TILE_COLUMNS ) "; 0 = fill entire rows)\n"
+"  --dedup                  align each distinct sequence once, and report its alignment under the name of every copy\n"
+"                           (the alignments of all distinct sequences are kept in memory)\n"
+"  --counts COUNTS          write the name of the first copy of each distinct sequence and its number of copies\n"
+"                           (tab separated) to the file COUNTS; implies --dedup\n"
+"  --cache DIR              keep the alignments of queries in the directory DIR (created if needed), and reuse them in later runs\n"
+"                           with the same reference, scoring and options (instead of aligning the queries again)\n"
+"  --cache-size MB          remove the least recently used alignments once the cache is larger than this (default=" TO_STR( DEFAULT_CACHE_SIZE ) ")\n"
+"  --verify-cache           align all queries, and check (and replace) the alignments in the cache that do not match\n"
+"  --index                  write an index of the records to OUTPUT.idx, so that a later run can reuse them with --previous\n"
+"                           (refmap and refalign output to a file only)\n"
+"  --previous PREVIOUS      copy the records of queries with the same name and sequence from PREVIOUS, the indexed output of\n"
+"                           an earlier run with the same reference, scoring and options, and align only the new or changed\n"
+"                           queries; PREVIOUS must not be OUTPUT (implies --index when the output is a file)\n"
 "  FASTA                    read sequences to compare from this file (default=stdin)\n";
 
     inline
@@ -86,7 +127,7 @@ const char help_msg[] =
     inline
     void version()
     {
-        fprintf( stderr, "%s\n", VERSION_NUMBER);
+        fprintf( stderr, "%s\nkernel: %s\n", VERSION_NUMBER, AlignStringsSIMDName ());
         exit( 0 );
     }
 
@@ -212,20 +253,45 @@ const char help_msg[] =
     quiet (false),
     affine (true),
     include_reference (false),
+    dedup (false),
+    counts (nullptr),
+    cache_directory (nullptr),
+    cache_size (DEFAULT_CACHE_SIZE),
+    verify_cache (false),
+    write_index (false),
+    previous_output (nullptr),
+    output_path (nullptr),
     memory_ref(nullptr){
+        // -v reports the kernel selected by --kernel, wherever that appears
+        bool show_version = false;
+        // the output is truncated as soon as -o is parsed, so it is checked against --previous (wherever that appears) first
+        for (int i = 1; i < argc - 1; ++i ) {
+            if ( !strcmp( argv[i], "--previous" ) ) {
+                previous_output = argv[i+1];
+            }
+        }
         // skip arg[0], it's just the program name
         for (int i = 1; i < argc; ++i ) {
             const char * arg = argv[i];
             
             if ( arg[0] == '-' && arg[1] == '-' ) {
                 if ( !strcmp( &arg[2], "help" ) ) help();
-                else if ( !strcmp( &arg[2], "version" ) ) version();
+                else if ( !strcmp( &arg[2], "version" ) ) show_version = true;
+                else if ( !strcmp( &arg[2], "kernel" ) ) parse_kernel ( next_arg (i, argc, argv) );
+                else if ( !strcmp( &arg[2], "tile-size" ) ) parse_tile_size ( next_arg (i, argc, argv) );
+                else if ( !strcmp( &arg[2], "dedup" ) ) parse_dedup ();
+                else if ( !strcmp( &arg[2], "counts" ) ) parse_counts ( next_arg (i, argc, argv) );
+                else if ( !strcmp( &arg[2], "cache" ) ) parse_cache ( next_arg (i, argc, argv) );
+                else if ( !strcmp( &arg[2], "cache-size" ) ) parse_cache_size ( next_arg (i, argc, argv) );
+                else if ( !strcmp( &arg[2], "verify-cache" ) ) parse_verify_cache ();
+                else if ( !strcmp( &arg[2], "index" ) ) parse_index ();
+                else if ( !strcmp( &arg[2], "previous" ) ) parse_previous ( next_arg (i, argc, argv) );
                 else
                     ERROR( "unknown argument: %s", arg );
             }
             else if ( arg[0] == '-' ) {
                 if ( !strcmp( &arg[1], "h" ) ) help();
-                else if (  arg[1] == 'v' ) version();
+                else if (  arg[1] == 'v' ) show_version = true;
                 else if (  arg[1] == 'o' ) parse_output ( next_arg (i, argc, argv) );
                 else if (  arg[1] == 'r' ) parse_reference ( next_arg (i, argc, argv) );
                 else if (  arg[1] == 's')  parse_scores( next_arg (i, argc, argv) );
@@ -247,9 +313,21 @@ const char help_msg[] =
                     ERROR( "unknown argument: %s", arg );
                 }
         }
+        if ( show_version ) {
+            version();
+        }
         if ( !reference ) {
             parse_reference ( DEFAULT_REFERENCE );
         }
+        if ( ( write_index || previous_output ) && out_format == pairwise ) {
+            ERROR( "--index and --previous need the refmap or refalign output format" );
+        }
+        if ( previous_output && output != stdout ) {
+            write_index = true;
+        }
+        if ( write_index && output == stdout ) {
+            ERROR( "--index needs an OUTPUT file (-o)" );
+        }
     }
 
     /**
@@ -266,6 +344,9 @@ const char help_msg[] =
         if ( reference )
             fclose (reference);
         
+        if ( counts )
+            fclose (counts);
+        
         if ( scores ) {
             delete scores;
         }
@@ -283,10 +364,21 @@ const char help_msg[] =
      */
     void args_t::parse_output( const char * str )
     {
-        if ( str && strcmp( str, "-" ) )
+        if ( str && strcmp( str, "-" ) ) {
+            struct stat output_info,
+                        previous_info;
+            
+            if ( previous_output && stat( str, &output_info ) == 0 && stat( previous_output, &previous_info ) == 0
+                 && output_info.st_dev == previous_info.st_dev && output_info.st_ino == previous_info.st_ino )
+                ERROR( "the OUTPUT file can not be the PREVIOUS output: %s", str );
+            
             output = fopen( str, "wb" );
-        else
+            output_path = str;
+        }
+        else {
             output = stdout;
+            output_path = nullptr;
+        }
         
         if ( !output )
             ERROR( "failed to open the OUTPUT file %s", str );
@@ -354,7 +446,7 @@ const char help_msg[] =
 
     /**
      * Parses the space type from a command-line argument.
-     * Valid options are "linear" or "quadratic".
+     * Valid options are "linear", "quadratic", "wavefront" or "banded".
      *
      * @param str The space type argument.
      */
@@ -363,6 +455,10 @@ const char help_msg[] =
             space_type = linear;
         } else if (!strcmp (str, "quadratic")) {
             space_type = quadratic;
+        } else if (!strcmp (str, "wavefront")) {
+            space_type = wavefront;
+        } else if (!strcmp (str, "banded")) {
+            space_type = banded;
         } else  {
             ERROR( "invalid algorithm type: %s", str );
         }
@@ -440,6 +536,109 @@ const char help_msg[] =
         }
     }
 
+    /**
+     * Selects the alignment kernels from a command-line argument.
+     * Valid options are "auto" or the name of an instruction set which this CPU supports.
+     *
+     * @param str The kernel argument.
+     */
+    void args_t::parse_kernel( const char * str ) {
+        if ( !SelectAlignmentKernel ( str ) ) {
+            ERROR( "invalid (or unsupported by this CPU) kernel: %s; available kernels: auto, %s", str, AlignmentKernelNames () );
+        }
+    }
+
+    /**
+     * Sets the width of the tiles in which codon DP matrices are filled from a command-line argument.
+     * Valid options are non-negative integers (0 fills entire rows).
+     *
+     * @param str The tile size argument.
+     */
+    void args_t::parse_tile_size( const char * str ) {
+        char * end;
+        const long columns = strtol ( str, &end, 10 );
+        if ( end == str || *end || columns < 0 ) {
+            ERROR( "invalid tile size (a non-negative integer is expected): %s", str );
+        }
+        SetAlignmentTileSize ( columns );
+    }
+
+    /**
+     * Enables the alignment of each distinct query sequence only once.
+     */
+    void args_t::parse_dedup() {
+        dedup = true;
+    }
+
+    /**
+     * Opens the file which receives the number of copies of each distinct query sequence; enables dedup.
+     *
+     * @param str The path to the counts file.
+     */
+    void args_t::parse_counts( const char * str ) {
+        counts = fopen( str, "wb" );
+        
+        if ( !counts )
+            ERROR( "failed to open the COUNTS file %s", str );
+        
+        dedup = true;
+    }
+
+    /**
+     * Sets the directory of the alignment cache from a command-line argument, and creates it if needed.
+     *
+     * @param str The path to the cache directory.
+     */
+    void args_t::parse_cache( const char * str ) {
+        struct stat info;
+        
+        if ( mkdir( str, 0777 ) != 0 && errno != EEXIST )
+            ERROR( "failed to create the cache directory %s", str );
+        
+        if ( stat( str, &info ) != 0 || !S_ISDIR( info.st_mode ) )
+            ERROR( "the cache path is not a directory: %s", str );
+        
+        cache_directory = str;
+    }
+
+    /**
+     * Sets the size limit (in megabytes) of the alignment cache from a command-line argument.
+     * Valid options are non-negative integers.
+     *
+     * @param str The cache size argument.
+     */
+    void args_t::parse_cache_size( const char * str ) {
+        char * end;
+        const long megabytes = strtol ( str, &end, 10 );
+        if ( end == str || *end || megabytes < 0 ) {
+            ERROR( "invalid cache size (a non-negative integer is expected): %s", str );
+        }
+        cache_size = megabytes;
+    }
+
+    /**
+     * Enables checking the alignments in the cache against new alignments.
+     */
+    void args_t::parse_verify_cache() {
+        verify_cache = true;
+    }
+
+    /**
+     * Enables writing an index of the output, which later runs can reuse (see parse_previous).
+     */
+    void args_t::parse_index() {
+        write_index = true;
+    }
+
+    /**
+     * Sets the (indexed) output of an earlier run, whose records are reused for unchanged queries.
+     *
+     * @param str The path to the earlier output.
+     */
+    void args_t::parse_previous( const char * str ) {
+        previous_output = str;
+    }
+
     /**
      * Enables the inclusion of the reference file in the output.
      */
@@ -14,6 +14,7 @@
 #define DEFAULT_LOCAL_TYPE       trim
 #define DEFAULT_OUTPUT_FORMAT    refmap
 #define DEFAULT_RC_TYPE          none
+#define DEFAULT_CACHE_SIZE       4096
 
 #include "stringBuffer.h"
 
@@ -45,7 +46,9 @@ namespace argparse
 
     enum space_t {
         quadratic,
-        linear
+        linear,
+        wavefront,
+        banded
     };
 
     enum out_format_t {
@@ -78,6 +81,14 @@ namespace argparse
         bool            quiet;
         bool            affine;
         bool            include_reference;
+        bool            dedup;
+        FILE            * counts;
+        const char      * cache_directory;
+        unsigned long   cache_size;
+        bool            verify_cache;
+        bool            write_index;
+        const char      * previous_output,
+                        * output_path;
        
        StringBuffer*   memory_ref;
         
@@ -98,6 +109,15 @@ namespace argparse
         void parse_data_t       ( const char * );
         void parse_local_t      ( const char * );
         void parse_out_format_t ( const char * );
+        void parse_kernel       ( const char * );
+        void parse_tile_size    ( const char * );
+        void parse_dedup        ( void );
+        void parse_counts       ( const char * );
+        void parse_cache        ( const char * );
+        void parse_cache_size   ( const char * );
+        void parse_verify_cache ( void );
+        void parse_index        ( void );
+        void parse_previous     ( const char * );
 
     };
 
@@ -1,8 +1,14 @@
 
 #include <iostream>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "argparse.hpp"
 #include "tn93_shared.h"
 #include "alignment.h"
+#include "alignment_cache.h"
+#include "output_index.h"
 #include "scoring.hpp"
 
 #ifdef _OPENMP
@@ -15,6 +21,53 @@ using namespace argparse;
 const char      rc_tag []   = "|RC";
 const char      empty_tag[] = "";
 
+/**
+ * A distinct query sequence (with --dedup): only its first copy is aligned, and the alignment is reported
+ * again under the names of the other copies.
+ */
+struct DistinctQuery {
+    std::string   first_name;
+    // the name of the first copy
+    long          copies  = 1;
+    bool          aligned = false;
+    // set once the alignment (below) of the first copy is stored
+    char        * aligned_ref = nullptr,
+                * aligned_qry = nullptr;
+    const char  * tag = empty_tag;
+    std::vector <std::string> pending;
+    // the names of copies read (by other threads) while the first copy was being aligned
+    bool          claimed = true;
+    // false while every copy has been reused from the previous output (--previous), so that the next copy is aligned
+    uint64_t      content = 0;
+    // the hash of the sequence (see ContentHash), with --index
+};
+
+/**
+ * What is done with a query once it has been read (see register_query).
+ */
+enum query_action_t {
+    align_query,
+    // align the query
+    copy_stored,
+    // (with --dedup) report the stored alignment of the first copy of its sequence again
+    copy_pending,
+    // (with --dedup) nothing; the thread aligning the first copy of its sequence reports it
+    copy_previous
+    // (with --previous) copy its record from the previous output
+};
+
+/**
+ * @return a copy of a (possibly null) string, allocated with new []
+ */
+static char * copy_string (const char * str) {
+    if (!str) {
+        return nullptr;
+    }
+    char * copy = new char [strlen (str) + 1];
+    strcpy (copy, str);
+    return copy;
+}
+
 
 
 //---------------------------------------------------------------
@@ -85,6 +138,9 @@ int main (int argc, const char * argv[]) {
     
     referenceSequenceLength++;
     
+    // the reference codons and their rows of the codon scoring tables, prepared once and shared by all the threads
+    CodonReference* codonReference = nullptr;
+    
     if (args.data_type == codon) {
         CawalignCodonScores* scores = (CawalignCodonScores*)alignmentScoring;
         if (referenceSequenceLength % 3 != 0) {
@@ -99,22 +155,261 @@ int main (int argc, const char * argv[]) {
                 }
             }
         }
+        codonReference = new CodonReference (refSequence.getString(), referenceSequenceLength, alignmentScoring->char_map,
+                                             alignmentScoring->scoring_matrix.values(), alignmentScoring->D+1, 4,
+                                             scores->s3x2.values(), scores->s3x1.values());
+    }
+    
+    // the k-mers of the reference, which decide the strand of most queries without aligning both (see QueryStrand)
+    StrandIndex* strandIndex = nullptr;
+    
+    if (args.reverse_complement != none) {
+        strandIndex = new StrandIndex (refSequence.getString(), referenceSequenceLength);
+    }
+    
+    // a hash of everything other than the queries that the alignments depend on: the alignments of a query in the
+    // cache (--cache) or in a previous output (--previous) are reused only if it has not changed
+    uint64_t run_settings = HASH_BASIS;
+    
+    auto add_setting = [&] (const void * data, const size_t bytes) {
+        run_settings = HashSetting (run_settings, data, bytes);
+    };
+    
+    const long       options [] = {args.data_type, args.local_option, args.space_type, args.out_format, args.reverse_complement, args.affine};
+    const cawlign_fp gaps    [] = {alignmentScoring->open_gap_reference, alignmentScoring->extend_gap_reference,
+                                   alignmentScoring->open_gap_query, alignmentScoring->extend_gap_query};
+    
+#ifdef VERSION_NUMBER
+    add_setting (VERSION_NUMBER, strlen (VERSION_NUMBER));
+#endif
+    add_setting (refSequence.getString(), refSequence.length());
+    add_setting (&alignmentScoring->gap_char, sizeof alignmentScoring->gap_char);
+    add_setting (options, sizeof options);
+    add_setting (gaps, sizeof gaps);
+    add_setting (alignmentScoring->alphabet.getString(), alignmentScoring->alphabet.length());
+    add_setting (alignmentScoring->scoring_matrix.values(), sizeof (cawlign_fp) * alignmentScoring->scoring_matrix.length());
+    
+    if (args.data_type == codon) {
+        CawalignCodonScores* scores = (CawalignCodonScores*)alignmentScoring;
+        const cawlign_fp codon_costs [] = {scores->frameshift_cost, scores->synonymous_penalty};
+        
+        add_setting (codon_costs, sizeof codon_costs);
+        add_setting (scores->s3x2.values(), sizeof (cawlign_fp) * scores->s3x2.length());
+        add_setting (scores->s3x1.values(), sizeof (cawlign_fp) * scores->s3x1.length());
+        add_setting (scores->translation_table.rvalues(), sizeof (long) * scores->translation_table.length());
+        add_setting (scores->resolutions.rvalues(), sizeof (long) * scores->resolutions.length());
+    }
+    
+    // with --cache, the alignments of earlier runs, keyed by the query and the settings
+    AlignmentCache* alignmentCache = nullptr;
+    
+    if (args.cache_directory) {
+        alignmentCache = new AlignmentCache (args.cache_directory, args.cache_size << 20, args.verify_cache,
+                                             refSequence.getString(), alignmentScoring->gap_char, run_settings);
+    }
+    
+    // with --previous, the output of an earlier run (and its index); the records of unchanged queries are copied from it
+    PreviousOutput* previousOutput = nullptr;
+    
+    if (args.previous_output) {
+        previousOutput = new PreviousOutput (args.previous_output, run_settings);
+        if (!previousOutput->Usable()) {
+            cerr << "The previous output " << args.previous_output << " was made with other settings; all the queries will be aligned" << endl;
+            delete previousOutput;
+            previousOutput = nullptr;
+        }
     }
+    
+    // with --index, where each record of the output is, and the hash of its query (see OutputIndex)
+    OutputIndex* outputIndex = nullptr;
+    
+    if (args.write_index) {
+        outputIndex = new OutputIndex (args.output_path, run_settings);
+    }
+    
+    // the hash of the query sequences (as read) is only needed to compare them with, or to index, previous outputs
+    const bool hash_queries = previousOutput || outputIndex;
  
     long sequences_read    = 0,
-         sequences_written = 0;
-        
+         sequences_written = 0,
+         sequences_reused  = 0;
     
     automatonState = 0;
     fasta_result   = 2;
     
+    // with --dedup, the distinct query sequences (as read, before any reverse complementation), in input order
+    std::unordered_map <std::string, DistinctQuery> distinct_queries;
+    std::vector <DistinctQuery*>                    distinct_order;
+    
     VectorFP   scoreCache,
                insertCache,
                deleteCache;
     
-    #pragma omp parallel shared (automatonState, fasta_result, sequences_read, sequences_written, args, refName, refSequence, alignmentScoring) private (nameLengths, seqLengths, names, sequences, scoreCache,insertCache,deleteCache)
+    #pragma omp parallel shared (automatonState, fasta_result, sequences_read, sequences_written, sequences_reused, args, refName, refSequence, alignmentScoring, codonReference, strandIndex, alignmentCache, previousOutput, outputIndex, distinct_queries, distinct_order) private (nameLengths, seqLengths, names, sequences, scoreCache,insertCache,deleteCache)
+    {
     while (fasta_result == 2) {
         
+        auto count_query = [&] () {
+#pragma omp critical
+            {
+                sequences_read++;
+                
+                if (args.quiet == false && sequences_read % 100 == 0) {
+                    cerr << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b" << setw(8) << sequences_read << " sequences";
+                }
+            }
+        };
+        
+        auto report_alignment = [&] (const char * seq_name, const uint64_t content, const char * seq_tag, char * alignedRefSeq, char * alignedQrySeq) {
+            if (alignedQrySeq) {
+                if (args.out_format == pairwise) {
+#pragma omp critical
+                    {
+                            
+                        fprintf (args.output, ">%s\n%s\n>%s%s\n%s\n", refName.getString(), alignedRefSeq, seq_name, seq_tag, alignedQrySeq);
+                    }
+                    
+                } else {
+#pragma omp critical
+                    {
+                        if (args.include_reference) {
+                            if (sequences_written == 0) {
+                                fprintf (args.output, ">%s\n%s\n", refName.getString(), refSequence.getString());
+                            }
+                        }
+ 
+                        if (args.out_format == refalign) {
+                           for (int i = 0; alignedRefSeq[i]; i++) {
+                               if (alignedRefSeq[i] == '-') {
+                                   alignedQrySeq[i] = tolower (alignedQrySeq[i]);
+                               }
+                           }
+                       }
+
+                       const long offset = outputIndex ? ftell (args.output) : 0;
+                       fprintf (args.output, ">%s%s\n%s\n", seq_name, seq_tag, alignedQrySeq);
+                       if (outputIndex) {
+                           outputIndex->Add (seq_name, content, offset, ftell (args.output) - offset);
+                       }
+                    }
+                    
+                    
+#pragma omp atomic
+                    sequences_written ++;
+                }
+                if (alignedRefSeq) {
+                    delete [] (alignedRefSeq);
+                }
+                delete [] (alignedQrySeq);
+            }
+            
+            count_query ();
+        };
+        
+        // (with --previous) copies the record of an unchanged query from the previous output
+        auto report_previous = [&] (const char * seq_name, const uint64_t content, const char * record, const size_t length) {
+#pragma omp critical
+            {
+                if (args.include_reference) {
+                    if (sequences_written == 0) {
+                        fprintf (args.output, ">%s\n%s\n", refName.getString(), refSequence.getString());
+                    }
+                }
+                
+                const long offset = outputIndex ? ftell (args.output) : 0;
+                fwrite (record, 1, length, args.output);
+                if (outputIndex) {
+                    outputIndex->Add (seq_name, content, offset, length);
+                }
+            }
+            
+#pragma omp atomic
+            sequences_written ++;
+#pragma omp atomic
+            sequences_reused ++;
+            
+            count_query ();
+        };
+        
+        // (called inside the critical section that reads the query) decides what is done with a query; with --dedup,
+        // also finds or adds the distinct sequence of the query, the first copy of which is the one aligned
+        auto register_query = [&] (StringBuffer& name, StringBuffer& sequence, const uint64_t content, const bool reused, DistinctQuery*& distinct) -> query_action_t {
+            if (!args.dedup) {
+                return reused ? copy_previous : align_query;
+            }
+            auto found = distinct_queries.emplace (std::string (sequence.getString()), DistinctQuery ());
+            distinct = &found.first->second;
+            if (found.second) {
+                distinct->first_name = name.getString();
+                distinct->content    = content;
+                distinct->claimed    = !reused;
+                distinct_order.push_back (distinct);
+                return reused ? copy_previous : align_query;
+            }
+            distinct->copies++;
+            if (reused) {
+                return copy_previous;
+            }
+            if (!distinct->claimed) {
+                distinct->claimed = true;
+                return align_query;
+            }
+            if (distinct->aligned) {
+                return copy_stored;
+            }
+            distinct->pending.push_back (name.getString());
+            return copy_pending;
+        };
+        
+        // (inside the critical section that reads the query) the hash of a query, and whether its record can be
+        // copied from the previous output
+        auto find_previous = [&] (StringBuffer& name, StringBuffer& sequence, uint64_t& content, const char *& record, size_t& length) -> bool {
+            if (!hash_queries) {
+                return false;
+            }
+            content = ContentHash (sequence.getString(), sequence.length());
+            return previousOutput && previousOutput->Find (name.getString(), content, record, length);
+        };
+        
+        // (with --dedup) reports the stored alignment of a distinct sequence under the name of another copy
+        auto report_copy = [&] (DistinctQuery* distinct, const char * seq_name) {
+            report_alignment (seq_name, distinct->content, distinct->tag, copy_string (distinct->aligned_ref), copy_string (distinct->aligned_qry));
+        };
+        
+        // reports the alignment of a query; with --dedup, the alignment of its (distinct) sequence is also stored,
+        // and reported for the copies that were waiting for it
+        auto report_query = [&] (DistinctQuery* distinct, const char * seq_name, const uint64_t content, const char * seq_tag, char * alignedRefSeq, char * alignedQrySeq) {
+            std::vector <std::string> pending;
+            if (distinct) {
+                #pragma omp critical
+                {
+                    distinct->aligned_ref = copy_string (alignedRefSeq);
+                    distinct->aligned_qry = copy_string (alignedQrySeq);
+                    distinct->tag         = seq_tag;
+                    distinct->aligned     = true;
+                    pending.swap (distinct->pending);
+                }
+            }
+            report_alignment (seq_name, content, seq_tag, alignedRefSeq, alignedQrySeq);
+            for (const std::string& name : pending) {
+                report_copy (distinct, name.c_str());
+            }
+        };
+        
+        // with -R, a query whose k-mers clearly match one strand of the reference is turned to that strand
+        // (and tagged), and aligned once; returns true if both strands of the query need to be aligned instead
+        auto orient_query = [&] (StringBuffer& sequence, const long length, const char *& seq_tag) -> bool {
+            if (args.reverse_complement == none) {
+                return false;
+            }
+            const long strand = QueryStrand (strandIndex, sequence.getString(), length);
+            if (strand < 0) {
+                reverseComplement(sequence, 0, length-1);
+                seq_tag = args.reverse_complement == annotated ? rc_tag : empty_tag;
+            }
+            return strand == 0;
+        };
+        
         StringBuffer names,
                      sequences;
 
@@ -124,6 +419,15 @@ int main (int argc, const char * argv[]) {
         long           sequenceLength = 0;
         const   char * rc_seq_tag = empty_tag;
         
+        // what is done with the query (see register_query), and (with --dedup) its distinct sequence
+        DistinctQuery * distinct = nullptr;
+        query_action_t  query_action = align_query;
+        
+        // with --index or --previous, the hash of the query, and its record in the previous output
+        uint64_t        content = 0;
+        const char    * previous_record = nullptr;
+        size_t          previous_length = 0;
+        
         #pragma omp critical
         {
             fasta_result = readFASTA (args.input, automatonState, names, sequences, nameLengths, seqLengths, sequenceLength, true);
@@ -131,6 +435,34 @@ int main (int argc, const char * argv[]) {
             if (fasta_result == 1) {
                 ERROR_NO_USAGE ("Error reading the input FASTA file.");
             }
+            if (fasta_result == 2 || (fasta_result == 3 && names.length() > 0)) {
+                const bool reused = find_previous (names, sequences, content, previous_record, previous_length);
+                query_action = register_query (names, sequences, content, reused, distinct);
+            }
+        }
+        
+        if (query_action != align_query) {
+            if (query_action == copy_stored) {
+                report_copy (distinct, names.getString());
+            } else if (query_action == copy_previous) {
+                report_previous (names.getString(), content, previous_record, previous_length);
+            }
+            continue;
+        }
+        
+        // with --cache, the query as read (the key of its cache entry); queries found in the cache are not aligned
+        std::string query_as_read;
+        
+        if (alignmentCache && (fasta_result == 2 || (fasta_result == 3 && names.length() > 0))) {
+            char * cachedRefSeq = nullptr,
+                 * cachedQrySeq = nullptr;
+            bool   reversed = false;
+            
+            query_as_read = sequences.getString();
+            if (alignmentCache->Lookup (sequences, sequenceLength, cachedRefSeq, cachedQrySeq, reversed)) {
+                report_query (distinct, names.getString(), content, reversed && args.reverse_complement == annotated ? rc_tag : empty_tag, cachedRefSeq, cachedQrySeq);
+                continue;
+            }
         }
         
         auto handle_rc = [&] (cawlign_fp direct_score, cawlign_fp rc_score, char*& rd, char*& qd, char *rr, char *qr) {
@@ -154,17 +486,62 @@ int main (int argc, const char * argv[]) {
             
             cawlign_fp score;
             
-             
+            const bool both_strands = orient_query (sequences, sequenceLength, rc_seq_tag);
         
             if (args.data_type != data_t::codon) {
-                if (args.space_type == quadratic) {
-                    cawlign_fp forward_score = AlignStrings(
+                if (args.space_type != linear) {
+                    auto align_to_reference = [&] (char*& aligned_ref, char*& aligned_qry) -> cawlign_fp {
+                        if (args.space_type == wavefront) {
+                            return AlignStringsWavefront(
+                                             refSequence.getString(),
+                                             sequences.getString(),
+                                             referenceSequenceLength,
+                                             sequenceLength,
+                                             aligned_ref,
+                                             aligned_qry,
+                                             alignmentScoring->char_map,
+                                             alignmentScoring->scoring_matrix.values(),
+                                             alignmentScoring->D+1,
+                                             alignmentScoring->gap_char,
+                                             alignmentScoring->open_gap_reference,
+                                             alignmentScoring->extend_gap_reference,
+                                             alignmentScoring->open_gap_query,
+                                             alignmentScoring->extend_gap_query,
+                                             args.local_option == trim,
+                                             args.affine,
+                                             args.local_option == local,
+                                             args.out_format != refmap
+                                             );
+                        }
+                        if (args.space_type == banded) {
+                            return AlignStringsBanded(
+                                             refSequence.getString(),
+                                             sequences.getString(),
+                                             referenceSequenceLength,
+                                             sequenceLength,
+                                             aligned_ref,
+                                             aligned_qry,
+                                             alignmentScoring->char_map,
+                                             alignmentScoring->scoring_matrix.values(),
+                                             alignmentScoring->D+1,
+                                             alignmentScoring->gap_char,
+                                             alignmentScoring->open_gap_reference,
+                                             alignmentScoring->extend_gap_reference,
+                                             alignmentScoring->open_gap_query,
+                                             alignmentScoring->extend_gap_query,
+                                             args.local_option == trim,
+                                             args.affine,
+                                             args.local_option == local,
+                                             args.out_format != refmap
+                                             );
+                        }
+                        return AlignStrings(
                                          refSequence.getString(),
                                          sequences.getString(),
                                          referenceSequenceLength,
                                          sequenceLength,
-                                         alignedRefSeq,
-                                         alignedQrySeq,
+                                         aligned_ref,
+                                         aligned_qry,
                                          alignmentScoring->char_map,
                                          alignmentScoring->scoring_matrix.values(),
                                          alignmentScoring->D+1,
@@ -180,44 +557,19 @@ int main (int argc, const char * argv[]) {
                                          alignmentScoring->D,
                                          nullptr,
                                          nullptr,
-                                         nullptr,
-                                         nullptr,
                                          args.local_option == local,
                                          args.out_format != refmap
                                          );
+                    };
                     
-                    if (args.reverse_complement != none) {
+                    cawlign_fp forward_score = align_to_reference (alignedRefSeq, alignedQrySeq);
+                    
+                    if (both_strands) {
                         reverseComplement(sequences, 0, sequenceLength-1);
                         char * alignedRefSeqRC = nullptr,
                              * alignedQrySeqRC = nullptr;
                         
-                        cawlign_fp rc_score = AlignStrings(
-                                             refSequence.getString(),
-                                             sequences.getString(),
-                                             referenceSequenceLength,
-                                             sequenceLength,
-                                             alignedRefSeqRC,
-                                             alignedQrySeqRC,
-                                             alignmentScoring->char_map,
-                                             alignmentScoring->scoring_matrix.values(),
-                                             alignmentScoring->D+1,
-                                             alignmentScoring->gap_char,
-                                             alignmentScoring->open_gap_reference,
-                                             alignmentScoring->extend_gap_reference,
-                                             alignmentScoring->open_gap_query,
-                                             alignmentScoring->extend_gap_query,
-                                             0.,
-                                             args.local_option == trim,
-                                             args.affine,
-                                             false,
-                                             alignmentScoring->D,
-                                             nullptr,
-                                             nullptr,
-                                             nullptr,
-                                             nullptr,
-                                             args.local_option == local,
-                                             args.out_format != refmap
-                                             );
+                        cawlign_fp rc_score = align_to_reference (alignedRefSeqRC, alignedQrySeqRC);
                         
                         handle_rc (forward_score, rc_score, alignedRefSeq, alignedQrySeq, alignedRefSeqRC, alignedQrySeqRC);
                     }
@@ -240,79 +592,58 @@ int main (int argc, const char * argv[]) {
                         ops[i] = -2;
                     }
                     
-                    cawlign_fp forward_score = LinearSpaceAlign (refSequence.getString(),
-                                              sequences.getString(),
-                                              referenceSequenceLength,
-                                              sequenceLength,
-                                              alignmentScoring->char_map,
-                                              alignmentScoring->scoring_matrix.values(),
-                                              alignmentScoring->D+1,
-                                              alignmentScoring->open_gap_reference,
-                                              alignmentScoring->extend_gap_reference,
-                                              alignmentScoring->open_gap_query,
-                                              alignmentScoring->extend_gap_query,
-                                              args.local_option == trim,
-                                              args.affine,
-                                              ops,
-                                              score,
-                                              0,
-                                              referenceSequenceLength,
-                                              0,
-                                              sequenceLength,
-                                              data_buffers,
-                                              0,
-                                              alignment_route);
-                    
-                    
-                    if (args.reverse_complement != none) {
-                        reverseComplement(sequences, 0, sequenceLength-1);
-                        char          *alignment_route_rc = new char[2*size_allocation] {0};
-                        long          *ops_rc = new long [referenceSequenceLength + 2];
-                        ops_rc [0] = -1;
-                        ops_rc [referenceSequenceLength + 1] = sequenceLength;
+                    if (both_strands) {
+                        // pick the strand by score alone, so that only the winning strand is aligned
+                        auto score_strand = [&] (void) -> cawlign_fp {
+                            return AlignStringsScore (refSequence.getString(),
+                                                      sequences.getString(),
+                                                      referenceSequenceLength,
+                                                      sequenceLength,
+                                                      alignmentScoring->char_map,
+                                                      alignmentScoring->scoring_matrix.values(),
+                                                      alignmentScoring->D+1,
+                                                      alignmentScoring->open_gap_reference,
+                                                      alignmentScoring->extend_gap_reference,
+                                                      alignmentScoring->open_gap_query,
+                                                      alignmentScoring->extend_gap_query,
+                                                      args.local_option == trim,
+                                                      args.affine);
+                        };
                         
-                        for (long i = 1L; i <= referenceSequenceLength; i++) {
-                            ops_rc [i] = -2;
-                        }
+                        cawlign_fp forward_score = score_strand ();
+                        reverseComplement(sequences, 0, sequenceLength-1);
+                        cawlign_fp reverse_score = score_strand ();
                         
-                        cawlign_fp reverse_score = LinearSpaceAlign (refSequence.getString(),
-                                                  sequences.getString(),
-                                                  referenceSequenceLength,
-                                                  sequenceLength,
-                                                  alignmentScoring->char_map,
-                                                  alignmentScoring->scoring_matrix.values(),
-                                                  alignmentScoring->D+1,
-                                                  alignmentScoring->open_gap_reference,
-                                                  alignmentScoring->extend_gap_reference,
-                                                  alignmentScoring->open_gap_query,
-                                                  alignmentScoring->extend_gap_query,
-                                                  args.local_option == trim,
-                                                  args.affine,
-                                                  ops_rc,
-                                                  score,
-                                                  0,
-                                                  referenceSequenceLength,
-                                                  0,
-                                                  sequenceLength,
-                                                  data_buffers,
-                                                  0,
-                                                  alignment_route_rc);
-
                         if (reverse_score > forward_score) {
                             rc_seq_tag = args.reverse_complement == annotated ? rc_tag : empty_tag;
-                            delete [] alignment_route;
-                            delete [] ops;
-                            
-                            alignment_route = alignment_route_rc;
-                            ops = ops_rc;
-                            
                         } else {
                             reverseComplement(sequences, 0, sequenceLength-1);
-                            delete [] alignment_route_rc;
-                            delete [] ops_rc;
                         }
                     }
                     
+                    LinearSpaceAlign (refSequence.getString(),
+                                      sequences.getString(),
+                                      referenceSequenceLength,
+                                      sequenceLength,
+                                      alignmentScoring->char_map,
+                                      alignmentScoring->scoring_matrix.values(),
+                                      alignmentScoring->D+1,
+                                      alignmentScoring->open_gap_reference,
+                                      alignmentScoring->extend_gap_reference,
+                                      alignmentScoring->open_gap_query,
+                                      alignmentScoring->extend_gap_query,
+                                      args.local_option == trim,
+                                      args.affine,
+                                      ops,
+                                      score,
+                                      0,
+                                      referenceSequenceLength,
+                                      0,
+                                      sequenceLength,
+                                      data_buffers,
+                                      0,
+                                      alignment_route);
+                    
                     StringBuffer     result1,
                                      result2;
                     
@@ -414,20 +745,80 @@ int main (int argc, const char * argv[]) {
  
                 CawalignCodonScores* codonScoring = ( CawalignCodonScores*)alignmentScoring;
                 
-                long score_size = (referenceSequenceLength / 3 + 1) * (sequenceLength + 1);
-                scoreCache.storeValue(0.,score_size-1);
-                if (args.affine) {
-                    insertCache.storeValue(0.,score_size-1);
-                    deleteCache.storeValue(0.,score_size-1);
-                }
-                
-                cawlign_fp forward_score = AlignStrings(
+                auto align_codons = [&] (char*& aligned_ref, char*& aligned_qry) -> cawlign_fp {
+                    if (args.space_type == linear) {
+                        return AlignStringsCodonLinear(
+                                         refSequence.getString(),
+                                         sequences.getString(),
+                                         referenceSequenceLength,
+                                         sequenceLength,
+                                         aligned_ref,
+                                         aligned_qry,
+                                         alignmentScoring->char_map,
+                                         alignmentScoring->scoring_matrix.values(),
+                                         alignmentScoring->D+1,
+                                         alignmentScoring->gap_char,
+                                         alignmentScoring->open_gap_reference,
+                                         alignmentScoring->extend_gap_reference,
+                                         alignmentScoring->open_gap_query,
+                                         alignmentScoring->extend_gap_query,
+                                         codonScoring->frameshift_cost,
+                                         args.local_option == trim,
+                                         args.affine,
+                                         4,
+                                         codonScoring->s3x2.values(),
+                                         codonScoring->s3x1.values(),
+                                         args.local_option == local,
+                                         args.out_format != refmap,
+                                         codonScoring->resolutions.rvalues (),
+                                         codonReference
+                                         );
+                    }
+                    
+                    if (args.space_type == banded) {
+                        return AlignStringsCodonBanded(
+                                         refSequence.getString(),
+                                         sequences.getString(),
+                                         referenceSequenceLength,
+                                         sequenceLength,
+                                         aligned_ref,
+                                         aligned_qry,
+                                         alignmentScoring->char_map,
+                                         alignmentScoring->scoring_matrix.values(),
+                                         alignmentScoring->D+1,
+                                         alignmentScoring->gap_char,
+                                         alignmentScoring->open_gap_reference,
+                                         alignmentScoring->extend_gap_reference,
+                                         alignmentScoring->open_gap_query,
+                                         alignmentScoring->extend_gap_query,
+                                         codonScoring->frameshift_cost,
+                                         args.local_option == trim,
+                                         args.affine,
+                                         4,
+                                         codonScoring->s3x2.values(),
+                                         codonScoring->s3x1.values(),
+                                         codonScoring->translation_table.rvalues (),
+                                         args.local_option == local,
+                                         args.out_format != refmap,
+                                         codonScoring->resolutions.rvalues (),
+                                         codonReference
+                                         );
+                    }
+                    
+                    long score_size = (referenceSequenceLength / 3 + 1) * (sequenceLength + 1);
+                    scoreCache.storeValue(0.,score_size-1);
+                    if (args.affine) {
+                        insertCache.storeValue(0.,score_size-1);
+                        deleteCache.storeValue(0.,score_size-1);
+                    }
+                    
+                    return AlignStrings(
                                      refSequence.getString(),
                                      sequences.getString(),
                                      referenceSequenceLength,
                                      sequenceLength,
-                                     alignedRefSeq,
-                                     alignedQrySeq,
+                                     aligned_ref,
+                                     aligned_qry,
                                      alignmentScoring->char_map,
                                      alignmentScoring->scoring_matrix.values(),
                                      alignmentScoring->D+1,
@@ -441,8 +832,6 @@ int main (int argc, const char * argv[]) {
                                      args.affine,
                                      true,
                                      4,
-                                     codonScoring->s3x5.values(),
-                                     codonScoring->s3x4.values(),
                                      codonScoring->s3x2.values(),
                                      codonScoring->s3x1.values(),
                                      args.local_option == local,
@@ -450,111 +839,75 @@ int main (int argc, const char * argv[]) {
                                      scoreCache.rvalues(),
                                      insertCache.rvalues(),
                                      deleteCache.rvalues(),
-                                     codonScoring->resolutions.rvalues ()
+                                     codonScoring->resolutions.rvalues (),
+                                     codonReference
                                      );
+                };
+                
+                cawlign_fp forward_score = align_codons (alignedRefSeq, alignedQrySeq);
                 
-                if (args.reverse_complement != none) {
+                if (both_strands) {
                     reverseComplement(sequences, 0, sequenceLength-1);
                     char * alignedRefSeqRC = nullptr,
                          * alignedQrySeqRC = nullptr;
                     
-                    scoreCache.storeValue(0.,score_size-1);
-                    if (args.affine) {
-                        insertCache.storeValue(0.,score_size-1);
-                        deleteCache.storeValue(0.,score_size-1);
-                    }
-                    
-                    cawlign_fp rc_score = AlignStrings(
-                                           refSequence.getString(),
-                                           sequences.getString(),
-                                           referenceSequenceLength,
-                                           sequenceLength,
-                                           alignedRefSeqRC,
-                                           alignedQrySeqRC,
-                                           alignmentScoring->char_map,
-                                           alignmentScoring->scoring_matrix.values(),
-                                           alignmentScoring->D+1,
-                                           alignmentScoring->gap_char,
-                                           alignmentScoring->open_gap_reference,
-                                           alignmentScoring->extend_gap_reference,
-                                           alignmentScoring->open_gap_query,
-                                           alignmentScoring->extend_gap_query,
-                                           codonScoring->frameshift_cost,
-                                           args.local_option == trim,
-                                           args.affine,
-                                           true,
-                                           4,
-                                           codonScoring->s3x5.values(),
-                                           codonScoring->s3x4.values(),
-                                           codonScoring->s3x2.values(),
-                                           codonScoring->s3x1.values(),
-                                           args.local_option == local,
-                                           args.out_format != refmap,
-                                           scoreCache.rvalues(),
-                                           insertCache.rvalues(),
-                                           deleteCache.rvalues(),
-                                           codonScoring->resolutions.rvalues ()
-                                           );
+                    cawlign_fp rc_score = align_codons (alignedRefSeqRC, alignedQrySeqRC);
                     
                     handle_rc (forward_score, rc_score, alignedRefSeq, alignedQrySeq, alignedRefSeqRC, alignedQrySeqRC);
 
                 }
             }
             
-            if (alignedQrySeq) {
-                if (args.out_format == pairwise) {
-#pragma omp critical
-                    {
-                            
-                        fprintf (args.output, ">%s\n%s\n>%s%s\n%s\n", refName.getString(), alignedRefSeq, names.getString(), rc_seq_tag, alignedQrySeq);
-                    }
-                    
-                } else {
-#pragma omp critical
-                    {
-                        if (args.include_reference) {
-                            if (sequences_written == 0) {
-                                fprintf (args.output, ">%s\n%s\n", refName.getString(), refSequence.getString());
-                            }
-                        }
- 
-                        if (args.out_format == refalign) {
-                           for (int i = 0; alignedRefSeq[i]; i++) {
-                               if (alignedRefSeq[i] == '-') {
-                                   alignedQrySeq[i] = tolower (alignedQrySeq[i]);
-                               }
-                           }
-                       }
-
-                       fprintf (args.output, ">%s%s\n%s\n", names.getString(), rc_seq_tag, alignedQrySeq);
-                    }
-                    
-                    
-#pragma omp atomic
-                    sequences_written ++;
-                }
-                if (alignedRefSeq) {
-                    delete [] (alignedRefSeq);
-                }
-                delete [] (alignedQrySeq);
+            if (alignmentCache) {
+                alignmentCache->Store (query_as_read.c_str(), sequences.getString(), alignedRefSeq, alignedQrySeq);
             }
             
-#pragma omp critical
-            {
-                sequences_read++;
-                
-                if (args.quiet == false && sequences_read % 100 == 0) {
-                    cerr << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b" << setw(8) << sequences_read << " sequences";
-                }
-            }
+            report_query (distinct, names.getString(), content, rc_seq_tag, alignedRefSeq, alignedQrySeq);
             
         }
     }
     
+    // no queries are left for this thread; while it waits for the others, it helps fill their DP matrices
+    AlignmentThreadIdle ();
+    }
+    
     if (args.quiet == false) {
       cerr << endl;
     }
     
+    if (args.counts) {
+        fprintf (args.counts, "name\tcopies\n");
+    }
+    for (DistinctQuery* distinct : distinct_order) {
+        if (args.counts) {
+            fprintf (args.counts, "%s\t%ld\n", distinct->first_name.c_str(), distinct->copies);
+        }
+        delete [] distinct->aligned_ref;
+        delete [] distinct->aligned_qry;
+    }
+    
+    if (codonReference) {
+        delete codonReference;
+    }
+    if (strandIndex) {
+        delete strandIndex;
+    }
+    if (alignmentCache) {
+        alignmentCache->Evict ();
+        if (args.quiet == false) {
+            alignmentCache->ReportStatistics (stderr);
+        }
+        delete alignmentCache;
+    }
+    if (previousOutput) {
+        if (args.quiet == false) {
+            fprintf (stderr, "previous output: %ld records reused\n", sequences_reused);
+        }
+        delete previousOutput;
+    }
+    if (outputIndex) {
+        delete outputIndex;
+    }
     if (alignmentScoring) {
         delete alignmentScoring;
     }
@@ -0,0 +1,170 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "output_index.h"
+#include "alignment_cache.h"
+#include "argparse.hpp"
+
+using namespace argparse;
+
+// the header of every index is "INDEX_FORMAT INDEX_VERSION <settings hash>"; changing the layout of the index
+// should change the version, so that old indices are not used
+#define INDEX_FORMAT  "cawlign-index"
+#define INDEX_VERSION 1
+
+//____________________________________________________________________________________
+
+uint64_t ContentHash ( const char * sequence, const size_t length ) {
+    return MixHash ( HashBytes ( HASH_BASIS, sequence, length ) );
+}
+
+//____________________________________________________________________________________
+
+OutputIndex::OutputIndex ( const char * output_path, const uint64_t settings ) {
+    const std::string path = std::string ( output_path ) + ".idx";
+    index = fopen ( path.c_str (), "wb" );
+    if ( !index ) {
+        ERROR_NO_USAGE ( "failed to open the output index %s: %s", path.c_str (), strerror ( errno ) );
+    }
+    fprintf ( index, "%s %d %016" PRIx64 "\n", INDEX_FORMAT, INDEX_VERSION, settings );
+}
+
+OutputIndex::~OutputIndex ( void ) {
+    fclose ( index );
+}
+
+void OutputIndex::Add ( const char * name, const uint64_t content, const long offset, const long length ) {
+    fprintf ( index, "%ld\t%ld\t%016" PRIx64 "\t%s\n", offset, length, content, name );
+}
+
+//____________________________________________________________________________________
+
+PreviousOutput::PreviousOutput ( const char * output_path, const uint64_t settings ) :
+    data (nullptr),
+    size (0),
+    usable (false)
+{
+    const int file = open ( output_path, O_RDONLY );
+    struct stat info;
+    if ( file < 0 || fstat ( file, &info ) != 0 ) {
+        ERROR_NO_USAGE ( "failed to open the previous output %s: %s", output_path, strerror ( errno ) );
+    }
+    size = info.st_size;
+    if ( size > 0 ) {
+        // the records which are reused are copied straight from the mapped file
+        data = (char *) mmap ( nullptr, size, PROT_READ, MAP_PRIVATE, file, 0 );
+        if ( data == MAP_FAILED ) {
+            ERROR_NO_USAGE ( "failed to map the previous output %s: %s", output_path, strerror ( errno ) );
+        }
+    }
+    close ( file );
+
+    const std::string path = std::string ( output_path ) + ".idx";
+    FILE * index = fopen ( path.c_str (), "rb" );
+    if ( !index ) {
+        ERROR_NO_USAGE ( "failed to open the index of the previous output %s (written by --index): %s", path.c_str (), strerror ( errno ) );
+    }
+
+    char     format [32];
+    int      version = 0;
+    uint64_t index_settings = 0;
+    if ( fscanf ( index, "%31s %d %" SCNx64, format, &version, &index_settings ) != 3 || strcmp ( format, INDEX_FORMAT ) != 0 ) {
+        ERROR_NO_USAGE ( "%s is not a cawlign output index", path.c_str () );
+    }
+
+    // an index in another version, or of an output made with other settings, is not used
+    usable = version == INDEX_VERSION && index_settings == settings;
+
+    std::string line;
+    int c;
+    while ( ( c = fgetc ( index ) ) != EOF && c != '\n' ) {
+    }
+
+    while ( usable && c != EOF ) {
+        line.clear ();
+        while ( ( c = fgetc ( index ) ) != EOF && c != '\n' ) {
+            line += (char) c;
+        }
+        if ( line.empty () ) {
+            continue;
+        }
+
+        // offset, length, content hash, name
+        const size_t length_start  = line.find ( '\t' ) + 1,
+                     content_start = length_start ? line.find ( '\t', length_start ) + 1 : 0,
+                     name_start    = content_start ? line.find ( '\t', content_start ) + 1 : 0;
+
+        Record record;
+        record.offset  = strtoull ( line.c_str (), nullptr, 10 );
+        record.length  = strtoull ( line.c_str () + length_start, nullptr, 10 );
+        record.content = strtoull ( line.c_str () + content_start, nullptr, 16 );
+
+        if ( name_start == 0 || record.length == 0 || record.offset + record.length > size || data[ record.offset ] != '>' ) {
+            ERROR_NO_USAGE ( "the index of the previous output %s does not match the output", path.c_str () );
+        }
+        records[ line.substr ( name_start ) ] = record;
+    }
+
+    fclose ( index );
+}
+
+PreviousOutput::~PreviousOutput ( void ) {
+    if ( data ) {
+        munmap ( data, size );
+    }
+}
+
+bool PreviousOutput::Find ( const char * name, const uint64_t content, const char *& record, size_t & length ) const {
+    auto found = records.find ( name );
+    if ( found == records.end () || found->second.content != content ) {
+        return false;
+    }
+    record = data + found->second.offset;
+    length = found->second.length;
+    return true;
+}
@@ -0,0 +1,144 @@
+/*
+
+ HyPhy - Hypothesis Testing Using Phylogenies.
+
+ Copyright (C) 1997-now
+ Core Developers:
+ Sergei L Kosakovsky Pond (spond@ucsd.edu)
+ Art FY Poon    (apoon42@uwo.ca)
+ Steven Weaver (sweaver@ucsd.edu)
+
+ Module Developers:
+ Lance Hepler (nlhepler@gmail.com)
+ Martin Smith (martin.audacis@gmail.com)
+
+ Significant contributions from:
+ Spencer V Muse (muse@stat.ncsu.edu)
+ Simon DW Frost (sdf22@cam.ac.uk)
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef __OUTPUT_INDEX_HEADER_FILE__
+
+#define __OUTPUT_INDEX_HEADER_FILE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+
+/**
+ * The index of a refmap or refalign output file, written next to it as <output>.idx (--index). It lists, for each query
+ * record, where the record is in the file, a hash of the query sequence (as read) and the name of the query, under a
+ * header with a hash of the settings (the reference, the scoring and the alignment options) the output was made with.
+ *
+ * Index lines are "offset<TAB>length<TAB>content hash<TAB>name"; the name is last, so that it may contain tabs.
+ */
+
+class OutputIndex {
+    public:
+        /**
+         * Creates the index of an output file (and writes its header)
+         *
+         * @param output_path the output file; the index is written to output_path.idx
+         * @param settings a hash (see HashSetting) of everything other than the queries that the alignments depend on
+         */
+        OutputIndex  ( const char * output_path, const uint64_t settings );
+        ~OutputIndex ( void );
+
+        OutputIndex (const OutputIndex&) = delete;
+        OutputIndex& operator= (const OutputIndex&) = delete;
+
+        /**
+         * Adds a record (not thread safe: call from the critical section that writes the record)
+         *
+         * @param name the name of the query (as read, without the strand tag)
+         * @param content the hash of the query (see ContentHash)
+         * @param offset where the record starts in the output file
+         * @param length the length of the record in bytes
+         */
+        void Add ( const char * name, const uint64_t content, const long offset, const long length );
+
+    private:
+        FILE * index;
+};
+
+/**
+ * The output of an earlier run and its index (--previous). The output is mapped into memory, and the records of
+ * queries which have not changed (the same name and sequence) are copied from it instead of being aligned again.
+ */
+
+class PreviousOutput {
+    public:
+        /**
+         * Maps an earlier output file and reads its index (output_path.idx); exits with an error if either can
+         * not be read. If the output was made with different settings, none of its records are used.
+         *
+         * @param output_path the earlier output file
+         * @param settings the hash of the settings of this run (see OutputIndex)
+         */
+        PreviousOutput  ( const char * output_path, const uint64_t settings );
+        ~PreviousOutput ( void );
+
+        PreviousOutput (const PreviousOutput&) = delete;
+        PreviousOutput& operator= (const PreviousOutput&) = delete;
+
+        /**
+         * @return true if the settings of the earlier run match those of this run
+         */
+        bool Usable ( void ) const { return usable; }
+
+        /**
+         * Finds the record of an unchanged query (thread safe: the index is not modified after it is read)
+         *
+         * @param name the name of the query (as read)
+         * @param content the hash of the query (see ContentHash)
+         * @param record (out) the record in the mapped file, if found
+         * @param length (out) the length of the record in bytes
+         * @return true if the earlier output has a record for this name and the query has not changed
+         */
+        bool Find ( const char * name, const uint64_t content, const char *& record, size_t & length ) const;
+
+    private:
+        struct Record {
+            uint64_t content;
+            size_t   offset,
+                     length;
+        };
+
+        std::unordered_map <std::string, Record> records;
+        // by query name (if an earlier output has several records with the same name, the last one is used)
+
+        char   * data;
+        size_t   size;
+        bool     usable;
+};
+
+/**
+ * @name ContentHash
+ * @return the hash of a query sequence (as read) that OutputIndex and PreviousOutput compare
+ */
+
+uint64_t ContentHash ( const char * sequence, const size_t length );
+
+#endif
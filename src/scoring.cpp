@@ -347,25 +347,11 @@ CawalignCodonScores::CawalignCodonScores (ConfigParser * settings) {
             cawlign_fp max001 = -1e100;
             
             for ( long d2 = 0; d2 < 4; d2 += 1 ) {
-                long partialCodon = 4 * d1 + d2;
                 cawlign_fp max110 = -1e100;
                 cawlign_fp max101 = -1e100;
                 cawlign_fp max011 = -1e100;
                 
                 for ( long d3 = 0; d3 < 4; d3 += 1 ) {
-                    long thisCodon2 = 4 * partialCodon + d3;
-                    cawlign_fp thisScore = scoring_matrix.value(thisCodon * 65 +  thisCodon2);
-                    
-                    // this is the trivial and stupid way of doing it, but it should work
-                    
-                    for ( long i = 0; i < 10; i++) {
-                        s3x5.appendValue (thisScore);
-                    }
-                    
-                    for ( long i = 0; i < 4; i++) {
-                        s3x4.appendValue (thisScore);
-                    }
-                    
                     // d1 is 1
                     max100 = MAX( max100, scoring_matrix.value( thisCodon * 65 + 16 * d1 + 4 * d2 + d3  ));
                     max010 = MAX( max010, scoring_matrix.value( thisCodon * 65 + 16 * d2 + 4 * d1 + d3  ));
@@ -396,11 +382,11 @@ CawalignCodonScores::CawalignCodonScores (ConfigParser * settings) {
         }
     };
     
-    pad_vector (s3x1, 10);
+    pad_vector (s3x1, 12);
     pad_vector (s3x2, 48);
-    pad_vector (s3x4, 256);
-    pad_vector (s3x5, 640);
     
+    // 3x4 and 3x5 matches score the three query characters they keep as a codon, using scoring_matrix directly;
+    // its first 64 entries for the unresolved reference codon are "0", as in the other partial score matrices
     
     open_gap_reference    = settings->aConfig<cawlign_fp>("PARAMETERS", "open_deletion");
     open_gap_query        = settings->aConfig<cawlign_fp>("PARAMETERS", "open_insertion");
@@ -74,11 +74,9 @@ class CawalignCodonScores : public CawalignSimpleScores {
         // if char_map[i] < -1, then indexing into this array using (-char_map[i]-2)*4 index will
         // return a four integer map, with 0 indicating that the corresponding character is not in the resolution, and 1 - that it is
     
-        // partial score tables
+        // partial score tables (3x4 and 3x5 matches are scored by scoring_matrix)
         VectorFP          s3x1,
-                              s3x2,
-                              s3x4,
-                              s3x5;
+                              s3x2;
         
         // the cost of introducing frameshits
         cawlign_fp                frameshift_cost,